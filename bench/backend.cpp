@@ -0,0 +1,203 @@
+/*
+ * 反向代理测试与压测用的本地后端：每个连接一个线程，阻塞读写，HTTP/1.1 长连接。
+ * 用法: backend [--port 9001] [--name b1] [--delay-ms 0]
+ * 请求参数：
+ *   ?size=N      响应体 N 字节（默认 1024），内容为固定的字母序列，便于校验
+ *   &chunked=1   分块编码发送响应体
+ *   &close=1     不带 Content-Length，发完后关闭连接
+ *   &delay=MS    响应前等待，模拟慢后端
+ * POST 请求读完 Content-Length 指定的请求体，响应体为收到的字节数和简单校验和。
+ * 每个响应带 X-Backend: name，以及请求中的 X-Forwarded-For。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+
+struct Options {
+    int port = 9001;
+    std::string name = "backend";
+    int delayMs = 0;
+};
+
+static Options opt;
+static std::atomic<uint64_t> served(0);
+
+static bool SendAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return false; }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static long Param(const std::string& target, const char* key, long def) {
+    size_t q = target.find('?');
+    if (q == std::string::npos) { return def; }
+    std::string want = std::string(key) + "=";
+    size_t pos = q + 1;
+    while (pos < target.size()) {
+        size_t amp = target.find('&', pos);
+        if (target.compare(pos, want.size(), want) == 0) { return atol(target.c_str() + pos + want.size()); }
+        if (amp == std::string::npos) { break; }
+        pos = amp + 1;
+    }
+    return def;
+}
+
+static std::string Header(const std::string& head, const char* name) {
+    size_t len = strlen(name);
+    size_t pos = head.find("\r\n");
+    while (pos != std::string::npos && pos + 2 < head.size()) {
+        size_t line = pos + 2;
+        size_t eol = head.find("\r\n", line);
+        if (eol == std::string::npos) { break; }
+        if (eol - line > len && head[line + len] == ':' && strncasecmp(head.c_str() + line, name, len) == 0) {
+            size_t v = line + len + 1;
+            while (v < eol && head[v] == ' ') { v++; }
+            return head.substr(v, eol - v);
+        }
+        pos = eol;
+    }
+    return "";
+}
+
+static void Body(std::string& out, size_t size) {     // 'a'..'z' 循环，偏移 i 处为 'a' + i % 26
+    static std::string block;
+    if (block.empty()) {
+        block.resize(26 * 4096);
+        for (size_t i = 0; i < block.size(); i++) { block[i] = static_cast<char>('a' + i % 26); }
+    }
+    while (size > 0) {
+        size_t n = std::min(size, block.size());
+        out.append(block, 0, n);
+        size -= n;
+    }
+}
+
+static void Serve(int fd) {
+    std::string in;
+    char buff[65536];
+    while (true) {
+        size_t end;
+        while ((end = in.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t n = recv(fd, buff, sizeof(buff), 0);
+            if (n <= 0) {
+                close(fd);
+                return;
+            }
+            in.append(buff, n);
+        }
+        std::string head = in.substr(0, end + 4);
+        in.erase(0, end + 4);
+        size_t sp1 = head.find(' ');
+        size_t sp2 = head.find(' ', sp1 + 1);
+        std::string method = head.substr(0, sp1);
+        std::string target = head.substr(sp1 + 1, sp2 - sp1 - 1);
+        size_t length = strtoull(Header(head, "Content-Length").c_str(), nullptr, 10);
+        while (in.size() < length) {
+            ssize_t n = recv(fd, buff, sizeof(buff), 0);
+            if (n <= 0) {
+                close(fd);
+                return;
+            }
+            in.append(buff, n);
+        }
+        uint64_t sum = 0;
+        for (size_t i = 0; i < length; i++) { sum += static_cast<unsigned char>(in[i]); }
+        in.erase(0, length);
+
+        long delay = Param(target, "delay", opt.delayMs);
+        if (delay > 0) { std::this_thread::sleep_for(std::chrono::milliseconds(delay)); }
+        bool chunked = Param(target, "chunked", 0) != 0;
+        bool closeAfter = Param(target, "close", 0) != 0 || strcasecmp(Header(head, "Connection").c_str(), "close") == 0;
+        std::string body;
+        if (method == "POST") {
+            body = "received " + std::to_string(length) + " bytes, sum " + std::to_string(sum) + "\n";
+        }
+        else {
+            Body(body, static_cast<size_t>(Param(target, "size", 1024)));
+        }
+        std::string out = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nX-Backend: " + opt.name + "\r\n";
+        std::string xff = Header(head, "X-Forwarded-For");
+        if (!xff.empty()) { out += "X-Forwarded-For: " + xff + "\r\n"; }
+        if (Param(target, "close", 0) != 0) {
+            out += "Connection: close\r\n\r\n";
+        }
+        else if (chunked) {
+            out += "Transfer-Encoding: chunked\r\n\r\n";
+        }
+        else {
+            out += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+        }
+        if (method != "HEAD") {
+            if (chunked) {          // 4000 字节一块，带一个块扩展
+                for (size_t off = 0; off < body.size(); off += 4000) {
+                    size_t n = std::min<size_t>(4000, body.size() - off);
+                    char size[32];
+                    out.append(size, snprintf(size, sizeof(size), "%zx;ext=1\r\n", n));
+                    out.append(body, off, n).append("\r\n");
+                }
+                out += "0\r\n\r\n";
+            }
+            else {
+                out += body;
+            }
+        }
+        served++;
+        if (!SendAll(fd, out.data(), out.size()) || closeAfter) {
+            close(fd);
+            return;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        if (key == "--port") { opt.port = atoi(argv[i + 1]); }
+        else if (key == "--name") { opt.name = argv[i + 1]; }
+        else if (key == "--delay-ms") { opt.delayMs = atoi(argv[i + 1]); }
+        else {
+            fprintf(stderr, "usage: %s [--port p] [--name n] [--delay-ms ms]\n", argv[0]);
+            return 1;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(opt.port);
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listenFd, 1024) < 0) {
+        perror("backend: bind/listen");
+        return 1;
+    }
+    fprintf(stderr, "backend %s listening on 127.0.0.1:%d\n", opt.name.c_str(), opt.port);
+    while (true) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) { continue; }
+            perror("backend: accept");
+            return 1;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::thread(Serve, fd).detach();
+    }
+}
@@ -0,0 +1,413 @@
+/*
+ * 多线程 epoll HTTP 压测工具，结果以 JSON 输出。
+ * 用法: loadgen [--host 127.0.0.1] [--port 1025] [--threads 2] [--conns 64]
+ *               [--duration 10] [--warmup 1] [--pipeline 1] [--keepalive 1]
+ *               [--paths /index.html,/css/style.css] [--resources ../resources]
+ *               [--login-ratio 0] [--user bench] [--password bench]
+ *               [--seed 1] [--out result.json]
+ * --resources 会递归扫描目录，把其中所有文件都作为静态请求路径。
+ * --login-ratio 为 POST /login 请求所占比例，配合 server_mock 可离线压测登录路径。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <memory>
+
+typedef std::chrono::steady_clock BenchClock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 1025;
+    int threads = 2;
+    int conns = 64;
+    double duration = 10;
+    double warmup = 1;
+    int pipeline = 1;
+    bool keepAlive = true;
+    std::vector<std::string> paths;
+    double loginRatio = 0;
+    std::string user = "bench";
+    std::string password = "bench";
+    unsigned seed = 1;
+    std::string out;
+};
+
+struct Stats {                          // 每个线程独立统计，结束后合并
+    std::vector<uint32_t> latencyUs;
+    std::map<int, uint64_t> status;
+    uint64_t requests = 0;
+    uint64_t bytes = 0;
+    uint64_t connects = 0;
+    uint64_t connectErrors = 0;
+    uint64_t readErrors = 0;
+    uint64_t parseErrors = 0;
+};
+
+struct Conn {
+    uint32_t idx = 0;                   // 在所属线程连接数组中的下标，作为 epoll 数据
+    int fd = -1;
+    bool connected = false;
+    std::string wbuf;
+    size_t woff = 0;
+    std::string rbuf;
+    std::deque<BenchClock::time_point> inflight;   // 已发送请求的发送时间
+};
+
+static int64_t UsSince(BenchClock::time_point t, BenchClock::time_point now) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(now - t).count();
+}
+
+static void ScanResources(const std::string& root, const std::string& rel, std::vector<std::string>& out) {
+    DIR* dir = opendir((root + rel).c_str());
+    if (!dir) { return; }
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != nullptr) {
+        std::string name = ent->d_name;
+        if (name.empty() || name[0] == '.') { continue; }
+        std::string path = rel + "/" + name;
+        struct stat st;
+        if (stat((root + path).c_str(), &st) < 0) { continue; }
+        if (S_ISDIR(st.st_mode)) {
+            ScanResources(root, path, out);
+        }
+        else if (S_ISREG(st.st_mode)) {
+            out.push_back(path);
+        }
+    }
+    closedir(dir);
+    std::sort(out.begin(), out.end());      // 固定顺序，保证同一种子下请求序列可复现
+}
+
+class Worker {
+public:
+    Worker(const Options& opt, int id, const std::vector<std::string>& requests, const std::string& login)
+        : opt_(opt), requests_(requests), login_(login), rng_(opt.seed * 7919 + id) {
+        conns_.resize(opt.conns / opt.threads + (id < opt.conns % opt.threads ? 1 : 0));
+        memset(&addr_, 0, sizeof(addr_));
+        addr_.sin_family = AF_INET;
+        addr_.sin_port = htons(opt.port);
+        inet_pton(AF_INET, opt.host.c_str(), &addr_.sin_addr);
+    }
+
+    void Run(BenchClock::time_point start, BenchClock::time_point end) {
+        epfd_ = epoll_create1(EPOLL_CLOEXEC);
+        for (size_t i = 0; i < conns_.size(); i++) { Connect_(conns_[i], static_cast<uint32_t>(i)); }
+        std::vector<epoll_event> events(256);
+        measureFrom_ = start;
+        while (true) {
+            BenchClock::time_point now = BenchClock::now();
+            if (now >= end) { break; }
+            int n = epoll_wait(epfd_, events.data(), static_cast<int>(events.size()), 10);
+            for (int i = 0; i < n; i++) {
+                Conn& c = conns_[events[i].data.u32];
+                uint32_t ev = events[i].events;
+                if (!c.connected && (ev & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                    if (err != 0) {
+                        stats_.connectErrors++;
+                        Reconnect_(c);
+                        continue;
+                    }
+                    c.connected = true;
+                    stats_.connects++;
+                    Fill_(c);
+                }
+                if (ev & EPOLLIN) {
+                    if (!Read_(c)) {
+                        Reconnect_(c);
+                        continue;
+                    }
+                }
+                else if (ev & (EPOLLERR | EPOLLHUP)) {
+                    stats_.readErrors++;
+                    Reconnect_(c);
+                    continue;
+                }
+                if (c.fd >= 0 && c.connected && !Flush_(c)) {
+                    Reconnect_(c);
+                }
+            }
+        }
+        for (auto& c : conns_) {
+            if (c.fd >= 0) { close(c.fd); }
+        }
+        close(epfd_);
+    }
+
+    Stats& GetStats() { return stats_; }
+
+private:
+    void Connect_(Conn& c, uint32_t idx) {
+        c = Conn();
+        c.idx = idx;
+        c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        int ret = connect(c.fd, reinterpret_cast<sockaddr*>(&addr_), sizeof(addr_));
+        if (ret < 0 && errno != EINPROGRESS) {
+            stats_.connectErrors++;
+        }
+        epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+        ev.data.u32 = idx;
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, c.fd, &ev);
+    }
+
+    void Reconnect_(Conn& c) {
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, c.fd, nullptr);
+        close(c.fd);
+        Connect_(c, c.idx);
+    }
+
+    void Fill_(Conn& c) {               // 保持每个连接有 pipeline 个未完成请求
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        while (static_cast<int>(c.inflight.size()) < opt_.pipeline) {
+            bool login = opt_.loginRatio > 0 && coin(rng_) < opt_.loginRatio;
+            const std::string& req = login ? login_ : requests_[rng_() % requests_.size()];
+            c.wbuf.append(req);
+            c.inflight.push_back(BenchClock::now());
+            if (!opt_.keepAlive) { break; }     // 短连接每个连接只发一个请求
+        }
+    }
+
+    bool Flush_(Conn& c) {
+        while (c.woff < c.wbuf.size()) {
+            ssize_t n = send(c.fd, c.wbuf.data() + c.woff, c.wbuf.size() - c.woff, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN) { break; }
+                stats_.readErrors++;
+                return false;
+            }
+            c.woff += n;
+        }
+        if (c.woff == c.wbuf.size()) {
+            c.wbuf.clear();
+            c.woff = 0;
+        }
+        return true;
+    }
+
+    bool Read_(Conn& c) {
+        char buf[65536];
+        while (true) {
+            ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                c.rbuf.append(buf, n);
+                continue;
+            }
+            if (n < 0 && errno == EAGAIN) { break; }
+            if (n < 0) { stats_.readErrors++; }
+            else if (!c.inflight.empty() && !Parse_(c)) { stats_.readErrors++; }
+            return false;                   // 对端关闭
+        }
+        if (!Parse_(c)) {
+            stats_.parseErrors++;
+            return false;
+        }
+        if (!opt_.keepAlive && c.inflight.empty()) { return false; }    // 短连接收完即重连
+        Fill_(c);
+        return true;
+    }
+
+    bool Parse_(Conn& c) {              // 解析尽可能多的完整响应
+        size_t pos = 0;
+        while (!c.inflight.empty()) {
+            size_t headerEnd = c.rbuf.find("\r\n\r\n", pos);
+            if (headerEnd == std::string::npos) { break; }
+            if (c.rbuf.compare(pos, 5, "HTTP/") != 0) { return false; }
+            int status = atoi(c.rbuf.c_str() + pos + 9);
+            size_t bodyLen = 0;
+            for (size_t line = c.rbuf.find("\r\n", pos) + 2; line < headerEnd; ) {
+                size_t next = c.rbuf.find("\r\n", line);
+                if (next - line > 15 && strncasecmp(c.rbuf.c_str() + line, "content-length:", 15) == 0) {
+                    bodyLen = strtoul(c.rbuf.c_str() + line + 15, nullptr, 10);
+                }
+                line = next + 2;
+            }
+            size_t total = headerEnd + 4 + bodyLen - pos;
+            if (c.rbuf.size() - pos < total) { break; }
+            BenchClock::time_point now = BenchClock::now();
+            if (now >= measureFrom_) {      // 预热阶段的结果不计入
+                stats_.latencyUs.push_back(static_cast<uint32_t>(UsSince(c.inflight.front(), now)));
+                stats_.status[status]++;
+                stats_.requests++;
+                stats_.bytes += total;
+            }
+            c.inflight.pop_front();
+            pos += total;
+        }
+        c.rbuf.erase(0, pos);
+        return true;
+    }
+
+    const Options& opt_;
+    const std::vector<std::string>& requests_;
+    const std::string& login_;
+    std::mt19937 rng_;
+    std::vector<Conn> conns_;
+    int epfd_ = -1;
+    sockaddr_in addr_;
+    BenchClock::time_point measureFrom_;
+    Stats stats_;
+};
+
+static std::vector<std::string> Split(const std::string& s) {
+    std::vector<std::string> out;
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos) { end = s.size(); }
+        if (end > start) { out.push_back(s.substr(start, end - start)); }
+        start = end + 1;
+    }
+    return out;
+}
+
+static bool ParseArgs(int argc, char* argv[], Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string key = argv[i];
+        if (i + 1 >= argc) { return false; }
+        std::string val = argv[++i];
+        if (key == "--host") { opt.host = val; }
+        else if (key == "--port") { opt.port = atoi(val.c_str()); }
+        else if (key == "--threads") { opt.threads = atoi(val.c_str()); }
+        else if (key == "--conns") { opt.conns = atoi(val.c_str()); }
+        else if (key == "--duration") { opt.duration = atof(val.c_str()); }
+        else if (key == "--warmup") { opt.warmup = atof(val.c_str()); }
+        else if (key == "--pipeline") { opt.pipeline = atoi(val.c_str()); }
+        else if (key == "--keepalive") { opt.keepAlive = atoi(val.c_str()) != 0; }
+        else if (key == "--paths") { opt.paths = Split(val); }
+        else if (key == "--resources") { ScanResources(val, "", opt.paths); }
+        else if (key == "--login-ratio") { opt.loginRatio = atof(val.c_str()); }
+        else if (key == "--user") { opt.user = val; }
+        else if (key == "--password") { opt.password = val; }
+        else if (key == "--seed") { opt.seed = static_cast<unsigned>(atoi(val.c_str())); }
+        else if (key == "--out") { opt.out = val; }
+        else { return false; }
+    }
+    if (opt.paths.empty()) { opt.paths = { "/index.html" }; }
+    return opt.threads > 0 && opt.conns >= opt.threads && opt.duration > 0 && opt.warmup >= 0 &&
+           opt.pipeline > 0 && opt.loginRatio >= 0 && opt.loginRatio <= 1;
+}
+
+static uint32_t Percentile(const std::vector<uint32_t>& sorted, double q) {
+    if (sorted.empty()) { return 0; }
+    size_t idx = static_cast<size_t>(q * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    if (!ParseArgs(argc, argv, opt)) {
+        fprintf(stderr, "usage: %s [--host h] [--port p] [--threads n] [--conns n] [--duration s] "
+                        "[--warmup s] [--pipeline n] [--keepalive 0|1] [--paths a,b] [--resources dir] "
+                        "[--login-ratio r] [--user u] [--password p] [--seed n] [--out file]\n", argv[0]);
+        return 1;
+    }
+
+    const char* conn = opt.keepAlive ? "keep-alive" : "close";
+    std::vector<std::string> requests;
+    for (auto& path : opt.paths) {
+        requests.push_back("GET " + path + " HTTP/1.1\r\nHost: " + opt.host +
+                           "\r\nConnection: " + conn + "\r\n\r\n");
+    }
+    std::string body = "username=" + opt.user + "&password=" + opt.password;
+    std::string login = "POST /login HTTP/1.1\r\nHost: " + opt.host + "\r\nConnection: " + conn +
+                        "\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: " +
+                        std::to_string(body.size()) + "\r\n\r\n" + body;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int i = 0; i < opt.threads; i++) {
+        workers.emplace_back(new Worker(opt, i, requests, login));
+    }
+    BenchClock::time_point begin = BenchClock::now();
+    BenchClock::time_point measure = begin + std::chrono::microseconds(static_cast<int64_t>(opt.warmup * 1e6));
+    BenchClock::time_point end = measure + std::chrono::microseconds(static_cast<int64_t>(opt.duration * 1e6));
+    std::vector<std::thread> threads;
+    for (auto& w : workers) {
+        Worker* worker = w.get();
+        threads.emplace_back([worker, measure, end] { worker->Run(measure, end); });
+    }
+    for (auto& t : threads) { t.join(); }
+
+    Stats total;
+    for (auto& w : workers) {
+        Stats& s = w->GetStats();
+        total.latencyUs.insert(total.latencyUs.end(), s.latencyUs.begin(), s.latencyUs.end());
+        for (auto& kv : s.status) { total.status[kv.first] += kv.second; }
+        total.requests += s.requests;
+        total.bytes += s.bytes;
+        total.connects += s.connects;
+        total.connectErrors += s.connectErrors;
+        total.readErrors += s.readErrors;
+        total.parseErrors += s.parseErrors;
+    }
+    std::sort(total.latencyUs.begin(), total.latencyUs.end());
+    double mean = 0;
+    for (uint32_t v : total.latencyUs) { mean += v; }
+    if (!total.latencyUs.empty()) { mean /= total.latencyUs.size(); }
+
+    std::string json;
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+        "{\"config\":{\"host\":\"%s\",\"port\":%d,\"threads\":%d,\"conns\":%d,\"duration_s\":%.3f,"
+        "\"warmup_s\":%.3f,\"pipeline\":%d,\"keepalive\":%s,\"paths\":%zu,\"login_ratio\":%.3f,\"seed\":%u},\n",
+        opt.host.c_str(), opt.port, opt.threads, opt.conns, opt.duration, opt.warmup, opt.pipeline,
+        opt.keepAlive ? "true" : "false", opt.paths.size(), opt.loginRatio, opt.seed);
+    json += buf;
+    snprintf(buf, sizeof(buf),
+        " \"requests\":%llu,\"rps\":%.1f,\"mbps\":%.2f,\"connects\":%llu,"
+        "\"errors\":{\"connect\":%llu,\"read\":%llu,\"parse\":%llu},\n",
+        static_cast<unsigned long long>(total.requests), total.requests / opt.duration,
+        total.bytes * 8 / opt.duration / 1e6, static_cast<unsigned long long>(total.connects),
+        static_cast<unsigned long long>(total.connectErrors), static_cast<unsigned long long>(total.readErrors),
+        static_cast<unsigned long long>(total.parseErrors));
+    json += buf;
+    snprintf(buf, sizeof(buf),
+        " \"latency_us\":{\"mean\":%.1f,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"p999\":%u,\"max\":%u},\n",
+        mean, Percentile(total.latencyUs, 0.5), Percentile(total.latencyUs, 0.9),
+        Percentile(total.latencyUs, 0.99), Percentile(total.latencyUs, 0.999),
+        total.latencyUs.empty() ? 0 : total.latencyUs.back());
+    json += buf;
+    json += " \"status\":{";
+    bool first = true;
+    for (auto& kv : total.status) {
+        snprintf(buf, sizeof(buf), "%s\"%d\":%llu", first ? "" : ",", kv.first,
+                 static_cast<unsigned long long>(kv.second));
+        json += buf;
+        first = false;
+    }
+    json += "}}\n";
+
+    fputs(json.c_str(), stdout);
+    if (!opt.out.empty()) {
+        FILE* fp = fopen(opt.out.c_str(), "w");
+        if (!fp) {
+            fprintf(stderr, "open %s failed\n", opt.out.c_str());
+            return 1;
+        }
+        fputs(json.c_str(), fp);
+        fclose(fp);
+    }
+    return total.requests > 0 ? 0 : 2;
+}
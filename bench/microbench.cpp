@@ -0,0 +1,504 @@
+/*
+ * 组件微基准：Buffer、HttpRequest::parse、Router、HeapTimer、ThreadPool、Log。
+ * 输入来自 bench/data/ 下的固定文件，每个用例输出 ns/op、cycles/op、allocs/op。
+ * 标为零分配的用例（请求解析、路由、长连接上的一轮请求/响应）稳态下 allocs/op 不为 0 时输出 FAIL 并以 1 退出；
+ * 运行前先逐字节核对预生成模板拼出的响应头（状态行、Connection/Keep-Alive、Content-Type、Date、Content-Length），不一致同样失败。
+ * 用法: microbench [--data bench/data] [--filter 子串] [--min-time 秒] [--json]
+ * 需在仓库根目录运行（默认数据目录为 bench/data）；HttpRequest 引用 UserVerify，
+ * 因此链接内存版 MySQL（mock_mysql.cpp）。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <new>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include "../code/buffer/buffer.h"
+#include "../code/http/httprequest.h"
+#include "../code/http/httpresponse.h"
+#include "../code/http/router.h"
+#include "../code/timer/heaptimer.h"
+#include "../code/pool/threadpool.h"
+#include "../code/pool/sqlconnpool.h"
+#include "../code/log/log.h"
+#include "../code/trace/trace.h"
+
+// 统计所有线程的堆分配次数与字节数
+static std::atomic<uint64_t> g_allocs(0);
+static std::atomic<uint64_t> g_allocBytes(0);
+
+void* operator new(size_t size) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    g_allocBytes.fetch_add(size, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p) { throw std::bad_alloc(); }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+// 内联后 GCC 会把 free 与 operator new 误判为不匹配（-Wmismatched-new-delete），禁止内联
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+typedef std::chrono::steady_clock BenchClock;
+
+// 用例：执行 iters 次操作，返回实际完成的操作数
+struct Case {
+    std::string name;
+    std::function<uint64_t(uint64_t iters)> run;
+    bool zeroAlloc;     // 预热后不允许任何分配
+};
+
+struct Result {
+    uint64_t ops;
+    double ns;
+    double cycles;
+    double allocs;
+    double allocBytes;
+};
+
+static Result Measure(const Case& c, double minTime) {
+    c.run(1);       // 预热，完成惰性初始化
+    uint64_t iters = 1;
+    while (true) {
+        uint64_t allocs = g_allocs.load(std::memory_order_relaxed);
+        uint64_t bytes = g_allocBytes.load(std::memory_order_relaxed);
+        uint64_t tsc = Trace::Now();
+        BenchClock::time_point begin = BenchClock::now();
+        uint64_t ops = c.run(iters);
+        double ns = std::chrono::duration<double, std::nano>(BenchClock::now() - begin).count();
+        uint64_t cycles = Trace::Now() - tsc;
+        if (ns >= minTime * 1e9 || iters >= (1ull << 40)) {
+            if (ops == 0) { ops = 1; }
+            return { ops, ns / ops, static_cast<double>(cycles) / ops,
+                     static_cast<double>(g_allocs.load(std::memory_order_relaxed) - allocs) / ops,
+                     static_cast<double>(g_allocBytes.load(std::memory_order_relaxed) - bytes) / ops };
+        }
+        iters *= ns < minTime * 1e8 ? 10 : 2;   // 逐步放大直到单轮耗时超过 minTime
+    }
+}
+
+static std::string ReadFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        fprintf(stderr, "open %s failed\n", path.c_str());
+        exit(1);
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+static std::vector<std::string> Lines(const std::string& text) {    // 跳过空行与 # 注释
+    std::vector<std::string> out;
+    std::istringstream in(text);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[0] != '#') { out.push_back(line); }
+    }
+    return out;
+}
+
+// 请求语料以 "%%" 行分隔，文件中用 \n 换行，载入时转成 \r\n
+static std::vector<std::string> LoadRequests(const std::string& path) {
+    std::vector<std::string> out;
+    std::string cur;
+    std::istringstream in(ReadFile(path));
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line == "%%") {
+            out.push_back(cur);
+            cur.clear();
+            continue;
+        }
+        cur += line;
+        cur += "\r\n";
+    }
+    if (!cur.empty()) { out.push_back(cur); }
+    for (auto& req : out) {     // 带正文的请求，正文后不应有换行
+        if (req.find("Content-Length") != std::string::npos && req.size() >= 2) {
+            req.resize(req.size() - 2);
+        }
+    }
+    return out;
+}
+
+struct TimerOp {
+    char op;
+    int id;
+    int timeout;
+};
+
+static std::vector<TimerOp> LoadTimerTrace(const std::string& path) {
+    std::vector<TimerOp> out;
+    for (auto& line : Lines(ReadFile(path))) {
+        TimerOp op = { 0, 0, 0 };
+        if (sscanf(line.c_str(), "%c %d %d", &op.op, &op.id, &op.timeout) >= 1) {
+            out.push_back(op);
+        }
+    }
+    return out;
+}
+
+static std::vector<std::pair<int, std::string>> LoadLogWorkload(const std::string& path) {
+    std::vector<std::pair<int, std::string>> out;
+    for (auto& line : Lines(ReadFile(path))) {
+        size_t sp = line.find(' ');
+        if (sp == std::string::npos) { continue; }
+        out.emplace_back(atoi(line.c_str()), line.substr(sp + 1));
+    }
+    return out;
+}
+
+// 期望的响应头按 RFC 7231 独立拼出，不经过 HttpResponse 的模板
+static std::string ExpectedHead(const char* status, bool keepAlive, int keepAliveSec, const char* type,
+                                const char* date, size_t length) {
+    std::string head = std::string("HTTP/1.1 ") + status + "\r\n";
+    head += keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    if (keepAlive && keepAliveSec > 0) { head += "Keep-Alive: timeout=" + std::to_string(keepAliveSec) + "\r\n"; }
+    head += std::string("Content-Type: ") + type + "\r\n";
+    head += std::string("Date: ") + date + "\r\n";
+    head += "Content-Length: " + std::to_string(length) + "\r\n\r\n";
+    return head;
+}
+
+static size_t FileSize(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+}
+
+// 逐字节核对 response_file / response_404 / response_memory 用例生成的响应头，返回是否全部一致
+static bool CheckHeaders() {
+    struct Expect {
+        const char* name;
+        const char* path;
+        int code;
+        bool keepAlive;
+        int keepAliveSec;
+        const char* status;
+        const char* type;
+        const char* file;               // 为空表示内存内容
+    };
+    static const Expect EXPECTS[] = {
+        { "file keep-alive",     "/index.html", 200, true,  60, "200 OK", "text/html", "resources/index.html" },
+        { "file close",          "/index.html", 200, false, 60, "200 OK", "text/html", "resources/index.html" },
+        { "file no timeout",     "/css/bootstrap.min.css", 200, true, 0, "200 OK", "text/css",
+                                 "resources/css/bootstrap.min.css" },
+        { "404 keep-alive",      "/wp-login.php", -1, true, 60, "404 Not Found", "text/html", "resources/404.html" },
+        { "404 close",           "/../../etc/passwd", -1, false, 0, "404 Not Found", "text/html", "resources/404.html" },
+        { "memory keep-alive",   "/metrics", 200, true,  60, "200 OK", "text/plain; version=0.0.4", nullptr },
+        { "memory close",        "/metrics", 200, false, 0,  "200 OK", "text/plain; version=0.0.4", nullptr },
+    };
+    const std::string body(200, 'x');
+    bool ok = true;
+    for (const Expect& e : EXPECTS) {
+        HttpResponse::SetKeepAliveTimeout(e.keepAliveSec);
+        std::string got, want;
+        for (int retry = 0; retry < 3; retry++) {       // 跨秒时 Date 可能不同，重来一次
+            time_t before = time(nullptr);
+            Buffer buff;
+            HttpResponse response;
+            response.Init("resources/", e.path, e.keepAlive, e.code);
+            if (e.file) { response.MakeResponse(buff); }
+            else { response.MakeResponse(buff, body, e.type); }
+            got = buff.RetrieveAllToStr();
+            response.UnmapFile();
+            if (time(nullptr) != before) { continue; }
+            char date[64];
+            struct tm g;
+            gmtime_r(&before, &g);
+            strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &g);
+            want = ExpectedHead(e.status, e.keepAlive, e.keepAliveSec, e.type, date,
+                                e.file ? FileSize(e.file) : body.size());
+            if (!e.file) { want += body; }
+            break;
+        }
+        if (got != want) {
+            fprintf(stderr, "FAIL header %s:\n--- got\n%s\n--- want\n%s\n", e.name, got.c_str(), want.c_str());
+            ok = false;
+        }
+    }
+    HttpResponse::SetKeepAliveTimeout(0);
+    return ok;
+}
+
+// 与服务器的路由表规模相当，处理函数为空
+static Router* BenchRouter() {
+    Router* router = Router::Instance();
+    if (!router->Frozen()) {
+        Router::Handler nop = [](HttpRequest&, const Router::Match&, Router::Reply&) {};
+        for (const char* p : { "/", "/index", "/login", "/login.html", "/register", "/register.html",
+                               "/welcome", "/video", "/picture", "/metrics", "/debug/trace" }) {
+            router->Add(Router::ANY, p, nop);
+        }
+        router->Add(Router::GET, "/api/users/:id/posts", nop);
+        router->Add(Router::ANY, "/*path", nop);
+        router->Freeze();
+    }
+    return router;
+}
+
+int main(int argc, char* argv[]) {
+    std::string dataDir = "bench/data";
+    std::string filter;
+    double minTime = 0.5;
+    bool json = false;
+    for (int i = 1; i < argc; i++) {
+        std::string key = argv[i];
+        if (key == "--json") { json = true; continue; }
+        if (i + 1 >= argc) { key.clear(); }
+        if (key == "--data") { dataDir = argv[++i]; }
+        else if (key == "--filter") { filter = argv[++i]; }
+        else if (key == "--min-time") { minTime = atof(argv[++i]); }
+        else {
+            fprintf(stderr, "usage: %s [--data dir] [--filter substr] [--min-time s] [--json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const std::vector<std::string> requests = LoadRequests(dataDir + "/requests.txt");
+    const std::vector<TimerOp> timerTrace = LoadTimerTrace(dataDir + "/timer_trace.txt");
+    const std::vector<std::pair<int, std::string>> logLines = LoadLogWorkload(dataDir + "/log_workload.txt");
+    const std::string payload = requests.empty() ? std::string(512, 'x') : requests[1];
+    SqlConnPool::Instance()->Init("localhost", 3306, "bench", "bench", "bench", 1);
+
+    std::vector<Case> cases;
+
+    cases.push_back({ "buffer/append", [&](uint64_t iters) {    // 读写交替，稳态下不扩容
+        Buffer buff;
+        for (uint64_t i = 0; i < iters; i++) {
+            buff.Append(payload);
+            buff.Retrieve(payload.size());
+        }
+        return iters;
+    }});
+
+    cases.push_back({ "buffer/append_grow", [&](uint64_t iters) {   // 从默认容量累积 64 个请求，触发 MakeSpace_ 扩容
+        uint64_t ops = 0;
+        for (uint64_t i = 0; i < iters; i += 64) {
+            Buffer buff;
+            for (int j = 0; j < 64; j++) { buff.Append(payload); }
+            ops += 64;
+        }
+        return ops;
+    }});
+
+    cases.push_back({ "buffer/make_space_compact", [&](uint64_t iters) {    // 头部空闲足够时 MakeSpace_ 走搬移分支
+        Buffer buff(4096);
+        std::string chunk(3000, 'x');
+        for (uint64_t i = 0; i < iters; i++) {
+            buff.Append(chunk);
+            buff.Retrieve(2900);
+            buff.Append(chunk);
+            buff.RetrieveAll();
+        }
+        return iters;
+    }});
+
+    cases.push_back({ "buffer/read_fd", [&](uint64_t iters) {   // 每次 ReadFd 读出一个请求大小的管道数据
+        int fds[2];
+        if (pipe(fds) < 0) { return static_cast<uint64_t>(0); }
+        Buffer buff;
+        int err = 0;
+        for (uint64_t i = 0; i < iters; i++) {
+            if (write(fds[1], payload.data(), payload.size()) < 0) { break; }
+            buff.ReadFd(fds[0], &err);
+            buff.RetrieveAll();
+        }
+        close(fds[0]);
+        close(fds[1]);
+        return iters;
+    }});
+
+    Buffer reqBuff;         // 跨轮次复用，与长连接上的 HttpConn 一样，容量在预热中长到位
+    HttpRequest request;
+    for (size_t r = 0; r < requests.size(); r++) {
+        const std::string& req = requests[r];
+        cases.push_back({ "http/parse_req" + std::to_string(r), [&req, &reqBuff, &request](uint64_t iters) {
+            for (uint64_t i = 0; i < iters; i++) {
+                request.Init();
+                reqBuff.Append(req);
+                request.parse(reqBuff);
+                reqBuff.RetrieveAll();
+            }
+            return iters;
+        }, true });
+    }
+
+    cases.push_back({ "http/response_file", [&](uint64_t iters) {     // 静态文件：stat、mmap 加头部模板，稳态下不分配
+        Buffer buff;
+        HttpResponse response;
+        std::string path;
+        for (uint64_t i = 0; i < iters; i++) {
+            path = "/index.html";
+            response.Init("resources/", path, true, 200);
+            response.MakeResponse(buff);
+            buff.RetrieveAll();
+        }
+        return iters;
+    }});
+
+    cases.push_back({ "http/response_404", [&](uint64_t iters) {      // 扫描器式的不存在路径，查找结果来自 FileCache 的否定缓存
+        static const char* const PATHS[] = { "/wp-login.php", "/.env", "/admin/config.php", "/../../etc/passwd" };
+        Buffer buff;
+        HttpResponse response;
+        std::string path;
+        for (uint64_t i = 0; i < iters; i++) {
+            path = PATHS[i % 4];
+            response.Init("resources/", path, true, -1);
+            response.MakeResponse(buff);
+            response.UnmapFile();
+            buff.RetrieveAll();
+        }
+        return iters;
+    }});
+
+    cases.push_back({ "http/response_memory", [&](uint64_t iters) {   // 内存内容（如 /metrics），只有头部拼装
+        Buffer buff;
+        HttpResponse response;
+        std::string path = "/metrics";
+        const std::string body(200, 'x');
+        for (uint64_t i = 0; i < iters; i++) {
+            response.Init("resources/", path, true, 200);
+            response.MakeResponse(buff, body, "text/plain; version=0.0.4");
+            buff.RetrieveAll();
+        }
+        return iters;
+    }});
+
+    cases.push_back({ "http/route_match", [&](uint64_t iters) {       // 静态、参数、通配各一，与服务器的路由表规模相当
+        static const char* const PATHS[] = { "/index.html", "/login", "/metrics", "/css/bootstrap.min.css",
+                                             "/api/users/42/posts", "/images/profile-image.jpg" };
+        Router* router = BenchRouter();
+        Router::Match match;
+        bool allowed;
+        uint64_t hits = 0;
+        for (uint64_t i = 0; i < iters; i++) {
+            const char* p = PATHS[i % 6];
+            hits += router->Find(Router::GET, p, strlen(p), &match, &allowed) != nullptr;
+        }
+        return hits;
+    }, true });
+
+    Buffer cycleRead, cycleWrite;   // 长连接上的一轮：解析、路由、定位文件并生成响应头、取消映射
+    HttpRequest cycleRequest;
+    HttpResponse cycleResponse;
+    Router::Reply reply;
+    const std::string& cycleReq = requests.size() > 1 ? requests[1] : payload;
+    cases.push_back({ "http/keepalive_cycle", [&](uint64_t iters) {
+        Router* router = BenchRouter();
+        uint64_t ok = 0;
+        for (uint64_t i = 0; i < iters; i++) {
+            cycleRead.Append(cycleReq);
+            cycleRequest.Init();
+            if (!cycleRequest.parse(cycleRead) || !cycleRequest.IsFinished()) { break; }
+            reply.Reset();
+            router->Dispatch(cycleRequest, reply);
+            cycleResponse.Init("resources/", cycleRequest.path(), cycleRequest.IsKeepAlive(), reply.code);
+            cycleResponse.MakeResponse(cycleWrite);
+            ok += cycleResponse.Code() == 200;
+            cycleResponse.UnmapFile();
+            cycleWrite.RetrieveAll();
+        }
+        return ok;
+    }, true });
+
+    cases.push_back({ "timer/trace_replay", [&](uint64_t iters) {     // 每个操作为轨迹中的一项
+        HeapTimer timer;
+        uint64_t ops = 0;
+        TimeoutCallBack cb = [] {};
+        while (ops < iters) {
+            for (const TimerOp& op : timerTrace) {
+                switch (op.op) {
+                    case 'a': timer.add(op.id, op.timeout, cb); break;
+                    case 'j': timer.adjust(op.id, op.timeout); break;
+                    case 'd': timer.doWork(op.id); break;
+                    case 't': timer.tick(); break;
+                    default: break;
+                }
+            }
+            ops += timerTrace.size();
+            timer.clear();
+        }
+        return ops;
+    }});
+
+    cases.push_back({ "threadpool/round_trip", [&](uint64_t iters) {  // AddTask 到任务执行完成的往返
+        static ThreadPool pool(1);
+        std::atomic<uint64_t> done(0);
+        for (uint64_t i = 0; i < iters; i++) {
+            pool.AddTask([&done] { done.fetch_add(1, std::memory_order_release); });
+            while (done.load(std::memory_order_acquire) <= i) { std::this_thread::yield(); }
+        }
+        return iters;
+    }});
+
+    cases.push_back({ "threadpool/add_task_burst", [&](uint64_t iters) {  // 连续投递，最后等待全部完成
+        static ThreadPool pool(2);
+        std::atomic<uint64_t> done(0);
+        for (uint64_t i = 0; i < iters; i++) {
+            pool.AddTask([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+        }
+        while (done.load(std::memory_order_acquire) < iters) { std::this_thread::yield(); }
+        return iters;
+    }});
+
+    const int LOG_THREADS = 4;
+    cases.push_back({ "log/write_4threads", [&](uint64_t iters) {     // 4 个线程同时写异步文本日志，按总行数计
+        if (!Log::Instance()->IsOpen()) {
+            Log::Instance()->init(0, "./bench_log", ".log", 1024, Log::MODE_TEXT);
+        }
+        uint64_t perThread = (iters + LOG_THREADS - 1) / LOG_THREADS;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < LOG_THREADS; t++) {
+            threads.emplace_back([&, perThread] {
+                size_t n = logLines.size();
+                for (uint64_t i = 0; i < perThread; i++) {
+                    const std::pair<int, std::string>& line = logLines[i % n];
+                    LOG_BASE(line.first, "%s", line.second.c_str());
+                }
+            });
+        }
+        for (auto& t : threads) { t.join(); }
+        return perThread * LOG_THREADS;
+    }});
+
+    if (json) { printf("["); }
+    else { printf("%-28s %12s %12s %12s %12s\n", "case", "ns/op", "cycles/op", "allocs/op", "bytes/op"); }
+    bool first = true;
+    bool failed = !CheckHeaders();
+    for (auto& c : cases) {
+        if (!filter.empty() && c.name.find(filter) == std::string::npos) { continue; }
+        Result r = Measure(c, minTime);
+        if (c.zeroAlloc && r.allocs > 0) {
+            fprintf(stderr, "FAIL %s: %.3f allocs/op, expected 0\n", c.name.c_str(), r.allocs);
+            failed = true;
+        }
+        if (json) {
+            printf("%s\n {\"case\":\"%s\",\"ops\":%llu,\"ns_per_op\":%.2f,\"cycles_per_op\":%.1f,"
+                   "\"allocs_per_op\":%.3f,\"bytes_per_op\":%.1f}", first ? "" : ",", c.name.c_str(),
+                   static_cast<unsigned long long>(r.ops), r.ns, r.cycles, r.allocs, r.allocBytes);
+        }
+        else {
+            printf("%-28s %12.1f %12.1f %12.3f %12.1f\n", c.name.c_str(), r.ns, r.cycles, r.allocs, r.allocBytes);
+        }
+        fflush(stdout);
+        first = false;
+    }
+    if (json) { printf("\n]\n"); }
+    return failed ? 1 : 0;
+}
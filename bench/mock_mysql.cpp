@@ -0,0 +1,170 @@
+/*
+ * 内存版 MySQL 客户端库，只实现服务器用到的几个 C API，用于离线压测登录/注册路径。
+ * 链接它代替 -lmysqlclient 即得到 server_mock（make bench）。
+ * 只识别 UserVerify 发出的两种语句：
+ *   SELECT username, password FROM user WHERE username='x' LIMIT 1
+ *   INSERT INTO user(username, password) VALUES('x','y')
+ * 环境变量：
+ *   MOCK_MYSQL_USERS       预置用户，形如 "alice:pw1,bob:pw2"，默认 "bench:bench"
+ *   MOCK_MYSQL_LATENCY_US  每条语句模拟的往返耗时（微秒），默认 0
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <mysql/mysql.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+struct MockConn {
+    bool hasResult;
+    std::vector<std::string> row;       // 最近一次 SELECT 的结果（至多一行）
+};
+
+struct MockResult {
+    std::vector<std::string> row;
+    std::vector<char*> cols;
+    bool fetched;
+};
+
+class UserTable {
+public:
+    static UserTable* Instance() {
+        static UserTable inst;
+        return &inst;
+    }
+
+    bool Find(const std::string& name, std::string& pwd) {
+        std::lock_guard<std::mutex> locker(mtx_);
+        auto it = users_.find(name);
+        if (it == users_.end()) { return false; }
+        pwd = it->second;
+        return true;
+    }
+
+    bool Insert(const std::string& name, const std::string& pwd) {
+        std::lock_guard<std::mutex> locker(mtx_);
+        return users_.emplace(name, pwd).second;
+    }
+
+    unsigned latencyUs() const { return latencyUs_; }
+
+private:
+    UserTable(): latencyUs_(0) {
+        const char* users = getenv("MOCK_MYSQL_USERS");
+        std::string list = users ? users : "bench:bench";
+        size_t start = 0;
+        while (start < list.size()) {
+            size_t end = list.find(',', start);
+            if (end == std::string::npos) { end = list.size(); }
+            std::string item = list.substr(start, end - start);
+            size_t colon = item.find(':');
+            if (colon != std::string::npos) {
+                users_[item.substr(0, colon)] = item.substr(colon + 1);
+            }
+            start = end + 1;
+        }
+        const char* latency = getenv("MOCK_MYSQL_LATENCY_US");
+        if (latency) { latencyUs_ = static_cast<unsigned>(atoi(latency)); }
+    }
+
+    std::mutex mtx_;
+    std::unordered_map<std::string, std::string> users_;
+    unsigned latencyUs_;
+};
+
+// 依次取出语句中单引号括起的字面量
+std::vector<std::string> Quoted(const char* q) {
+    std::vector<std::string> out;
+    const char* p = q;
+    while ((p = strchr(p, '\'')) != nullptr) {
+        const char* end = strchr(p + 1, '\'');
+        if (!end) { break; }
+        out.emplace_back(p + 1, end);
+        p = end + 1;
+    }
+    return out;
+}
+
+MockConn* Conn(MYSQL* mysql) { return reinterpret_cast<MockConn*>(mysql); }
+MockResult* Result(MYSQL_RES* res) { return reinterpret_cast<MockResult*>(res); }
+
+}   // namespace
+
+extern "C" {
+
+MYSQL* mysql_init(MYSQL* mysql) {
+    if (mysql) { return nullptr; }     // 不支持调用方提供的存储
+    return reinterpret_cast<MYSQL*>(new MockConn{ false, {} });
+}
+
+MYSQL* mysql_real_connect(MYSQL* mysql, const char*, const char*, const char*,
+                          const char*, unsigned int, const char*, unsigned long) {
+    UserTable::Instance();
+    return mysql;
+}
+
+int mysql_query(MYSQL* mysql, const char* q) {
+    MockConn* conn = Conn(mysql);
+    if (!conn || !q) { return 1; }
+    unsigned latency = UserTable::Instance()->latencyUs();
+    if (latency) { usleep(latency); }
+    std::vector<std::string> args = Quoted(q);
+    conn->hasResult = false;
+    conn->row.clear();
+    if (strncasecmp(q, "SELECT", 6) == 0 && args.size() == 1) {
+        std::string pwd;
+        if (UserTable::Instance()->Find(args[0], pwd)) {
+            conn->row = { args[0], pwd };
+        }
+        conn->hasResult = true;
+        return 0;
+    }
+    if (strncasecmp(q, "INSERT", 6) == 0 && args.size() == 2) {
+        return UserTable::Instance()->Insert(args[0], args[1]) ? 0 : 1;
+    }
+    return 1;
+}
+
+MYSQL_RES* mysql_store_result(MYSQL* mysql) {
+    MockConn* conn = Conn(mysql);
+    if (!conn || !conn->hasResult) { return nullptr; }
+    MockResult* res = new MockResult{ conn->row, {}, false };
+    for (auto& col : res->row) {
+        res->cols.push_back(&col[0]);
+    }
+    conn->hasResult = false;
+    return reinterpret_cast<MYSQL_RES*>(res);
+}
+
+unsigned int mysql_num_fields(MYSQL_RES* res) {
+    return res ? 2 : 0;
+}
+
+MYSQL_FIELD* mysql_fetch_fields(MYSQL_RES*) {
+    return nullptr;
+}
+
+MYSQL_ROW mysql_fetch_row(MYSQL_RES* res) {
+    MockResult* r = Result(res);
+    if (!r || r->fetched || r->cols.empty()) { return nullptr; }
+    r->fetched = true;
+    return r->cols.data();
+}
+
+void mysql_free_result(MYSQL_RES* res) {
+    delete Result(res);
+}
+
+void mysql_close(MYSQL* mysql) {
+    delete Conn(mysql);
+}
+
+// 新版头文件中 mysql_library_end 是 mysql_server_end 的宏，两种头文件下都能得到正确的符号
+void mysql_library_end(void) {
+}
+
+}   // extern "C"
@@ -0,0 +1,40 @@
+#!/bin/sh
+# 固定场景的压测套件：先跑组件微基准，再启动 server_mock 依次运行 loadgen，
+# 每个场景输出一个 JSON 到 bench_output/；/api/ 经反向代理转发给两个本地 backend
+# 可用环境变量覆盖：DURATION(秒) WARMUP(秒) THREADS CONNS PORT
+cd "$(dirname "$0")/.." || exit 1
+
+DURATION=${DURATION:-10}
+WARMUP=${WARMUP:-1}
+THREADS=${THREADS:-2}
+CONNS=${CONNS:-64}
+PORT=${PORT:-1025}
+OUT=bench_output
+
+mkdir -p "$OUT"
+echo "== microbench"
+./bin/microbench --json > "$OUT/microbench.json" || exit 1
+cat "$OUT/microbench.json"
+
+./bin/backend --port 9001 --name b1 &
+B1=$!
+./bin/backend --port 9002 --name b2 &
+B2=$!
+./bin/server_mock --proxy="/api/=127.0.0.1:9001,127.0.0.1:9002" &
+SERVER=$!
+trap 'kill $SERVER $B1 $B2 2>/dev/null; wait $SERVER $B1 $B2 2>/dev/null' EXIT INT TERM
+sleep 1
+
+run() {
+    name=$1
+    shift
+    echo "== $name"
+    ./bin/loadgen --port "$PORT" --threads "$THREADS" --conns "$CONNS" \
+        --duration "$DURATION" --warmup "$WARMUP" --seed 1 --out "$OUT/$name.json" "$@" || exit 1
+}
+
+run static_keepalive --resources resources --keepalive 1
+run static_close --resources resources --keepalive 0
+run index_keepalive --paths /index.html --keepalive 1
+run mixed_login --resources resources --keepalive 1 --login-ratio 0.1
+run proxy_keepalive --paths "/api/x?size=4096" --keepalive 1
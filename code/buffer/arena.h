@@ -0,0 +1,41 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+/*
+ * 按请求复位的顺序分配区：解析出的变长字段依次追加到同一块连续内存，用偏移和长度引用，
+ * 扩容搬移后引用仍然有效。Reset 只把写位置归零，容量保留，长连接稳态下不再分配。
+ */
+class Arena {
+public:
+    struct Span {
+        uint32_t off;
+        uint32_t len;
+    };
+
+    explicit Arena(size_t initSize = 1024) { buf_.reserve(initSize); }
+
+    Span Append(const char* data, size_t len) {
+        Span s = { static_cast<uint32_t>(buf_.size()), static_cast<uint32_t>(len) };
+        buf_.insert(buf_.end(), data, data + len);
+        return s;
+    }
+
+    char* Data(const Span& s) { return buf_.data() + s.off; }
+    const char* Data(const Span& s) const { return buf_.data() + s.off; }
+
+    bool Equal(const Span& s, const char* str, size_t len) const {
+        return s.len == len && memcmp(Data(s), str, len) == 0;
+    }
+
+    void Reset() { buf_.clear(); }
+    size_t Size() const { return buf_.size(); }
+
+private:
+    std::vector<char> buf_;
+};
+
+#endif //ARENA_H
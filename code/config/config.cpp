@@ -0,0 +1,300 @@
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <fstream>
+#include "../log/log.h"
+#include "../pool/affinity.h"
+#include "../http/proxy.h"
+
+using namespace std;
+
+vector<ServerConfig::Field> ServerConfig::Fields_() {
+    return {
+        { "port",             INT,    &port,           "listen port (1024-65535)" },
+        { "trig_mode",        INT,    &trigMode,       "0 LT/LT, 1 conn ET, 2 listen ET, 3 ET/ET" },
+        { "timeout_ms",       INT,    &timeoutMs,      "keep-alive idle timeout, 0 disables all connection timeouts" },
+        { "header_timeout_ms", INT,   &headerTimeoutMs, "deadline from the first request byte to complete headers" },
+        { "body_timeout_ms",  INT,    &bodyTimeoutMs,  "request body check window" },
+        { "write_timeout_ms", INT,    &writeTimeoutMs, "response write check window" },
+        { "min_rate_bps",     INT,    &minRateBps,     "minimum body/write throughput per window, bytes/s" },
+        { "opt_linger",       BOOL,   &optLinger,      "SO_LINGER on the listen socket" },
+        { "listen_backlog",   INT,    &listenBacklog,  "listen() backlog" },
+        { "accept_batch",     INT,    &acceptBatch,    "max connections accepted per listen wakeup" },
+        { "defer_accept",     INT,    &deferAcceptSec, "TCP_DEFER_ACCEPT seconds, 0 disables" },
+        { "epoll_max_events", INT,    &epollMaxEvents, "events returned per epoll_wait" },
+        { "read_buffer",      INT,    &readBuffSize,   "initial per-connection read buffer bytes" },
+        { "write_buffer",     INT,    &writeBuffSize,  "initial per-connection write buffer bytes" },
+        { "http2",            BOOL,   &http2,          "accept cleartext HTTP/2 (prior knowledge or h2c upgrade)" },
+        { "tls",              BOOL,   &tls,            "serve HTTPS on the listen port (needs make TLS=1)" },
+        { "tls_cert",         STRING, &tlsCert,        "PEM certificate chain" },
+        { "tls_key",          STRING, &tlsKey,         "PEM private key" },
+        { "tls_ktls",         BOOL,   &tlsKtls,        "offload the send side to kernel TLS after the handshake" },
+        { "tls_tickets",      BOOL,   &tlsTickets,     "issue TLS session tickets" },
+        { "tls_session_cache", INT,   &tlsSessionCache, "server-side TLS session cache entries, 0 disables" },
+        { "websocket",        BOOL,   &websocket,      "accept WebSocket upgrades on /ws and broadcast received messages" },
+        { "websocket_max_message", INT, &wsMaxMessage, "largest WebSocket message accepted, bytes" },
+        { "websocket_queue_bytes", INT, &wsQueueBytes, "per-connection send queue limit before a slow client is dropped" },
+        { "websocket_idle_ms", INT,   &wsIdleMs,       "close a WebSocket connection after this long without traffic" },
+        { "proxy",            STRING, &proxy,          "reverse proxy routes: /prefix=host:port,host:port ..., empty disables" },
+        { "proxy_keepalive",  INT,    &proxyKeepalive, "idle keep-alive connections kept per upstream" },
+        { "proxy_timeout_ms", INT,    &proxyTimeoutMs, "close a proxied request after this long without progress" },
+        { "resources",        STRING, &resources,      "static file directory, default ./resources/" },
+        { "drain_timeout_ms", INT,    &drainTimeoutMs, "graceful shutdown deadline for in-flight requests" },
+        { "per_ip_conns",     INT,    &perIpConns,     "max concurrent connections per client IP, 0 unlimited" },
+        { "per_ip_rate",      INT,    &perIpRate,      "requests per second per client IP, 0 unlimited" },
+        { "per_ip_burst",     INT,    &perIpBurst,     "token bucket size for per_ip_rate" },
+        { "ip_table_size",    INT,    &ipTableSize,    "slots in the per-client limit table" },
+        { "control_socket",   STRING, &controlSocket,  "Unix socket for hot restart, empty disables" },
+        { "takeover",         BOOL,   &takeover,       "take the listen sockets over from control_socket" },
+        { "sql_host",         STRING, &sqlHost,        "MySQL host" },
+        { "sql_port",         INT,    &sqlPort,        "MySQL port" },
+        { "sql_user",         STRING, &sqlUser,        "MySQL user" },
+        { "sql_password",     STRING, &sqlPwd,         "MySQL password" },
+        { "sql_db",           STRING, &dbName,         "MySQL database" },
+        { "sql_pool",         INT,    &connPoolNum,    "MySQL connection pool size" },
+        { "threads",          INT,    &threadNum,      "worker threads (per reactor with numa_workers)" },
+        { "reactors",         INT,    &reactors,       "event loops, each with its own SO_REUSEPORT listener" },
+        { "reactor_cpus",     STRING, &reactorCpus,    "CPU list, reactor i pinned to the i-th entry" },
+        { "worker_cpus",      STRING, &workerCpus,     "CPU list the worker threads are pinned to" },
+        { "log_cpus",         STRING, &logCpus,        "CPU list the log writer threads are pinned to" },
+        { "incoming_cpu",     BOOL,   &incomingCpu,    "set SO_INCOMING_CPU on listeners (needs reactor_cpus)" },
+        { "numa_workers",     BOOL,   &numaWorkers,    "per-reactor worker pool on the reactor's NUMA node" },
+        { "queue_limit",      INT,    &queueLimit,     "max queued tasks before new requests get 503, 0 unlimited" },
+        { "codel_target_ms",  INT,    &codelTargetMs,  "acceptable queue wait, 0 disables overload detection" },
+        { "codel_interval_ms", INT,   &codelIntervalMs, "queue wait above target this long sheds DB requests" },
+        { "log",              BOOL,   &openLog,        "enable logging" },
+        { "log_level",        INT,    &logLevel,       "0 debug, 1 info, 2 warn, 3 error" },
+        { "log_queue",        INT,    &logQueSize,     "async log queue size, 0 is synchronous" },
+        { "log_mode",         INT,    &logMode,        "0 text, 1 deferred, 2 binary, 3 json" },
+        { "log_rotate_mb",    INT,    &logRotateMb,    "start a new log file past this size, 0 rotates daily only" },
+        { "log_compress",     BOOL,   &logCompress,    "gzip rotated log files in a low-priority thread" },
+        { "log_keep",         INT,    &logKeep,        "rotated log files to keep, 0 keeps all" },
+        { "access_sample",    INT,    &accessSample,   "access log 1/N sampling, 0 disables" },
+        { "access_slow_ms",   INT,    &accessSlowMs,   "always log requests slower than this, 0 disables" },
+    };
+}
+
+static string Trim(const string& s) {
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == string::npos) { return ""; }
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+bool ServerConfig::Set(const string& key, const string& value) {
+    for (auto& f : Fields_()) {
+        if (key != f.key) { continue; }
+        if (f.type == STRING) {
+            *static_cast<string*>(f.ptr) = value;
+            return true;
+        }
+        if (f.type == BOOL) {
+            if (value == "1" || value == "true" || value == "on") { *static_cast<bool*>(f.ptr) = true; }
+            else if (value == "0" || value == "false" || value == "off") { *static_cast<bool*>(f.ptr) = false; }
+            else {
+                fprintf(stderr, "config: %s expects a boolean, got '%s'\n", key.c_str(), value.c_str());
+                return false;
+            }
+            return true;
+        }
+        char* end = nullptr;
+        errno = 0;
+        long v = strtol(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || errno != 0 || v < INT_MIN || v > INT_MAX) {
+            fprintf(stderr, "config: %s expects an integer, got '%s'\n", key.c_str(), value.c_str());
+            return false;
+        }
+        *static_cast<int*>(f.ptr) = static_cast<int>(v);
+        return true;
+    }
+    fprintf(stderr, "config: unknown key '%s'\n", key.c_str());
+    return false;
+}
+
+bool ServerConfig::Load(const char* path) {
+    ifstream in(path);
+    if (!in) {
+        fprintf(stderr, "config: cannot open %s\n", path);
+        return false;
+    }
+    string line;
+    int lineNo = 0;
+    while (getline(in, line)) {
+        lineNo++;
+        size_t hash = line.find('#');
+        if (hash != string::npos) { line.erase(hash); }
+        line = Trim(line);
+        if (line.empty()) { continue; }
+        size_t eq = line.find('=');
+        if (eq == string::npos) {
+            fprintf(stderr, "config: %s:%d: expected key = value\n", path, lineNo);
+            return false;
+        }
+        if (!Set(Trim(line.substr(0, eq)), Trim(line.substr(eq + 1)))) {
+            fprintf(stderr, "config: %s:%d: invalid entry\n", path, lineNo);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ServerConfig::ParseArgs(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {       // 先加载配置文件，保证命令行总是覆盖文件
+        const char* arg = argv[i];
+        if (strcmp(arg, "-c") == 0 && i + 1 < argc) {
+            if (!Load(argv[++i])) { return false; }
+        }
+        else if (strncmp(arg, "--config=", 9) == 0) {
+            if (!Load(arg + 9)) { return false; }
+        }
+    }
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "-c") == 0) { i++; continue; }
+        if (strncmp(arg, "--config=", 9) == 0) { continue; }
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            Usage(argv[0]);
+            return false;
+        }
+        const char* eq = strchr(arg, '=');
+        if (strncmp(arg, "--", 2) != 0 || !eq) {
+            fprintf(stderr, "config: bad argument '%s', expected --key=value\n", arg);
+            return false;
+        }
+        string key(arg + 2, eq);
+        for (auto& c : key) {               // 命令行允许 --log-level 这种写法
+            if (c == '-') { c = '_'; }
+        }
+        if (!Set(key, eq + 1)) { return false; }
+    }
+    return true;
+}
+
+bool ServerConfig::Validate() const {
+    struct Rule {
+        const char* key;
+        long value;
+        long min;
+        long max;
+    };
+    const Rule rules[] = {
+        { "port",             port,           1024, 65535 },
+        { "trig_mode",        trigMode,       0,    3 },
+        { "timeout_ms",       timeoutMs,      0,    INT_MAX },
+        { "header_timeout_ms", headerTimeoutMs, 1,  INT_MAX },
+        { "body_timeout_ms",  bodyTimeoutMs,  1,    INT_MAX },
+        { "write_timeout_ms", writeTimeoutMs, 1,    INT_MAX },
+        { "min_rate_bps",     minRateBps,     0,    INT_MAX },
+        { "listen_backlog",   listenBacklog,  1,    65535 },
+        { "accept_batch",     acceptBatch,    1,    65536 },
+        { "defer_accept",     deferAcceptSec, 0,    3600 },
+        { "epoll_max_events", epollMaxEvents, 1,    65536 },
+        { "read_buffer",      readBuffSize,   64,   64 << 20 },
+        { "write_buffer",     writeBuffSize,  64,   64 << 20 },
+        { "tls_session_cache", tlsSessionCache, 0,  1 << 24 },
+        { "websocket_max_message", wsMaxMessage, 125, 64 << 20 },
+        { "websocket_queue_bytes", wsQueueBytes, 4096, 1 << 30 },
+        { "websocket_idle_ms", wsIdleMs,     1,    INT_MAX },
+        { "proxy_keepalive",  proxyKeepalive, 0,    65536 },
+        { "proxy_timeout_ms", proxyTimeoutMs, 1,    INT_MAX },
+        { "drain_timeout_ms", drainTimeoutMs, 0,    INT_MAX },
+        { "per_ip_conns",     perIpConns,     0,    INT_MAX },
+        { "per_ip_rate",      perIpRate,      0,    1000000 },
+        { "per_ip_burst",     perIpBurst,     1,    1000000 },
+        { "ip_table_size",    ipTableSize,    1024, 1 << 24 },
+        { "sql_port",         sqlPort,        1,    65535 },
+        { "sql_pool",         connPoolNum,    1,    1024 },
+        { "threads",          threadNum,      1,    1024 },
+        { "reactors",         reactors,       1,    64 },
+        { "queue_limit",      queueLimit,     0,    INT_MAX },
+        { "codel_target_ms",  codelTargetMs,  0,    60000 },
+        { "codel_interval_ms", codelIntervalMs, 1,  60000 },
+        { "log_level",        logLevel,       0,    3 },
+        { "log_queue",        logQueSize,     0,    1 << 24 },
+        { "log_mode",         logMode,        Log::MODE_TEXT, Log::MODE_JSON },
+        { "log_rotate_mb",    logRotateMb,    0,    1 << 20 },
+        { "log_keep",         logKeep,        0,    INT_MAX },
+        { "access_sample",    accessSample,   0,    INT_MAX },
+        { "access_slow_ms",   accessSlowMs,   0,    INT_MAX },
+    };
+    bool ok = true;
+    for (const Rule& r : rules) {
+        if (r.value < r.min || r.value > r.max) {
+            fprintf(stderr, "config: %s = %ld out of range [%ld, %ld]\n", r.key, r.value, r.min, r.max);
+            ok = false;
+        }
+    }
+    const pair<const char*, const string*> cpuLists[] = {
+        { "reactor_cpus", &reactorCpus }, { "worker_cpus", &workerCpus }, { "log_cpus", &logCpus },
+    };
+    for (auto& item : cpuLists) {
+        vector<int> cpus;
+        if (!Affinity::ParseList(*item.second, cpus)) {
+            fprintf(stderr, "config: %s '%s' is not a CPU list like 0-3,8\n", item.first, item.second->c_str());
+            ok = false;
+        }
+        for (int c : cpus) {
+            if (c >= Affinity::CpuCount()) {
+                fprintf(stderr, "config: %s contains CPU %d, only %d CPUs\n", item.first, c, Affinity::CpuCount());
+                ok = false;
+                break;
+            }
+        }
+    }
+    if (takeover && controlSocket.empty()) {
+        fprintf(stderr, "config: takeover needs control_socket\n");
+        ok = false;
+    }
+    if ((incomingCpu || numaWorkers) && reactorCpus.empty()) {
+        fprintf(stderr, "config: incoming_cpu and numa_workers need reactor_cpus\n");
+        ok = false;
+    }
+    string err;
+    if (!proxy.empty() && !Proxy::Parse(proxy, &err)) {
+        fprintf(stderr, "config: proxy: %s\n", err.c_str());
+        ok = false;
+    }
+    if (tls && (tlsCert.empty() || tlsKey.empty())) {
+        fprintf(stderr, "config: tls needs tls_cert and tls_key\n");
+        ok = false;
+    }
+    if (!resources.empty()) {
+        struct stat st;
+        if (stat(resources.c_str(), &st) < 0 || !S_ISDIR(st.st_mode)) {
+            fprintf(stderr, "config: resources '%s' is not a directory\n", resources.c_str());
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void ServerConfig::Dump() const {
+    for (auto& f : const_cast<ServerConfig*>(this)->Fields_()) {
+        if (f.type == STRING) {
+            const string& v = *static_cast<const string*>(f.ptr);
+            LOG_INFO("Config %s = %s", f.key, f.ptr == &sqlPwd ? "******" : v.c_str());
+        }
+        else if (f.type == BOOL) {
+            LOG_INFO("Config %s = %s", f.key, *static_cast<const bool*>(f.ptr) ? "true" : "false");
+        }
+        else {
+            LOG_INFO("Config %s = %d", f.key, *static_cast<const int*>(f.ptr));
+        }
+    }
+}
+
+void ServerConfig::Usage(const char* prog) {
+    ServerConfig defaults;
+    fprintf(stderr, "usage: %s [-c file | --config=file] [--key=value ...]\n", prog);
+    for (auto& f : defaults.Fields_()) {
+        string def;
+        if (f.type == STRING) { def = *static_cast<string*>(f.ptr); }
+        else if (f.type == BOOL) { def = *static_cast<bool*>(f.ptr) ? "true" : "false"; }
+        else { def = to_string(*static_cast<int*>(f.ptr)); }
+        fprintf(stderr, "  --%-18s %s (default: %s)\n", f.key, f.help, def.c_str());
+    }
+}
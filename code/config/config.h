@@ -0,0 +1,97 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+#include <vector>
+
+// 服务器运行参数：默认值 <- 配置文件（key = value）<- 命令行 --key=value，后者覆盖前者。
+// 启动时校验，日志初始化后由 Dump 逐项写入日志。
+struct ServerConfig {
+    // 网络
+    int port = 1025;
+    int trigMode = 3;               // 0 LT/LT，1 连接ET，2 监听ET，3 ET/ET
+    int timeoutMs = 15000;          // 长连接空闲超时，0 关闭所有连接超时
+    int headerTimeoutMs = 10000;    // 从收到请求首字节到请求头完整的期限，不因收到数据而续期
+    int bodyTimeoutMs = 10000;      // 接收请求体时的检查窗口
+    int writeTimeoutMs = 10000;     // 发送响应时的检查窗口
+    int minRateBps = 512;           // 请求体和写阶段每个窗口内的最低吞吐（字节/秒）
+    bool optLinger = false;
+    int listenBacklog = 1024;
+    int acceptBatch = 64;           // 每次监听就绪最多 accept 的连接数
+    int deferAcceptSec = 5;         // TCP_DEFER_ACCEPT 秒数，0 关闭
+    int epollMaxEvents = 1024;      // 每次 epoll_wait 取回的最大事件数
+    int readBuffSize = 1024;        // 每个连接读缓冲区初始大小
+    int writeBuffSize = 1024;       // 每个连接写缓冲区初始大小
+    bool http2 = true;              // 接受 h2c：连接前言（prior knowledge）或 Upgrade: h2c
+    bool tls = false;               // 监听端口改为 HTTPS（需 make TLS=1）
+    std::string tlsCert;            // PEM 证书链
+    std::string tlsKey;             // PEM 私钥
+    bool tlsKtls = true;            // 握手后把发送方向交给内核 TLS
+    bool tlsTickets = true;         // 发放会话票据
+    int tlsSessionCache = 20480;    // 服务端会话缓存条数，0 关闭
+    bool websocket = false;         // 在 /ws 接受 WebSocket 升级，收到的消息广播给所有连接
+    int wsMaxMessage = 65536;       // 单条 WebSocket 消息上限，超过时以 1009 关闭
+    int wsQueueBytes = 1 << 20;     // 每个 WebSocket 连接待发送的上限，超过即断开慢连接
+    int wsIdleMs = 60000;           // WebSocket 连接双向都没有数据的最长时间
+    std::string proxy;              // 反向代理路由，如 "/api/=127.0.0.1:9001,127.0.0.1:9002"，为空时关闭
+    int proxyKeepalive = 32;        // 每个后端保留的空闲长连接数
+    int proxyTimeoutMs = 30000;     // 转发中两个方向都没有数据的最长时间
+    std::string resources;          // 资源目录，为空时使用 工作目录/resources/
+    int drainTimeoutMs = 30000;     // 收到 SIGTERM/SIGINT 或交出监听套接字后，等待在途请求完成的最长时间
+    int perIpConns = 1024;          // 单个客户端 IP 的最大并发连接数，0 不限制
+    int perIpRate = 0;              // 单个客户端 IP 每秒请求数，0 不限制
+    int perIpBurst = 100;           // 令牌桶容量，允许的突发请求数
+    int ipTableSize = 65536;        // 客户端限额表的槽数
+    std::string controlSocket;      // 热升级控制套接字路径，为空时关闭
+    bool takeover = false;          // 启动时从 control_socket 接管旧进程的监听套接字
+
+    // 数据库
+    std::string sqlHost = "localhost";
+    int sqlPort = 3306;
+    std::string sqlUser = "root";
+    std::string sqlPwd = "root";
+    std::string dbName = "yourdb";
+    int connPoolNum = 12;
+
+    // 线程
+    int threadNum = 6;              // 工作线程数；numa_workers 时为每个反应堆的线程数
+    int reactors = 1;               // 反应堆数，多于 1 个时各自监听（SO_REUSEPORT）并独占连接
+    std::string reactorCpus;        // 反应堆 i 绑定到列表中第 i 个 CPU（循环使用），如 "0,8"
+    std::string workerCpus;         // 工作线程绑定的 CPU 集合，如 "1-7"
+    std::string logCpus;            // 日志与访问日志写线程绑定的 CPU 集合
+    bool incomingCpu = false;       // 监听套接字设置 SO_INCOMING_CPU，让内核把连接交给同 CPU 的反应堆
+    bool numaWorkers = false;       // 每个反应堆使用自己 NUMA 节点上的私有线程池
+    int queueLimit = 1024;          // 线程池排队任务上限，超过时新请求直接 503，0 不限制
+    int codelTargetMs = 5;          // 可接受的排队时间，0 关闭过载检测
+    int codelIntervalMs = 100;      // 排队时间持续超过 target 这么久即视为过载，拒绝数据库请求
+
+    // 日志
+    bool openLog = true;
+    int logLevel = 0;
+    int logQueSize = 1024;
+    int logMode = 0;                // Log::MODE
+    int logRotateMb = 64;           // 日志文件超过该大小即切分，0 只按天切分
+    bool logCompress = true;        // 切出的文件由后台线程压缩为 .gz
+    int logKeep = 30;               // 保留的历史日志文件数，0 不限
+    int accessSample = 100;         // 访问日志 1/N 采样，0 关闭
+    int accessSlowMs = 500;         // 慢请求阈值，0 关闭
+
+    bool Load(const char* path);                // 读取配置文件
+    bool ParseArgs(int argc, char* argv[]);     // -c/--config=文件 先加载，其余 --key=value 覆盖
+    bool Set(const std::string& key, const std::string& value);
+    bool Validate() const;                      // 错误写到 stderr（此时日志尚未初始化）
+    void Dump() const;                          // 逐项写入日志
+    static void Usage(const char* prog);
+
+private:
+    enum TYPE { INT, BOOL, STRING };
+    struct Field {
+        const char* key;
+        TYPE type;
+        void* ptr;
+        const char* help;
+    };
+    std::vector<Field> Fields_();
+};
+
+#endif //CONFIG_H
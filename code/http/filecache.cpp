@@ -0,0 +1,138 @@
+#include "filecache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/openat2.h>
+#include <atomic>
+
+#include "../log/log.h"
+
+const int FileCache::TTL_MS;
+const size_t FileCache::KEY_MAX;
+const size_t FileCache::POSITIVE_SLOTS;
+const size_t FileCache::NEGATIVE_SLOTS;
+
+FileCache::Cache::Cache() : spill(-1) {
+    for (Entry& e : positive) { e.len = 0; e.fd = -1; }
+    for (Entry& e : negative) { e.len = 0; e.fd = -1; }
+}
+
+FileCache::Cache::~Cache() {
+    for (Entry& e : positive) {
+        if (e.fd >= 0) { close(e.fd); }
+    }
+    if (spill >= 0) { close(spill); }
+}
+
+FileCache::Cache& FileCache::Local_() {
+    static thread_local Cache cache;
+    return cache;
+}
+
+int FileCache::Root_(const char* srcDir) {
+    static const int root = [srcDir]() {
+        int fd = open(srcDir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) { LOG_ERROR("FileCache: open %s failed, errno %d", srcDir, errno); }
+        return fd;
+    }();
+    return root;
+}
+
+bool FileCache::Open(const char* srcDir) {
+    return Root_(srcDir) >= 0;
+}
+
+int64_t FileCache::NowMs_() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);     // vDSO，不进内核
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint32_t FileCache::Hash_(const char* path, size_t len) {  // FNV-1a
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ static_cast<uint8_t>(path[i])) * 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+int FileCache::Resolve_(int root, const char* path, int* fd, struct stat* st) {
+    static std::atomic<bool> noOpenat2(false);  // 内核早于 5.6 时退回 openat，只能拒绝含 ".." 的路径
+    while (*path == '/') { path++; }
+    if (*path == '\0') { path = "."; }
+    int f = -1;
+    if (!noOpenat2) {
+        struct open_how how;
+        memset(&how, 0, sizeof(how));
+        how.flags = O_RDONLY | O_CLOEXEC | O_NOCTTY;
+        how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+        for (int retry = 0; retry < 3; retry++) {   // 并发的 rename 可能使解析返回 EAGAIN
+            f = syscall(SYS_openat2, root, path, &how, sizeof(how));
+            if (f >= 0 || errno != EAGAIN) { break; }
+        }
+        if (f < 0 && errno == ENOSYS) {
+            LOG_WARN("FileCache: openat2 unavailable, symlinks are not confined");
+            noOpenat2 = true;
+        }
+    }
+    if (noOpenat2) {
+        for (const char* p = path; (p = strstr(p, "..")) != nullptr; p += 2) {
+            if ((p == path || p[-1] == '/') && (p[2] == '\0' || p[2] == '/')) { return EXDEV; }
+        }
+        f = openat(root, path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    }
+    if (f < 0) { return errno; }
+    int err = fstat(f, st) < 0 ? errno : (S_ISDIR(st->st_mode) ? EISDIR : 0);
+    if (err) {
+        close(f);
+        return err;
+    }
+    *fd = f;
+    return 0;
+}
+
+int FileCache::Lookup(const char* srcDir, const char* path, size_t len, int* fd, struct stat* st) {
+    int root = Root_(srcDir);
+    if (root < 0) { return ENOENT; }
+    Cache& c = Local_();
+    if (len > KEY_MAX) {                        // 不缓存，但描述符仍由这里持有
+        if (c.spill >= 0) {
+            close(c.spill);
+            c.spill = -1;
+        }
+        int err = Resolve_(root, path, &c.spill, st);
+        *fd = c.spill;
+        return err;
+    }
+    int64_t now = NowMs_();
+    uint32_t hash = Hash_(path, len);
+    Entry& pos = c.positive[hash % POSITIVE_SLOTS];
+    if (pos.len == len && pos.hash == hash && pos.expireMs > now && memcmp(pos.key, path, len) == 0) {
+        *fd = pos.fd;
+        *st = pos.st;
+        return 0;
+    }
+    Entry& neg = c.negative[hash % NEGATIVE_SLOTS];
+    if (neg.len == len && neg.hash == hash && neg.expireMs > now && memcmp(neg.key, path, len) == 0) {
+        return neg.err;
+    }
+
+    int f = -1;
+    int err = Resolve_(root, path, &f, st);
+    if (err == EXDEV) { LOG_WARN("FileCache: %s escapes %s", path, srcDir); }
+    Entry& e = err ? neg : pos;                 // 走到这里时两张表中都没有该路径的有效项
+    if (e.fd >= 0) { close(e.fd); }             // 替换掉的文件已映射的部分不受影响
+    e.hash = hash;
+    e.len = static_cast<uint32_t>(len);
+    e.expireMs = now + TTL_MS;
+    e.fd = f;
+    e.err = err;
+    e.st = *st;
+    memcpy(e.key, path, len);
+    *fd = f;
+    return err;
+}
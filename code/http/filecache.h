@@ -0,0 +1,53 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/*
+ * 资源目录下的文件查找：资源目录第一次使用时以 O_PATH 打开并固定，请求路径相对它用 openat2(RESOLVE_BENEATH) 打开，
+ * 由内核保证解析（包括 ".." 和符号链接）不离开资源目录，也不再从根目录逐级查找绝对路径。
+ * 每个线程缓存最近的结果：找到的文件保留打开的描述符和 stat，命中时不进内核；找不到的路径另存一张表，
+ * 扫描器的大量 404 不会挤掉热点文件。两张表都是直接映射，TTL_MS 后重新查找，文件被替换最多晚这么久生效。
+ */
+class FileCache {
+public:
+    static const int TTL_MS = 1000;
+    static const size_t KEY_MAX = 128;          // 更长的路径不进缓存
+    static const size_t POSITIVE_SLOTS = 64;    // 每项占一个描述符
+    static const size_t NEGATIVE_SLOTS = 256;
+
+    static bool Open(const char* srcDir);       // 提前固定资源目录，进程内只有第一次生效，失败返回 false
+
+    // path 以 '/' 开头并以 '\0' 结尾。找到普通文件返回 0，*fd 归缓存所有，在本线程下一次 Lookup 前有效；
+    // 否则返回 errno：ENOENT、EACCES、EISDIR，路径越出资源目录时为 EXDEV
+    static int Lookup(const char* srcDir, const char* path, size_t len, int* fd, struct stat* st);
+
+private:
+    struct Entry {
+        uint32_t hash;
+        uint32_t len;                           // 0 表示空槽
+        int64_t expireMs;
+        int fd;                                 // 找不到时为 -1
+        int err;
+        struct stat st;
+        char key[KEY_MAX];
+    };
+
+    struct Cache {
+        Cache();
+        ~Cache();                               // 线程退出时关闭描述符
+        Entry positive[POSITIVE_SLOTS];
+        Entry negative[NEGATIVE_SLOTS];
+        int spill;                              // 超长路径打开的描述符，下一次超长查找时关闭
+    };
+
+    static int Root_(const char* srcDir);
+    static int Resolve_(int root, const char* path, int* fd, struct stat* st);
+    static uint32_t Hash_(const char* path, size_t len);
+    static int64_t NowMs_();
+    static Cache& Local_();
+};
+
+#endif //FILE_CACHE_H
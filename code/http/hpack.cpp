@@ -0,0 +1,319 @@
+#include "hpack.h"
+
+using namespace std;
+
+namespace Hpack {
+
+// RFC 7541 附录 A 静态表，下标从 1 开始
+static const Field STATIC_TABLE[] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+
+static const size_t STATIC_NUM = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+
+// RFC 7541 附录 B Huffman 码表（不含 EOS）
+static const uint32_t HUFFMAN_CODE[256] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+};
+
+static const uint8_t HUFFMAN_LEN[256] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+};
+
+
+struct HuffNode {
+    int16_t next[2];    // 子节点下标，-1 表示不存在
+    int16_t sym;        // 叶子对应的字节，内部节点为 -1
+};
+
+static vector<HuffNode> BuildHuffTree() {    // 由码表构造解码树，约 500 个节点
+    vector<HuffNode> tree(1, HuffNode{ { -1, -1 }, -1 });
+    for (int s = 0; s < 256; s++) {
+        int node = 0;
+        for (int bit = HUFFMAN_LEN[s] - 1; bit >= 0; bit--) {
+            int b = (HUFFMAN_CODE[s] >> bit) & 1;
+            if (tree[node].next[b] < 0) {
+                tree[node].next[b] = static_cast<int16_t>(tree.size());
+                tree.push_back(HuffNode{ { -1, -1 }, -1 });
+            }
+            node = tree[node].next[b];
+        }
+        tree[node].sym = static_cast<int16_t>(s);
+    }
+    return tree;
+}
+
+bool HuffmanDecode(const uint8_t* p, size_t len, string& out) {
+    static const vector<HuffNode> tree = BuildHuffTree();
+    int node = 0;
+    int depth = 0;          // 自上一个完整字符以来的位数
+    bool allOnes = true;
+    for (size_t i = 0; i < len; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            int b = (p[i] >> bit) & 1;
+            node = tree[node].next[b];
+            if (node < 0) { return false; }     // 包括 EOS：它比所有码字都长，不在树中
+            if (tree[node].sym >= 0) {
+                out.push_back(static_cast<char>(tree[node].sym));
+                node = 0;
+                depth = 0;
+                allOnes = true;
+            }
+            else {
+                depth++;
+                allOnes = allOnes && b;
+            }
+        }
+    }
+    return node == 0 || (depth <= 7 && allOnes);   // 末尾填充必须是不超过 7 位的 EOS 前缀
+}
+
+bool DecodeInt(const uint8_t*& p, const uint8_t* end, int prefix, uint64_t& value) {
+    if (p >= end) { return false; }
+    uint8_t mask = static_cast<uint8_t>((1 << prefix) - 1);
+    value = *p++ & mask;
+    if (value < mask) { return true; }
+    int shift = 0;
+    while (p < end) {
+        uint8_t b = *p++;
+        value += static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) { return true; }
+        shift += 7;
+        if (shift > 28) { return false; }   // 超过 32 位的整数在这里都没有意义
+    }
+    return false;
+}
+
+bool DecodeString(const uint8_t*& p, const uint8_t* end, string& out) {
+    if (p >= end) { return false; }
+    bool huffman = *p & 0x80;
+    uint64_t len;
+    if (!DecodeInt(p, end, 7, len) || len > static_cast<uint64_t>(end - p)) { return false; }
+    out.clear();
+    if (huffman) {
+        if (!HuffmanDecode(p, len, out)) { return false; }
+    }
+    else {
+        out.assign(reinterpret_cast<const char*>(p), len);
+    }
+    p += len;
+    return true;
+}
+
+Decoder::Decoder(size_t maxTableSize) {
+    size_ = 0;
+    maxSize_ = limit_ = maxTableSize;
+}
+
+bool Decoder::Get_(uint64_t index, Header& header) const {
+    if (index == 0) { return false; }
+    if (index <= STATIC_NUM) {
+        header.name = STATIC_TABLE[index - 1].name;
+        header.value = STATIC_TABLE[index - 1].value;
+        return true;
+    }
+    index -= STATIC_NUM + 1;
+    if (index >= table_.size()) { return false; }
+    header = table_[index];
+    return true;
+}
+
+void Decoder::Evict_(size_t limit) {
+    while (size_ > limit && !table_.empty()) {
+        size_ -= table_.back().name.size() + table_.back().value.size() + 32;
+        table_.pop_back();
+    }
+}
+
+void Decoder::Insert_(const Header& header) {
+    size_t entry = header.name.size() + header.value.size() + 32;
+    if (entry > maxSize_) {     // 比整个表还大：清空表，条目本身不加入
+        Evict_(0);
+        return;
+    }
+    Evict_(maxSize_ - entry);
+    table_.push_front(header);
+    size_ += entry;
+}
+
+bool Decoder::Decode(const uint8_t* data, size_t len, vector<Header>& headers) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + len;
+    size_t listSize = 0;
+    Header header;
+    while (p < end) {
+        uint8_t b = *p;
+        uint64_t index;
+        if (b & 0x80) {                     // 索引字段
+            if (!DecodeInt(p, end, 7, index) || !Get_(index, header)) { return false; }
+        }
+        else if ((b & 0xe0) == 0x20) {      // 动态表大小更新
+            if (!DecodeInt(p, end, 5, index) || index > limit_) { return false; }
+            maxSize_ = index;
+            Evict_(maxSize_);
+            continue;
+        }
+        else {      // 字面值：0x40 加入动态表，0x00 不索引，0x10 永不索引
+            bool indexing = (b & 0xc0) == 0x40;
+            if (!DecodeInt(p, end, indexing ? 6 : 4, index)) { return false; }
+            if (index) {
+                if (!Get_(index, header)) { return false; }
+            }
+            else if (!DecodeString(p, end, header.name)) {
+                return false;
+            }
+            if (!DecodeString(p, end, header.value)) { return false; }
+            if (indexing) { Insert_(header); }
+        }
+        listSize += header.name.size() + header.value.size() + 32;
+        if (listSize > MAX_HEADER_LIST) { return false; }
+        headers.push_back(header);
+    }
+    return true;
+}
+
+void EncodeInt(Buffer& out, uint8_t first, int prefix, uint64_t value) {
+    uint8_t mask = static_cast<uint8_t>((1 << prefix) - 1);
+    if (value < mask) {
+        uint8_t b = first | static_cast<uint8_t>(value);
+        out.Append(&b, 1);
+        return;
+    }
+    char buf[12];
+    size_t n = 0;
+    buf[n++] = static_cast<char>(first | mask);
+    value -= mask;
+    while (value >= 0x80) {
+        buf[n++] = static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    buf[n++] = static_cast<char>(value);
+    out.Append(buf, n);
+}
+
+void EncodeField(Buffer& out, int nameIndex, const char* value, size_t len) {
+    EncodeInt(out, 0x00, 4, nameIndex);
+    EncodeInt(out, 0x00, 7, len);       // 不使用 Huffman
+    out.Append(value, len);
+}
+
+void EncodeStatus(Buffer& out, int code) {
+    static const int CODES[] = { 200, 204, 206, 304, 400, 404, 500 };   // 静态表 8 到 14
+    for (int i = 0; i < 7; i++) {
+        if (CODES[i] == code) {
+            EncodeInt(out, 0x80, 7, STATUS_200 + i);
+            return;
+        }
+    }
+    char digits[3] = { static_cast<char>('0' + code / 100 % 10), static_cast<char>('0' + code / 10 % 10),
+                       static_cast<char>('0' + code % 10) };
+    EncodeField(out, STATUS_200, digits, 3);
+}
+
+}   // namespace Hpack
@@ -0,0 +1,67 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <deque>
+#include <vector>
+
+#include "../buffer/buffer.h"
+
+/*
+ * HPACK 头部压缩（RFC 7541）。
+ * 解码完整支持静态表、动态表、表大小更新和 Huffman 编码的字符串；
+ * 编码只用静态表中的名字加不索引的字面值，不维护编码端动态表，对端无需为我们保存状态。
+ */
+namespace Hpack {
+
+struct Field {
+    const char* name;
+    const char* value;
+};
+
+struct Header {
+    std::string name;
+    std::string value;
+};
+
+enum STATIC_INDEX {         // 编码响应时用到的静态表下标
+    STATUS_200 = 8,
+    CONTENT_LENGTH = 28,
+    CONTENT_TYPE = 31,
+    DATE = 33,
+};
+
+static const size_t DEFAULT_TABLE_SIZE = 4096;      // SETTINGS_HEADER_TABLE_SIZE 的默认值
+static const size_t MAX_HEADER_LIST = 64 * 1024;    // 解码后头部总大小上限（每项按 RFC 加 32 字节）
+
+class Decoder {
+public:
+    explicit Decoder(size_t maxTableSize = DEFAULT_TABLE_SIZE);
+
+    // 解码一个完整的头部块，失败（格式错误或超限）时应以 COMPRESSION_ERROR 关闭连接
+    bool Decode(const uint8_t* data, size_t len, std::vector<Header>& headers);
+
+private:
+    bool Get_(uint64_t index, Header& header) const;
+    void Insert_(const Header& header);
+    void Evict_(size_t limit);
+
+    std::deque<Header> table_;      // 动态表，新条目在前
+    size_t size_;                   // 动态表当前大小
+    size_t maxSize_;                // 对端通过表大小更新设置的上限
+    size_t limit_;                  // 我们在 SETTINGS 中允许的上限
+};
+
+bool DecodeInt(const uint8_t*& p, const uint8_t* end, int prefix, uint64_t& value);
+bool DecodeString(const uint8_t*& p, const uint8_t* end, std::string& out);
+bool HuffmanDecode(const uint8_t* p, size_t len, std::string& out);
+
+void EncodeInt(Buffer& out, uint8_t first, int prefix, uint64_t value);
+void EncodeStatus(Buffer& out, int code);
+void EncodeField(Buffer& out, int nameIndex, const char* value, size_t len);   // 静态表名字 + 不索引的字面值
+
+}   // namespace Hpack
+
+#endif //HPACK_H
@@ -0,0 +1,573 @@
+#include "http2.h"
+#include "httpconn.h"
+#include <algorithm>
+
+using namespace std;
+
+const char Http2Session::PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const char Http2Session::UPGRADE_RESPONSE[] =
+    "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+const size_t Http2Session::PREFACE_LEN;
+
+static uint32_t Get32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void Put32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static bool Base64UrlDecode(const string& in, string& out) {    // HTTP2-Settings 头，同时接受标准 base64
+    out.clear();
+    uint32_t acc = 0;
+    int bits = 0;
+    for (char c : in) {
+        int v;
+        if (c >= 'A' && c <= 'Z') { v = c - 'A'; }
+        else if (c >= 'a' && c <= 'z') { v = c - 'a' + 26; }
+        else if (c >= '0' && c <= '9') { v = c - '0' + 52; }
+        else if (c == '-' || c == '+') { v = 62; }
+        else if (c == '_' || c == '/') { v = 63; }
+        else if (c == '=') { break; }
+        else { return false; }
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<char>((acc >> bits) & 0xff));
+        }
+    }
+    return true;
+}
+
+Http2Session::Http2Session(const char* srcDir, const struct in_addr& ip, int fd) {
+    srcDir_ = srcDir;
+    ip_ = ip;
+    fd_ = fd;
+    gotPreface_ = false;
+    goawaySent_ = goawayRecv_ = failed_ = false;
+    lastStreamId_ = 0;
+    continuation_ = 0;
+    continuationEnd_ = false;
+    connWindow_ = peerWindow_ = DEFAULT_WINDOW;
+    peerMaxFrame_ = MAX_FRAME;
+    sentOut_ = 0;
+    batchSeq_ = 0;
+}
+
+Http2Session::~Http2Session() = default;
+
+void Http2Session::Start() {
+    uint8_t payload[12] = { 0x00, 0x03 };   // SETTINGS_MAX_CONCURRENT_STREAMS
+    Put32(payload + 2, MAX_STREAMS);
+    payload[6] = 0x00;                      // SETTINGS_MAX_HEADER_LIST_SIZE
+    payload[7] = 0x06;
+    Put32(payload + 8, Hpack::MAX_HEADER_LIST);
+    WriteFrame_(SETTINGS, 0, 0, payload, sizeof(payload));
+}
+
+bool Http2Session::Upgrade(const HttpRequest& request, const string& settings) {
+    out_.Append(UPGRADE_RESPONSE, sizeof(UPGRADE_RESPONSE) - 1);
+    Start();
+    string payload;     // 101 即隐式确认，不再回 SETTINGS ACK
+    if (!Base64UrlDecode(settings, payload) || payload.size() % 6 ||
+        !OnSettings_(0, reinterpret_cast<const uint8_t*>(payload.data()), payload.size(), false)) {
+        return Fail_(PROTOCOL_ERROR);
+    }
+    lastStreamId_ = 1;
+    Stream* s = Open_(1);   // 升级前的请求即流 1，请求方向已结束
+    s->method = request.method();
+    s->path = request.path();
+    Metrics::Add(Metrics::H2_STREAMS);
+    Respond_(s);
+    return true;
+}
+
+bool Http2Session::OnData(Buffer& in) {
+    if (failed_) {
+        in.RetrieveAll();
+        return false;
+    }
+    if (!gotPreface_) {
+        if (in.ReadableBytes() < PREFACE_LEN) { return true; }
+        if (memcmp(in.Peek(), PREFACE, PREFACE_LEN) != 0) {
+            in.RetrieveAll();
+            return Fail_(PROTOCOL_ERROR);
+        }
+        in.Retrieve(PREFACE_LEN);
+        gotPreface_ = true;
+    }
+    while (in.ReadableBytes() >= 9) {       // 只处理完整的帧，剩余部分留到下次
+        const uint8_t* h = reinterpret_cast<const uint8_t*>(in.Peek());
+        size_t len = (h[0] << 16) | (h[1] << 8) | h[2];
+        if (len > MAX_FRAME) {
+            in.RetrieveAll();
+            return Fail_(FRAME_SIZE_ERROR);
+        }
+        if (in.ReadableBytes() < 9 + len) { break; }
+        bool ok = OnFrame_(h[3], h[4], Get32(h + 5) & 0x7fffffff, h + 9, len);
+        in.Retrieve(9 + len);
+        if (!ok) {
+            in.RetrieveAll();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Http2Session::OnFrame_(uint8_t type, uint8_t flags, uint32_t sid, const uint8_t* p, size_t len) {
+    if (continuation_ && (type != CONTINUATION || sid != continuation_)) {  // 头部块中间不能插入其他帧
+        return Fail_(PROTOCOL_ERROR);
+    }
+    switch (type) {
+        case DATA:
+            return OnData_(flags, sid, p, len);
+        case HEADERS:
+            return OnHeaders_(flags, sid, p, len);
+        case PRIORITY:          // RFC 9113 已废弃，改用 priority 头
+            if (sid == 0) { return Fail_(PROTOCOL_ERROR); }
+            if (len != 5) { ResetStream_(sid, FRAME_SIZE_ERROR); }
+            return true;
+        case RST_STREAM:
+            if (sid == 0 || sid > lastStreamId_) { return Fail_(PROTOCOL_ERROR); }
+            if (len != 4) { return Fail_(FRAME_SIZE_ERROR); }
+            Erase_(sid);
+            return true;
+        case SETTINGS:
+            if (sid != 0) { return Fail_(PROTOCOL_ERROR); }
+            return OnSettings_(flags, p, len, true);
+        case PUSH_PROMISE:      // 客户端不能推送
+            return Fail_(PROTOCOL_ERROR);
+        case PING:
+            if (sid != 0) { return Fail_(PROTOCOL_ERROR); }
+            if (len != 8) { return Fail_(FRAME_SIZE_ERROR); }
+            if (!(flags & ACK)) { WriteFrame_(PING, ACK, 0, p, 8); }
+            return true;
+        case GOAWAY:
+            if (sid != 0) { return Fail_(PROTOCOL_ERROR); }
+            goawayRecv_ = true;     // 已有的流继续完成
+            return true;
+        case WINDOW_UPDATE:
+            return OnWindowUpdate_(sid, p, len);
+        case CONTINUATION:
+            if (continuation_ == 0) { return Fail_(PROTOCOL_ERROR); }
+            headerBlock_.append(reinterpret_cast<const char*>(p), len);
+            if (headerBlock_.size() > Hpack::MAX_HEADER_LIST) { return Fail_(PROTOCOL_ERROR); }
+            if (flags & END_HEADERS) {
+                continuation_ = 0;
+                return OnHeaderBlock_(sid, continuationEnd_);
+            }
+            return true;
+        default:                // 未知类型按规范忽略
+            return true;
+    }
+}
+
+bool Http2Session::OnSettings_(uint8_t flags, const uint8_t* p, size_t len, bool ack) {
+    if (flags & ACK) {
+        return len == 0 || Fail_(FRAME_SIZE_ERROR);
+    }
+    if (len % 6) { return Fail_(FRAME_SIZE_ERROR); }
+    for (size_t i = 0; i < len; i += 6) {
+        uint16_t id = (p[i] << 8) | p[i + 1];
+        uint32_t v = Get32(p + i + 2);
+        switch (id) {
+            case 0x2:           // SETTINGS_ENABLE_PUSH，我们不推送
+                if (v > 1) { return Fail_(PROTOCOL_ERROR); }
+                break;
+            case 0x4: {         // SETTINGS_INITIAL_WINDOW_SIZE，按差值调整所有流的窗口
+                if (v > MAX_WINDOW) { return Fail_(FLOW_CONTROL_ERROR); }
+                int64_t delta = static_cast<int64_t>(v) - peerWindow_;
+                for (auto& s : streams_) {
+                    s->window += delta;
+                    if (s->window > MAX_WINDOW) { return Fail_(FLOW_CONTROL_ERROR); }
+                }
+                peerWindow_ = v;
+                break;
+            }
+            case 0x5:           // SETTINGS_MAX_FRAME_SIZE
+                if (v < MAX_FRAME || v > 0xffffff) { return Fail_(PROTOCOL_ERROR); }
+                peerMaxFrame_ = v;
+                break;
+            default:            // 头部表大小：编码端不使用动态表，无需处理
+                break;
+        }
+    }
+    if (ack) { WriteFrame_(SETTINGS, ACK, 0, nullptr, 0); }
+    return true;
+}
+
+bool Http2Session::OnHeaders_(uint8_t flags, uint32_t sid, const uint8_t* p, size_t len) {
+    if (sid == 0 || !(sid & 1)) { return Fail_(PROTOCOL_ERROR); }   // 客户端的流编号是奇数
+    size_t pad = 0;
+    if (flags & PADDED) {
+        if (len < 1) { return Fail_(PROTOCOL_ERROR); }
+        pad = p[0];
+        p++;
+        len--;
+    }
+    if (flags & PRIORITY_FLAG) {
+        if (len < 5) { return Fail_(PROTOCOL_ERROR); }
+        p += 5;
+        len -= 5;
+    }
+    if (pad > len) { return Fail_(PROTOCOL_ERROR); }
+    headerBlock_.assign(reinterpret_cast<const char*>(p), len - pad);
+    if (!(flags & END_HEADERS)) {
+        continuation_ = sid;
+        continuationEnd_ = flags & END_STREAM;
+        return true;
+    }
+    return OnHeaderBlock_(sid, flags & END_STREAM);
+}
+
+bool Http2Session::OnHeaderBlock_(uint32_t sid, bool endStream) {
+    headers_.clear();       // 即使随后拒绝这个流也要解码，保持动态表与对端一致
+    if (!decoder_.Decode(reinterpret_cast<const uint8_t*>(headerBlock_.data()), headerBlock_.size(), headers_)) {
+        return Fail_(COMPRESSION_ERROR);
+    }
+    Stream* s = Find_(sid);
+    if (s) {                // 请求体之后的 trailers
+        if (s->responded || !endStream) {
+            ResetStream_(sid, s->responded ? STREAM_CLOSED : PROTOCOL_ERROR);
+            Erase_(sid);
+            return true;
+        }
+        Respond_(s);
+        return true;
+    }
+    if (sid <= lastStreamId_) { return Fail_(STREAM_CLOSED); }
+    lastStreamId_ = sid;
+    if (goawaySent_) { return true; }       // 排空中：GOAWAY 之后的新流不处理
+    if (streams_.size() >= MAX_STREAMS) {
+        ResetStream_(sid, REFUSED_STREAM);
+        return true;
+    }
+    s = Open_(sid);
+    for (const Hpack::Header& h : headers_) {
+        if (h.name == ":method") { s->method = h.value; }
+        else if (h.name == ":path") { s->path = h.value; }
+        else if (h.name == "content-type") { s->contentType = h.value; }
+        else if (h.name == "priority") { ParsePriority_(s, h.value); }
+    }
+    if (s->method.empty() || s->path.empty() || s->path[0] != '/') {
+        ResetStream_(sid, PROTOCOL_ERROR);
+        Erase_(sid);
+        return true;
+    }
+    Metrics::Add(Metrics::H2_STREAMS);
+    if (endStream) { Respond_(s); }
+    return true;
+}
+
+bool Http2Session::OnData_(uint8_t flags, uint32_t sid, const uint8_t* p, size_t len) {
+    if (sid == 0) { return Fail_(PROTOCOL_ERROR); }
+    size_t flowLen = len;       // 填充也计入流量控制
+    if (flags & PADDED) {
+        if (len < 1 || p[0] > len - 1) { return Fail_(PROTOCOL_ERROR); }
+        len -= 1 + p[0];
+        p++;
+    }
+    uint8_t inc[4];
+    Put32(inc, flowLen);
+    if (flowLen) { WriteFrame_(WINDOW_UPDATE, 0, 0, inc, 4); }     // 立即归还连接窗口
+    Stream* s = Find_(sid);
+    if (!s) {
+        if (sid > lastStreamId_) { return Fail_(PROTOCOL_ERROR); }
+        ResetStream_(sid, STREAM_CLOSED);
+        return true;
+    }
+    if (s->responded || s->body.size() + len > MAX_BODY) {
+        ResetStream_(sid, s->responded ? STREAM_CLOSED : CANCEL);
+        Erase_(sid);
+        return true;
+    }
+    s->body.append(reinterpret_cast<const char*>(p), len);
+    if (flags & END_STREAM) {
+        Respond_(s);
+    }
+    else if (flowLen) {
+        WriteFrame_(WINDOW_UPDATE, 0, sid, inc, 4);
+    }
+    return true;
+}
+
+bool Http2Session::OnWindowUpdate_(uint32_t sid, const uint8_t* p, size_t len) {
+    if (len != 4) { return Fail_(FRAME_SIZE_ERROR); }
+    uint32_t inc = Get32(p) & 0x7fffffff;
+    if (sid == 0) {
+        connWindow_ += inc;
+        if (inc == 0) { return Fail_(PROTOCOL_ERROR); }
+        if (connWindow_ > MAX_WINDOW) { return Fail_(FLOW_CONTROL_ERROR); }
+        return true;
+    }
+    Stream* s = Find_(sid);
+    if (!s) {               // 已结束的流，忽略
+        return sid <= lastStreamId_ || Fail_(PROTOCOL_ERROR);
+    }
+    s->window += inc;
+    if (inc == 0 || s->window > MAX_WINDOW) {
+        ResetStream_(sid, inc == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+        Erase_(sid);
+    }
+    return true;
+}
+
+void Http2Session::ParsePriority_(Stream* s, const string& value) {    // 形如 "u=1, i"
+    size_t pos = 0;
+    while (pos < value.size()) {
+        size_t end = value.find(',', pos);
+        if (end == string::npos) { end = value.size(); }
+        while (pos < end && value[pos] == ' ') { pos++; }
+        if (end - pos >= 3 && value[pos] == 'u' && value[pos + 1] == '=' && value[pos + 2] >= '0' && value[pos + 2] <= '7') {
+            s->urgency = value[pos + 2] - '0';
+        }
+        else if (value.compare(pos, end - pos, "i") == 0 || value.compare(pos, end - pos, "i=?1") == 0) {
+            s->incremental = true;
+        }
+        pos = end + 1;
+    }
+}
+
+Http2Session::Stream* Http2Session::Find_(uint32_t sid) {
+    for (auto& s : streams_) {
+        if (s->id == sid) { return s.get(); }
+    }
+    return nullptr;
+}
+
+Http2Session::Stream* Http2Session::Open_(uint32_t sid) {
+    if (spare_.empty()) {
+        streams_.emplace_back(new Stream);
+    }
+    else {
+        streams_.push_back(move(spare_.back()));
+        spare_.pop_back();
+    }
+    Stream* s = streams_.back().get();
+    s->id = sid;
+    s->responded = s->done = false;
+    s->finishedIn = 0;
+    s->urgency = 3;             // RFC 9218 默认值
+    s->incremental = false;
+    s->window = peerWindow_;
+    s->method.clear();
+    s->path.clear();
+    s->contentType.clear();
+    s->body.clear();
+    s->content.clear();
+    s->data = nullptr;
+    s->len = s->sent = 0;
+    s->start = chrono::steady_clock::now();
+    return s;
+}
+
+void Http2Session::Erase_(uint32_t sid) {
+    for (size_t i = 0; i < streams_.size(); i++) {
+        if (streams_[i]->id == sid) {
+            EraseAt_(i);
+            return;
+        }
+    }
+}
+
+void Http2Session::EraseAt_(size_t i) {
+    streams_[i]->response.UnmapFile();
+    if (spare_.size() < 16) { spare_.push_back(move(streams_[i])); }
+    streams_[i] = move(streams_.back());
+    streams_.pop_back();
+}
+
+void Http2Session::Respond_(Stream* s) {
+    s->request.Assign(s->method, s->path, s->contentType, s->body);
+    s->request.SetConnFd(fd_);
+    reply_.Reset();
+    if (!HttpConn::LimitRequest(ip_, reply_)) {
+        Router::Instance()->Dispatch(s->request, reply_);
+    }
+    s->response.Init(srcDir_, s->request.path(), true, reply_.code);
+    const char* type;
+    if (reply_.contentType) {
+        s->content.swap(reply_.content);
+        type = reply_.contentType;
+    }
+    else {
+        TRACE_SCOPE(Trace::FILE_IO, fd_);
+        s->response.MakeBody(s->content);
+        type = s->response.ContentType();
+    }
+    if (s->response.File()) {
+        s->data = s->response.File();
+        s->len = s->response.FileLen();
+    }
+    else {
+        s->data = s->content.data();
+        s->len = s->content.size();
+    }
+    s->responded = true;
+
+    char digits[24];
+    int n = snprintf(digits, sizeof(digits), "%zu", s->len);
+    Hpack::EncodeStatus(block_, s->response.Code());
+    Hpack::EncodeField(block_, Hpack::CONTENT_TYPE, type, strlen(type));
+    Hpack::EncodeField(block_, Hpack::CONTENT_LENGTH, digits, n);
+    Hpack::EncodeField(block_, Hpack::DATE, TimeCache::HttpDate(), TimeCache::HTTP_DATE_LEN);
+    WriteFrame_(HEADERS, END_HEADERS | (s->len == 0 ? END_STREAM : 0), s->id, block_.Peek(), block_.ReadableBytes());
+    block_.RetrieveAll();
+    if (s->len == 0) {          // 只有头部，随下一批发出
+        s->done = true;
+        s->finishedIn = batchSeq_ + 1;
+    }
+}
+
+void Http2Session::Finish_(Stream* s) {
+    using namespace std::chrono;
+    AccessRecord rec;
+    rec.ip = ip_;
+    rec.method = &s->request.method();
+    rec.path = &s->request.path();
+    rec.version = &s->request.version();
+    rec.status = s->response.Code();
+    rec.bytes = s->len;
+    rec.queueUs = rec.parseUs = 0;
+    rec.totalUs = duration_cast<microseconds>(steady_clock::now() - s->start).count();
+    Metrics::CountStatus(rec.status);
+    Metrics::Observe(Metrics::REQUEST_TIME, rec.totalUs);
+    AccessLog* log = AccessLog::Instance();
+    if (log->ShouldLog(rec)) {
+        log->Write(rec);
+    }
+}
+
+// 按 urgency 从高到低分组：组内非 incremental 的流按编号依次发完，incremental 的流每轮一帧交替发送；
+// 高优先级的组被窗口卡住后才轮到下一组
+size_t Http2Session::Fill(vector<iovec>& iov) {
+    iov.clear();
+    out_.Retrieve(sentOut_);
+    sentOut_ = 0;
+    for (size_t i = 0; i < streams_.size();) {      // 上一批已写完，结束其中发完的流
+        Stream* s = streams_[i].get();
+        if (s->done && s->finishedIn <= batchSeq_) {
+            Finish_(s);
+            EraseAt_(i);
+            continue;
+        }
+        i++;
+    }
+    batchSeq_++;
+
+    segs_.clear();
+    if (out_.ReadableBytes()) { segs_.push_back(Segment{ nullptr, 0, out_.ReadableBytes() }); }
+    order_.clear();
+    for (auto& s : streams_) {
+        if (!gotPreface_) { break; }    // 升级后等客户端前言和 SETTINGS 到达再发 DATA，101 之后先只发头部
+        if (s->responded && s->sent < s->len) { order_.push_back(s.get()); }
+    }
+    sort(order_.begin(), order_.end(), [](const Stream* a, const Stream* b) {
+        return a->urgency != b->urgency ? a->urgency < b->urgency : a->id < b->id;
+    });
+    size_t budget = BATCH_BYTES;
+    for (size_t i = 0; i < order_.size() && budget > 0 && connWindow_ > 0;) {
+        size_t j = i;
+        while (j < order_.size() && order_[j]->urgency == order_[i]->urgency) { j++; }
+        bool progress = true;
+        while (progress) {
+            progress = false;
+            for (size_t k = i; k < j; k++) {
+                Stream* s = order_[k];
+                if (s->incremental) {
+                    progress = SendData_(s, budget) || progress;
+                    continue;
+                }
+                while (SendData_(s, budget)) { progress = true; }
+            }
+        }
+        i = j;
+    }
+
+    size_t total = 0;
+    for (const Segment& seg : segs_) {      // out_ 不再增长，偏移可以换成指针了
+        const char* base = seg.base ? seg.base : out_.Peek() + seg.offset;
+        iov.push_back(iovec{ const_cast<char*>(base), seg.len });
+        total += seg.len;
+    }
+    sentOut_ = out_.ReadableBytes();
+    return total;
+}
+
+bool Http2Session::SendData_(Stream* s, size_t& budget) {
+    if (s->sent >= s->len || segs_.size() + 2 > MAX_SEGMENTS) { return false; }
+    int64_t window = min(s->window, connWindow_);
+    size_t n = min(min(s->len - s->sent, peerMaxFrame_), budget);
+    if (window <= 0 || n == 0) { return false; }
+    n = min(n, static_cast<size_t>(window));
+    bool last = s->sent + n == s->len;
+    segs_.push_back(Segment{ nullptr, out_.ReadableBytes(), 9 });
+    WriteFrameHead_(n, DATA, last ? END_STREAM : 0, s->id);
+    segs_.push_back(Segment{ s->data + s->sent, 0, n });
+    s->sent += n;
+    s->window -= n;
+    connWindow_ -= n;
+    budget -= n;
+    if (last) {
+        s->done = true;
+        s->finishedIn = batchSeq_;
+    }
+    return true;
+}
+
+void Http2Session::GoAway() {
+    if (goawaySent_) { return; }
+    uint8_t payload[8];
+    Put32(payload, lastStreamId_);
+    Put32(payload + 4, NO_ERROR);
+    WriteFrame_(GOAWAY, 0, 0, payload, sizeof(payload));
+    goawaySent_ = true;
+}
+
+bool Http2Session::WantWrite() const {
+    if (out_.ReadableBytes() > sentOut_) { return true; }
+    if (connWindow_ <= 0 || !gotPreface_) { return false; }
+    for (const auto& s : streams_) {
+        if (s->responded && s->sent < s->len && s->window > 0) { return true; }
+    }
+    return false;
+}
+
+bool Http2Session::Closing() const {
+    return failed_ || ((goawaySent_ || goawayRecv_) && streams_.empty());
+}
+
+bool Http2Session::Fail_(uint32_t code) {
+    if (!failed_) {
+        uint8_t payload[8];
+        Put32(payload, lastStreamId_);
+        Put32(payload + 4, code);
+        WriteFrame_(GOAWAY, 0, 0, payload, sizeof(payload));
+        failed_ = goawaySent_ = true;
+        while (!streams_.empty()) { EraseAt_(streams_.size() - 1); }
+        LOG_DEBUG("h2: connection error %u", code);
+    }
+    return false;
+}
+
+void Http2Session::ResetStream_(uint32_t sid, uint32_t code) {
+    uint8_t payload[4];
+    Put32(payload, code);
+    WriteFrame_(RST_STREAM, 0, sid, payload, sizeof(payload));
+}
+
+void Http2Session::WriteFrameHead_(size_t len, uint8_t type, uint8_t flags, uint32_t sid) {
+    uint8_t head[9] = { static_cast<uint8_t>(len >> 16), static_cast<uint8_t>(len >> 8), static_cast<uint8_t>(len),
+                        type, flags };
+    Put32(head + 5, sid & 0x7fffffff);
+    out_.Append(head, sizeof(head));
+}
+
+void Http2Session::WriteFrame_(uint8_t type, uint8_t flags, uint32_t sid, const void* payload, size_t len) {
+    WriteFrameHead_(len, type, flags, sid);
+    if (len) { out_.Append(payload, len); }
+}
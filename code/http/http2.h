@@ -0,0 +1,166 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../buffer/buffer.h"
+#include "../log/log.h"
+#include "../log/accesslog.h"
+#include "../metrics/metrics.h"
+#include "../trace/trace.h"
+#include "hpack.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+#include "router.h"
+
+/*
+ * HTTP/2 明文连接（h2c，RFC 9113）：帧解析、HPACK、流复用、流量控制和按优先级发送。
+ * 每个流复用 HttpRequest 的路径映射、表单处理和 HttpResponse 的静态文件映射，
+ * 文件内容作为 DATA 帧的 iovec 直接发送，不复制。
+ * 与 HttpConn 一样同一时刻只有一个线程访问：OnData 只在上一批数据写完后调用，
+ * Fill 返回的 iovec 在下一次 Fill 之前保持有效。
+ */
+class Http2Session {
+public:
+    static const char PREFACE[];                // 客户端连接前言
+    static const size_t PREFACE_LEN = 24;
+    static const char UPGRADE_RESPONSE[];       // h2c 升级时的 101 响应
+
+    Http2Session(const char* srcDir, const struct in_addr& ip, int fd);  // fd 只用作追踪事件的 id
+    ~Http2Session();
+
+    void Start();       // 直接以 HTTP/2 开始（prior knowledge）：发送服务器 SETTINGS
+    // h2c 升级：先发 101，原请求作为流 1 响应；settings 为 HTTP2-Settings 头的 base64url 内容
+    bool Upgrade(const HttpRequest& request, const std::string& settings);
+
+    bool OnData(Buffer& in);                    // 处理收到的完整帧，出错时排好 GOAWAY 并返回 false
+    size_t Fill(std::vector<iovec>& iov);       // 上一批写完后调用，组织下一批待发数据，返回字节数
+    void GoAway();                              // 服务器排空：不再接受新流，已有的流继续完成
+
+    bool WantWrite() const;                     // 有控制帧，或有窗口允许发送的数据
+    bool Closing() const;                       // GOAWAY 之后没有未完成的流，写完即可关闭
+
+private:
+    enum FRAME_TYPE {
+        DATA = 0x0,
+        HEADERS = 0x1,
+        PRIORITY = 0x2,
+        RST_STREAM = 0x3,
+        SETTINGS = 0x4,
+        PUSH_PROMISE = 0x5,
+        PING = 0x6,
+        GOAWAY = 0x7,
+        WINDOW_UPDATE = 0x8,
+        CONTINUATION = 0x9,
+    };
+
+    enum FLAG {
+        END_STREAM = 0x1,
+        ACK = 0x1,
+        END_HEADERS = 0x4,
+        PADDED = 0x8,
+        PRIORITY_FLAG = 0x20,
+    };
+
+    enum ERROR_CODE {
+        NO_ERROR = 0x0,
+        PROTOCOL_ERROR = 0x1,
+        INTERNAL_ERROR = 0x2,
+        FLOW_CONTROL_ERROR = 0x3,
+        STREAM_CLOSED = 0x5,
+        FRAME_SIZE_ERROR = 0x6,
+        REFUSED_STREAM = 0x7,
+        CANCEL = 0x8,
+        COMPRESSION_ERROR = 0x9,
+    };
+
+    struct Stream {
+        uint32_t id;
+        bool responded;             // 请求已完整，响应头已排入
+        bool done;                  // 最后的数据已排入第 finishedIn 批
+        uint64_t finishedIn;
+        int urgency;                // RFC 9218 priority 头：u=0..7，越小越优先
+        bool incremental;           // i：与同优先级的流交替发送，否则按流编号依次发完
+        int64_t window;             // 发送窗口
+        std::string method, path, contentType, body;
+        HttpRequest request;
+        HttpResponse response;
+        std::string content;        // 内存中的响应体（指标、错误页面）
+        const char* data;
+        size_t len;
+        size_t sent;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    struct Segment {                // Fill 时先记录，out_ 不再增长后再换成 iovec
+        const char* base;           // nullptr 表示 out_ 中的偏移
+        size_t offset;
+        size_t len;
+    };
+
+    bool OnFrame_(uint8_t type, uint8_t flags, uint32_t sid, const uint8_t* p, size_t len);
+    bool OnHeaders_(uint8_t flags, uint32_t sid, const uint8_t* p, size_t len);
+    bool OnHeaderBlock_(uint32_t sid, bool endStream);
+    bool OnData_(uint8_t flags, uint32_t sid, const uint8_t* p, size_t len);
+    bool OnSettings_(uint8_t flags, const uint8_t* p, size_t len, bool ack);
+    bool OnWindowUpdate_(uint32_t sid, const uint8_t* p, size_t len);
+
+    Stream* Find_(uint32_t sid);
+    Stream* Open_(uint32_t sid);
+    void Erase_(uint32_t sid);
+    void EraseAt_(size_t i);
+    void Finish_(Stream* s);                    // 记录指标和访问日志
+    void Respond_(Stream* s);
+    void ParsePriority_(Stream* s, const std::string& value);
+    bool SendData_(Stream* s, size_t& budget);  // 排入一个 DATA 帧，没有窗口或预算时返回 false
+
+    void WriteFrame_(uint8_t type, uint8_t flags, uint32_t sid, const void* payload, size_t len);
+    void WriteFrameHead_(size_t len, uint8_t type, uint8_t flags, uint32_t sid);
+    void ResetStream_(uint32_t sid, uint32_t code);
+    bool Fail_(uint32_t code);                  // 连接错误：排入 GOAWAY，丢弃所有流，返回 false
+
+    static const uint32_t MAX_STREAMS = 100;            // SETTINGS_MAX_CONCURRENT_STREAMS
+    static const size_t MAX_FRAME = 16384;              // 接收的最大帧，即默认的 SETTINGS_MAX_FRAME_SIZE
+    static const int64_t DEFAULT_WINDOW = 65535;
+    static const int64_t MAX_WINDOW = 0x7fffffff;
+    static const size_t MAX_BODY = 1 << 20;             // 单个请求体上限
+    static const size_t BATCH_BYTES = 256 * 1024;       // 每批写出的上限，让出线程给其他连接
+    static const size_t MAX_SEGMENTS = 512;
+
+    const char* srcDir_;
+    struct in_addr ip_;
+    int fd_;
+    bool gotPreface_;
+    bool goawaySent_;
+    bool goawayRecv_;
+    bool failed_;
+    uint32_t lastStreamId_;         // 已处理的最大客户端流编号
+    uint32_t continuation_;         // 等待 CONTINUATION 的流，0 表示没有
+    bool continuationEnd_;          // 该头部块所在 HEADERS 带有 END_STREAM
+    std::string headerBlock_;
+
+    int64_t connWindow_;            // 连接级发送窗口
+    int64_t peerWindow_;            // 对端 SETTINGS_INITIAL_WINDOW_SIZE
+    size_t peerMaxFrame_;           // 对端 SETTINGS_MAX_FRAME_SIZE
+
+    Hpack::Decoder decoder_;
+    std::vector<Hpack::Header> headers_;            // 复用的解码结果
+    std::vector<std::unique_ptr<Stream>> streams_;
+    std::vector<std::unique_ptr<Stream>> spare_;    // 复用已结束的流，避免重复构造请求和响应对象
+
+    Buffer out_;                    // 控制帧、响应头和 DATA 帧头
+    Buffer block_;                  // 编码响应头部块
+    Router::Reply reply_;           // 路由处理函数的结果，内存中的响应体换进流的 content
+    size_t sentOut_;                // 上一批包含的 out_ 字节数
+    uint64_t batchSeq_;
+    std::vector<Segment> segs_;
+    std::vector<Stream*> order_;
+};
+
+#endif //HTTP2_H
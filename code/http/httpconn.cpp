@@ -1,39 +1,88 @@
 #include "httpconn.h"
+#include <limits.h>
 using namespace std;
 
 const char* HttpConn::srcDir;       //静态成员初始化
 std::atomic<int> HttpConn::userCount;
 bool HttpConn::isET;
+std::atomic<bool> HttpConn::isDraining(false);
+int HttpConn::readBuffSize = 1024;
+int HttpConn::writeBuffSize = 1024;
+bool HttpConn::enableH2 = true;
+bool HttpConn::enableWs = false;
+std::function<bool(uint32_t)> HttpConn::allowRequest;
+const size_t HttpConn::WS_BATCH;
 
 HttpConn::HttpConn() {
     fd_ = -1;
     addr_ = { 0 };
     isClose_ = true;
+    busy_ = false;
+    phase_ = IDLE;
+    phaseSinceMs_ = 0;
+    phaseBytes_ = 0;
+    timeoutCheck = TimeoutCheck{ -1, 0, 0, 0 };
+    readyTsc_ = 0;
+    queueUs_ = parseUs_ = 0;
+    bytesSent_ = 0;
+    pendingFinish_ = false;
+    handshake_ = false;
+    h2IovIdx_ = h2Pending_ = 0;
+    owner_ = 0;
+    rearm_ = -1;
+    proxied_ = false;
 }
 
 HttpConn::~HttpConn() {
     Close();
 }
 
-void HttpConn::init(int fd, const sockaddr_in& addr) {   // 初始化连接的函数
+void HttpConn::init(int fd, const sockaddr_in& addr, int owner) {   // 初始化连接的函数
     assert(fd > 0);                                      // 断言文件描述符有效
     userCount++;                                         // 增加用户计数
     addr_ = addr;                                        // 设置地址
     fd_ = fd;                                            // 设置文件描述符
+    request_.SetConnFd(fd);
+    owner_ = owner;
     writeBuff_.RetrieveAll();                            // 清空写缓冲区
     readBuff_.RetrieveAll();                             // 清空读缓冲区
+    writeBuff_.EnsureWriteable(writeBuffSize);           // 按配置预留缓冲区，已足够时不重新分配
+    readBuff_.EnsureWriteable(readBuffSize);
     isClose_ = false;                                    // 标记连接为开启状态
+    busy_ = false;
+    phase_ = -1;
+    SetPhase_(IDLE);
+    timeoutCheck = TimeoutCheck{ -1, 0, 0, 0 };
+    pendingFinish_ = false;
+    h2_.reset();
+    h2Iov_.clear();
+    h2IovIdx_ = h2Pending_ = 0;
+    rearm_ = -1;
+    proxied_ = false;
+    handshake_ = Tls::Enabled();
+    if (handshake_) { tls_.Attach(fd); }                 // 失败时握手永远不会完成，由超时关闭
+    readyTime_ = std::chrono::steady_clock::now();
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)userCount); // 记录日志
 }
 
-void HttpConn::Close() {                                 // 关闭连接的函数
+bool HttpConn::Close() {                                 // 关闭连接的函数，返回本次是否真正关闭
     response_.UnmapFile();                               // 如果有映射文件，先解除映射
+    h2_.reset();                                         // 同时释放各个流映射的文件
+    h2Pending_ = 0;
+    if (ws_) {                                           // 退出广播，已排队的帧随会话释放
+        WebSocketHub::Instance()->Remove(ws_.get());
+        ws_.reset();
+    }
+    if (proxy_) { proxy_->Abort(); }                     // 转发中途关闭的后端连接不放回池中
     if (isClose_ == false) {                             // 如果连接未关闭
         isClose_ = true;                                 // 标记为已关闭
         userCount--;                                     // 减少用户计数
+        tls_.Detach();                                   // 在关闭描述符之前发送 close_notify
         close(fd_);                                      // 关闭文件描述符
         LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(), GetPort(), (int)userCount); // 记录日志
+        return true;
     }
+    return false;
 }
 int HttpConn::GetFd() const {
     return fd_;
@@ -52,24 +101,53 @@ int HttpConn::GetPort() const {
 }
 
 ssize_t HttpConn::read(int* saveErrno) {                 // 从连接读取数据的函数
+    TRACE_SCOPE(Trace::READ, fd_);
+    if (tls_.Active() && !tls_.Established()) {          // 先推进握手，完成后接着读取应用数据
+        int ret = tls_.Handshake();
+        if (ret <= 0) {
+            *saveErrno = ret < 0 ? EPROTO : EAGAIN;
+            return -1;
+        }
+    }
     ssize_t len = -1;                                    // 初始化读取长度为-1
     do {
-        len = readBuff_.ReadFd(fd_, saveErrno);          // 从文件描述符读取数据到缓冲区
+        if (tls_.Active()) {                             // 解密后的数据，一次读到 SSL 没有剩余
+            len = tls_.Read(readBuff_, saveErrno);
+        }
+        else {
+            len = readBuff_.ReadFd(fd_, saveErrno);      // 从文件描述符读取数据到缓冲区
+        }
         if (len <= 0) {                                  // 如果读取失败或数据读取完毕
             break;                                       // 跳出循环
         }
+        Metrics::Add(Metrics::BYTES_IN, len);
+        phaseBytes_.fetch_add(len, std::memory_order_relaxed);
     } while (isET);                                      // 如果是边缘触发模式，继续读取
     return len;                                          // 返回读取的字节数
 }
 
 ssize_t HttpConn::write(int* saveErrno) {                // 向连接写入数据的函数
+    TRACE_SCOPE(Trace::WRITEV, fd_);
+    if (tls_.WantWrite()) {                              // 继续被阻塞的握手
+        if (tls_.Handshake() < 0) {
+            *saveErrno = EPROTO;
+            return -1;
+        }
+        *saveErrno = EAGAIN;
+        return -1;
+    }
+    if (h2_) { return WriteH2_(saveErrno); }
+    if (ws_) { return WriteWs_(saveErrno); }
     ssize_t len = -1;                                    // 初始化写入长度为-1
     do {
-        len = writev(fd_, iov_, iovCnt_);                // writev 允许一次性写入多个非连续内存块，而 iovec 结构数组正是用来描述这些内存块的位置和大小。
+        len = Writev_(iov_, iovCnt_);                    // writev 允许一次性写入多个非连续内存块，而 iovec 结构数组正是用来描述这些内存块的位置和大小。
         if(len <= 0) {                                   // 如果写入失败
             *saveErrno = errno;                          // 保存错误码
             break;                                       // 跳出循环
         }
+        bytesSent_ += len;
+        Metrics::Add(Metrics::BYTES_OUT, len);
+        phaseBytes_.fetch_add(len, std::memory_order_relaxed);
         
         //一次 writev 调用可能无法发送 iovec 中描述的所有数据。通过调整基地址和长度，程序可以在下一次调用时继续发送剩余的数据，而无需重新组织或复制这些数据。
 
@@ -91,23 +169,217 @@ ssize_t HttpConn::write(int* saveErrno) {                // 向连接写入数
             writeBuff_.Retrieve(len);                   // 从写缓冲区移除已发送的数据
         }
     } while (isET || ToWriteBytes() > 10240);           // 在边缘触发模式下继续写入，或者待写数据大于10KB
+    if (ToWriteBytes() == 0) {
+        if (pendingFinish_) { FinishRequest_(); }       // 响应写完，记录指标和访问日志
+        readyTime_ = std::chrono::steady_clock::now();  // 流水线中的下一个请求从此刻开始计时
+    }
     return len;
 }
 
+// 先写完上一批剩下的数据，再向会话取一批新的；每次最多取一批，之后回到 process 处理对端的帧
+ssize_t HttpConn::WriteH2_(int* saveErrno) {
+    ssize_t len = 0;
+    bool filled = false;
+    while (true) {
+        if (h2Pending_ == 0) {
+            if (filled) { break; }
+            h2Pending_ = h2_->Fill(h2Iov_);
+            h2IovIdx_ = 0;
+            filled = true;
+            if (h2Pending_ == 0) { break; }
+        }
+        int cnt = static_cast<int>(min<size_t>(h2Iov_.size() - h2IovIdx_, IOV_MAX));
+        len = Writev_(&h2Iov_[h2IovIdx_], cnt);
+        if (len <= 0) {
+            *saveErrno = errno;
+            break;
+        }
+        Metrics::Add(Metrics::BYTES_OUT, len);
+        phaseBytes_.fetch_add(len, std::memory_order_relaxed);
+        h2Pending_ -= len;
+        size_t n = len;
+        while (n > 0) {                                  // 跳过已写完的 iovec，调整写了一部分的那个
+            iovec& v = h2Iov_[h2IovIdx_];
+            if (n >= v.iov_len) {
+                n -= v.iov_len;
+                h2IovIdx_++;
+            }
+            else {
+                v.iov_base = (uint8_t*) v.iov_base + n;
+                v.iov_len -= n;
+                n = 0;
+            }
+        }
+    }
+    return len;
+}
+
+// 帧写完之前不出队，广播线程只在队尾追加，iovec 指向的帧内容在写的过程中保持有效
+ssize_t HttpConn::WriteWs_(int* saveErrno) {
+    size_t budget = WS_BATCH;
+    ssize_t len = 0;
+    while (budget > 0) {
+        size_t n = ws_->Collect(wsIov_, budget);
+        if (n == 0) { return len; }
+        len = Writev_(wsIov_.data(), static_cast<int>(wsIov_.size()));
+        if (len <= 0) {
+            *saveErrno = errno;
+            return len;
+        }
+        ws_->Consume(len);
+        Metrics::Add(Metrics::BYTES_OUT, len);
+        phaseBytes_.fetch_add(len, std::memory_order_relaxed);
+        budget -= min<size_t>(budget, len);
+    }
+    if (ws_->Pending() > 0) {                            // 本批写满，让出线程，等下一次写事件
+        *saveErrno = EAGAIN;
+        return -1;
+    }
+    return len;
+}
+
+ssize_t HttpConn::Writev_(const struct iovec* iov, int cnt) {
+    return tls_.Active() ? tls_.Writev(fd_, iov, cnt) : writev(fd_, iov, cnt);
+}
+
+int64_t HttpConn::NowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+bool HttpConn::LimitRequest(const struct in_addr& ip, Router::Reply& reply) {
+    if (!allowRequest || allowRequest(ip.s_addr)) { return false; }
+    Metrics::Add(Metrics::LIMITED);
+    reply.code = 429;
+    reply.contentType = "text/plain";
+    reply.content.assign("Too many requests\n");
+    return true;
+}
+
+void HttpConn::SetPhase_(PHASE phase) {
+    if (phase_.load(std::memory_order_relaxed) == phase) { return; }
+    phaseBytes_.store(0, std::memory_order_relaxed);
+    phaseSinceMs_.store(NowMs(), std::memory_order_relaxed);
+    phase_.store(phase, std::memory_order_relaxed);
+}
+
+void HttpConn::FinishRequest_() {
+    using namespace std::chrono;
+    pendingFinish_ = false;
+    AccessRecord rec;
+    rec.ip = addr_.sin_addr;
+    rec.method = proxied_ ? &proxy_->Method() : &request_.method();
+    rec.path = proxied_ ? &proxy_->Path() : &request_.path();
+    rec.version = proxied_ ? &proxy_->Version() : &request_.version();
+    rec.status = proxied_ ? proxy_->Status() : response_.Code();
+    rec.bytes = bytesSent_;
+    rec.queueUs = queueUs_;
+    rec.parseUs = parseUs_;
+    rec.totalUs = duration_cast<microseconds>(steady_clock::now() - readyTime_).count();
+    Metrics::CountStatus(rec.status);
+    Metrics::Observe(Metrics::REQUEST_TIME, rec.totalUs);
+    AccessLog* log = AccessLog::Instance();
+    if (log->ShouldLog(rec)) {
+        log->Write(rec);
+    }
+}
+
 bool HttpConn::process() {                               // 处理读取的请求数据
+    using namespace std::chrono;
+    steady_clock::time_point start = steady_clock::now();
+    if (handshake_) {
+        if (!tls_.Established()) {                       // 握手计入请求头期限，防止慢速握手占住连接
+            SetPhase_(HEADER);
+            return tls_.WantWrite();
+        }
+        handshake_ = false;
+    }
+    if (h2_) { return ProcessH2_(); }
+    if (ws_) { return ProcessWs_(); }
+    size_t n = min(readBuff_.ReadableBytes(), Http2Session::PREFACE_LEN);
+    if (enableH2 && n > 0 && memcmp(readBuff_.Peek(), Http2Session::PREFACE, n) == 0) {
+        if (n < Http2Session::PREFACE_LEN) {             // 前言还不完整，等待更多数据
+            SetPhase_(HEADER);
+            return false;
+        }
+        StartH2_();
+        return ProcessH2_();
+    }
+    proxied_ = false;
+    if (Proxy::Enabled()) {                              // 匹配路由的请求不解析，整个交给后端
+        ProxySession::DETECT detect = ProxySession::Detect(readBuff_);
+        if (detect == ProxySession::NEED_MORE) {
+            SetPhase_(HEADER);
+            return false;
+        }
+        if (detect == ProxySession::MATCHED) {
+            StartProxy_(start);
+            return false;
+        }
+    }
     request_.Init();                                     // 初始化请求对象
     if (readBuff_.ReadableBytes() <= 0) {                // 如果没有可读数据
+        SetPhase_(IDLE);
+        return false;
+    }
+    queueUs_ = duration_cast<microseconds>(start - readyTime_).count();
+    TRACE_SINCE(Trace::QUEUE, readyTsc_, fd_);
+    bool parsed;
+    {
+        TRACE_SCOPE(Trace::PARSE, fd_);
+        parsed = request_.parse(readBuff_);
+    }
+    if (parsed && !request_.IsFinished()) {             // 请求还不完整，已收到的部分留在读缓冲区
+        SetPhase_(request_.State() == HttpRequest::BODY ? BODY : HEADER);   // 请求体按吞吐检查，请求头按固定期限
         return false;
     }
-    else if (request_.parse(readBuff_)) {               // 解析请求
+    parseUs_ = duration_cast<microseconds>(steady_clock::now() - start).count();
+    bytesSent_ = 0;
+    Metrics::Observe(Metrics::PARSE_TIME, parseUs_);
+    pendingFinish_ = true;
+    reply_.Reset();
+    bool limited = parsed && LimitRequest(addr_.sin_addr, reply_);   // 拆成多次读到的请求也只扣一次
+    if (parsed && !limited && enableH2 && !tls_.Active() && (request_.method() == "GET" || request_.method() == "HEAD")) {
+        const string& upgrade = request_.Header(KnownHeader::UPGRADE);
+        const string& settings = request_.Header(KnownHeader::HTTP2_SETTINGS);
+        if (upgrade.find("h2c") != string::npos && !settings.empty()) {    // h2c 升级，原请求作为流 1
+            pendingFinish_ = false;
+            h2_.reset(new Http2Session(srcDir, addr_.sin_addr, fd_));
+            Metrics::Add(Metrics::H2_CONNS);
+            h2_->Upgrade(request_, settings);   // 随后的前言由会话校验
+            return ProcessH2_();
+        }
+    }
+    if (parsed && !limited && enableWs && !isDraining && WebSocketSession::IsUpgrade(request_)) {
+        ws_ = std::make_shared<WebSocketSession>(fd_, owner_);
+        response_.Init(srcDir, request_.path(), false, 101);
+        bytesSent_ = ws_->Accept(request_.Header(KnownHeader::SEC_WEBSOCKET_KEY));  // 101 作为第一帧排入发送队列
+        FinishRequest_();
+        Metrics::Add(Metrics::WS_UPGRADES);
+        WebSocketHub::Instance()->Add(ws_);
+        return ProcessWs_();                             // 客户端可能紧跟着发来了帧
+    }
+    if (limited) {
+        response_.Init(srcDir, request_.path(), IsKeepAlive(), reply_.code);
+    }
+    else if (parsed) {                                   // 解析请求
         LOG_DEBUG("%s", request_.path().c_str());       // 记录请求路径
-        response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);    // 初始化响应对象
+        Router::Instance()->Dispatch(request_, reply_); // 处理函数可能改写路径或给出内存中的响应体
+        response_.Init(srcDir, request_.path(), IsKeepAlive(), reply_.code);    // 初始化响应对象
     }
     else {
         response_.Init(srcDir, request_.path(), false, 400);       // 如果解析失败，初始化错误响应        
     }
 
-    response_.MakeResponse(writeBuff_);             // 构建响应并存入写缓冲区
+    {
+        TRACE_SCOPE(Trace::FILE_IO, fd_);
+        if (parsed && reply_.contentType) {
+            response_.MakeResponse(writeBuff_, reply_.content, reply_.contentType);
+        }
+        else {
+            response_.MakeResponse(writeBuff_);         // 构建响应并存入写缓冲区
+        }
+    }
 
     iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek()); // 设置第一部分iovec的基址为写缓冲区的起始位置
     iov_[0].iov_len = writeBuff_.ReadableBytes();            // 设置第一部分iovec的长度为写缓冲区的可读字节数
@@ -119,6 +391,53 @@ bool HttpConn::process() {                               // 处理读取的请
         iovCnt_ = 2;                                         // 设置iovec结构数量为2
     }
     LOG_DEBUG("filesize:%d, %d to %d", response_.FileLen(), iovCnt_, ToWriteBytes());   // 记录调试信息
+    SetPhase_(WRITE);
 
     return true;
-}
\ No newline at end of file
+}
+
+void HttpConn::StartH2_() {
+    h2_.reset(new Http2Session(srcDir, addr_.sin_addr, fd_));
+    Metrics::Add(Metrics::H2_CONNS);
+    h2_->Start();
+}
+
+bool HttpConn::ProcessH2_() {
+    if (isDraining) { h2_->GoAway(); }
+    h2_->OnData(readBuff_);                              // 出错时会话已排好 GOAWAY，写完后关闭
+    bool want = h2_->WantWrite();
+    SetPhase_(want ? WRITE : IDLE);
+    return want;
+}
+
+bool HttpConn::ProcessWs_() {
+    ws_->OnData(readBuff_);                              // 出错时会话已排好关闭帧，写完后关闭
+    SetPhase_(WEBSOCKET);
+    return ws_->Pending() > 0;
+}
+
+void HttpConn::StartProxy_(std::chrono::steady_clock::time_point start) {
+    using namespace std::chrono;
+    if (!proxy_) { proxy_.reset(new ProxySession()); }
+    queueUs_ = duration_cast<microseconds>(start - readyTime_).count();
+    TRACE_SINCE(Trace::QUEUE, readyTsc_, fd_);
+    parseUs_ = 0;
+    bytesSent_ = 0;
+    pendingFinish_ = true;
+    proxied_ = true;
+    SetPhase_(UPSTREAM);
+    Router::Reply reply;                                 // Detect 已等到请求头完整，与本地请求一样每个请求扣一次
+    bool limited = LimitRequest(addr_.sin_addr, reply);
+    proxy_->Start(readBuff_, fd_, &tls_, addr_.sin_addr, isDraining, limited);
+}
+
+ProxySession::WAIT HttpConn::StepProxy() {
+    ProxySession::WAIT wait = proxy_->Step(readBuff_);
+    phaseBytes_.fetch_add(proxy_->TakeProgress(), std::memory_order_relaxed);
+    if (wait == ProxySession::DONE) {
+        bytesSent_ = proxy_->BytesSent();
+        FinishRequest_();
+        readyTime_ = std::chrono::steady_clock::now();  // 流水线中的下一个请求从此刻开始计时
+    }
+    return wait;
+}
@@ -6,26 +6,56 @@
 #include <arpa/inet.h>           // 提供sockaddr_in结构和网络函数
 #include <stdlib.h>              // 包含atoi()等标准库函数
 #include <errno.h>               // 包含错误号定义
+#include <chrono>                // 请求各阶段计时
+#include <functional>
+#include <memory>
+#include <vector>
+
 
 #include "../log/log.h"          // 引入日志模块
+#include "../log/accesslog.h"    // 引入访问日志模块
+#include "../metrics/metrics.h"  // 引入指标统计模块
+#include "../trace/trace.h"      // 引入分阶段追踪
 #include "../pool/sqlconnRAII.h" // 引入SQL连接RAII封装
 #include "../buffer/buffer.h"    // 引入缓冲区处理模块
 #include "httprequest.h"         // 引入HTTP请求处理模块
 #include "httpresponse.h"        // 引入HTTP响应处理模块
+#include "router.h"              // 引入路由表
+#include "http2.h"               // 引入HTTP/2会话
+#include "websocket.h"           // 引入WebSocket会话
+#include "proxy.h"               // 引入反向代理会话
+#include "../tls/tls.h"          // 引入TLS会话
 
 class HttpConn {
 public:
+    enum PHASE {        // 连接所处阶段，各阶段超时不同
+        IDLE = 0,       // 长连接等待下一个请求
+        HEADER,         // 已收到部分请求行或请求头
+        BODY,           // 请求头完整，正在接收请求体
+        WRITE,          // 响应已生成，等待客户端读取
+        WEBSOCKET,      // 已升级为 WebSocket
+        UPSTREAM,       // 请求已交给反向代理的后端
+    };
+
+    // 超时检查的上一次快照，仅由反应堆线程的定时器回调访问
+    struct TimeoutCheck {
+        int phase;
+        int64_t since;
+        uint64_t bytes;
+        int64_t checkedMs;
+    };
+
     HttpConn();
 
     ~HttpConn();
 
-    void init(int sockFd, const sockaddr_in& addr);// 初始化函数，设置套接字和地址
+    void init(int sockFd, const sockaddr_in& addr, int owner = 0);// 初始化函数，设置套接字、地址和所属反应堆
 
     ssize_t read(int *saveErrno);               // 从套接字读取数据，保存错误码
 
     ssize_t write(int *saveErrno);              // 向套接字写入数据，保存错误码
 
-    void Close();                               // 关闭连接
+    bool Close();                               // 关闭连接，已关闭时返回 false
 
     int GetFd() const;                           // 获取文件描述符
 
@@ -37,17 +67,71 @@ public:
 
     bool process();                             // 处理读取的数据
 
+    void MarkReady() {                          // 反应堆线程分发读事件时记录就绪时间
+        readyTime_ = std::chrono::steady_clock::now();
+        TRACE_STAMP(readyTsc_);
+    }
+
     int ToWriteBytes() {                        // 返回待写入的字节数
+        if (tls_.WantWrite()) { return 1; }     // 握手输出被阻塞，等写事件继续
+        if (ws_) { return static_cast<int>(ws_->Pending()); }
+        if (h2_) { return h2Pending_; }
         return iov_[0].iov_len + iov_[1].iov_len;
     }
 
-    bool IsKeepAlive() const {                  // 检查连接是否保持活动状态
-        return request_.IsKeepAlive();
+    bool IsKeepAlive() const {                  // 检查连接是否保持活动状态，排空期间一律关闭
+        if (handshake_) { return !isDraining; } // 写事件中完成了 TLS 握手，还没有请求
+        if (h2_) { return !h2_->Closing(); }    // HTTP/2 排空时先发 GOAWAY，流都完成后再关闭
+        if (ws_) { return !ws_->Closing(); }    // 关闭帧写完后关闭
+        if (proxied_) { return proxy_->KeepAlive() && !isDraining; }
+        return request_.IsKeepAlive() && !isDraining;
+    }
+
+    bool IsClosed() const { return isClose_; }
+
+    void SetBusy(bool busy) {                   // 反应堆投递任务时置位，工作线程处理完清除
+        busy_.store(busy, std::memory_order_release);
+    }
+
+    bool IsBusy() const { return busy_.load(std::memory_order_acquire); }
+
+    // WebSocket 连接随时可能被广播唤醒，epoll 一律由反应堆线程重新挂上：
+    // 工作线程处理完记下要读还是要写，交回反应堆；反应堆取走后再看一次发送队列
+    bool IsWebSocket() const { return ws_ != nullptr; }
+    void SetRearm(bool write) { rearm_.store(write ? 1 : 0, std::memory_order_release); }
+    int TakeRearm() { return rearm_.exchange(-1, std::memory_order_acq_rel); }    // -1 表示工作线程没有交回
+    bool WsArm(bool write) { return ws_->Arm(write); }
+    bool WsOverflow() { return ws_->Overflow(); }
+
+    // 反向代理：请求交给后端后，读写事件都由 StepProxy 推进，直到返回 DONE 或 FAILED
+    bool Proxying() const { return proxy_ && proxy_->Active(); }
+    ProxySession::WAIT StepProxy();
+    int UpstreamFd() const { return proxy_->UpstreamFd(); }
+
+    PHASE Phase() const { return static_cast<PHASE>(phase_.load(std::memory_order_relaxed)); }
+    // 明文 HTTP/1.1 且处在两个请求之间：反应堆线程才能直接写一个完整的 HTTP 响应后关闭
+    bool AtRequestBoundary() const {
+        return !h2_ && !ws_ && !Proxying() && !tls_.Active() && Phase() == IDLE;
     }
+    int64_t PhaseSinceMs() const { return phaseSinceMs_.load(std::memory_order_relaxed); }
+    uint64_t PhaseBytes() const { return phaseBytes_.load(std::memory_order_relaxed); }   // 本阶段读或写的字节数
+
+    static int64_t NowMs();
+
+    // 每个解析完整的请求（包括 HTTP/2 的流）扣一次令牌；不足时 reply 换成 429 并返回 true
+    static bool LimitRequest(const struct in_addr& ip, Router::Reply& reply);
+
+    TimeoutCheck timeoutCheck;
 
     static bool isET;               // 静态成员变量，表示是否使用边缘触发模式     
     static const char* srcDir;      // 静态成员变量，表示资源目录
     static std::atomic<int> userCount; // 静态原子成员变量，追踪用户数
+    static std::atomic<bool> isDraining;   // 服务器正在排空，响应后不再保持连接
+    static int readBuffSize;        // 读缓冲区初始大小
+    static int writeBuffSize;       // 写缓冲区初始大小
+    static bool enableH2;           // 接受 h2c（前言或 Upgrade）
+    static bool enableWs;           // 接受 WebSocket 升级
+    static std::function<bool(uint32_t ip)> allowRequest;  // 按客户端 IP 的请求限速，为空不限
 
 private:
 
@@ -55,6 +139,7 @@ private:
     struct sockaddr_in addr_;       // 网络地址结构
 
     bool isClose_;                   // 标记连接是否已关闭
+    std::atomic<bool> busy_;         // 有任务在工作线程中处理
 
     int iovCnt_;                     // 表示iovec结构数组的数量
     struct iovec iov_[2];            // iovec结构数组，用于readv/writev
@@ -64,6 +149,46 @@ private:
 
     HttpRequest request_;            // HTTP请求对象
     HttpResponse response_;          // HTTP响应对象
+    Router::Reply reply_;            // 路由处理函数的结果
+
+    void StartH2_();                 // 收到连接前言（prior knowledge），切换到 HTTP/2
+    bool ProcessH2_();
+    ssize_t WriteH2_(int* saveErrno);
+    bool ProcessWs_();
+    ssize_t WriteWs_(int* saveErrno);
+    void StartProxy_(std::chrono::steady_clock::time_point start);
+    ssize_t Writev_(const struct iovec* iov, int cnt);  // TLS 连接未开启 kTLS 时经 SSL_write
+    void FinishRequest_();           // 响应写完后记录指标和访问日志
+    void SetPhase_(PHASE phase);     // 阶段变化时记录开始时间并清零字节数
+
+    std::atomic<int> phase_;         // 工作线程更新，定时器回调读取，不在每次读写时调整定时器
+    std::atomic<int64_t> phaseSinceMs_;
+    std::atomic<uint64_t> phaseBytes_;
+
+    std::chrono::steady_clock::time_point readyTime_;   // 读事件就绪时间
+    uint64_t readyTsc_;              // 读事件就绪时的 TSC，仅追踪时使用
+    int64_t queueUs_;                // 线程池排队耗时
+    int64_t parseUs_;                // 解析耗时
+    size_t bytesSent_;               // 当前响应已发送字节数
+    bool pendingFinish_;             // 当前响应尚未记录指标和访问日志
+
+    TlsSession tls_;
+    bool handshake_;                 // TLS 握手尚未完成，或完成后还没有处理过数据
+
+    std::unique_ptr<Http2Session> h2_;  // 非空表示连接已切换到 HTTP/2
+    std::vector<iovec> h2Iov_;       // 当前一批待写的数据
+    size_t h2IovIdx_;
+    size_t h2Pending_;
+
+    static const size_t WS_BATCH = 256 * 1024;  // 每次写事件最多写出的 WebSocket 数据，之后让出线程
+
+    int owner_;                      // 所属反应堆，WebSocket 广播据此唤醒
+    std::shared_ptr<WebSocketSession> ws_;  // 非空表示连接已升级为 WebSocket，同时登记在 WebSocketHub
+    std::vector<iovec> wsIov_;
+    std::atomic<int> rearm_;
+
+    std::unique_ptr<ProxySession> proxy_;   // 第一次转发时创建，之后随连接复用
+    bool proxied_;                   // 当前请求由反向代理处理
 };
 
 #endif  //HTTP_CONN_H
\ No newline at end of file
@@ -1,181 +1,222 @@
 #include "httprequest.h"
 using namespace std;
 
-const unordered_set<string> HttpRequest::DEFAULT_HTML {
-    "/index", "/register", "/login",
-    "/welcome", "/video", "/picture", };
-const unordered_map<string, int> HttpRequest::DEFAULT_HTML_TAG {
-    {"/register.html", 0}, {"/login.html", 1}, };
+const size_t HttpRequest::MAX_HEAD;
+const size_t HttpRequest::MAX_BODY;
 
 void HttpRequest::Init() {
-    method_ = path_ = version_ = body_ = "";
+    method_.clear();        // 只清空内容，保留容量，长连接上的后续请求不再分配
+    path_.clear();
+    version_.clear();
+    body_.clear();
     state_ = REQUEST_LINE;  // 设置初始解析状态为请求行
-    header_.clear();        // 清空头部字段映射
-    post_.clear();          // 清空 POST 字段映射
+    for (uint32_t bits = present_; bits; bits &= bits - 1) {    // 清空头部字段，保留各字符串的容量
+        known_[__builtin_ctz(bits)].clear();
+    }
+    present_ = 0;
+    other_.clear();
+    post_.clear();          // 清空 POST 字段
+    arena_.Reset();
+}
+
+void HttpRequest::Assign(const string& method, const string& path, const string& contentType, const string& body) {
+    Init();
+    method_ = method;
+    path_ = path;
+    version_ = "2";
+    if (!contentType.empty()) { SetHeader_("Content-Type", 12, contentType.data(), contentType.size()); }
+    body_ = body;
+    if (!body_.empty()) { ParsePost_(); }
+    state_ = FINISH;
 }
 
-bool HttpRequest::IsKeepAlive() const {     //判断连接是否保持活跃
-    if (header_.count("Connection") == 1) {
-        return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";// 如果存在 "Connection" 字段且版本为 1.1，则保持连接
+string HttpRequest::GetHeader(const char* key) const {
+    size_t len = strlen(key);
+    KnownHeader::ID id = KnownHeader::Find(key, len);
+    if (id != KnownHeader::COUNT) { return known_[id]; }
+    for (const Field& f : other_) {
+        if (f.name.len == len && strncasecmp(arena_.Data(f.name), key, len) == 0) {
+            return string(arena_.Data(f.value), f.value.len);
+        }
     }
-    return false;
+    return "";
+}
+
+void HttpRequest::SetHeader_(const char* name, size_t nameLen, const char* value, size_t valueLen) {
+    KnownHeader::ID id = KnownHeader::Find(name, nameLen);
+    if (id != KnownHeader::COUNT) {         // 重复的头以最后一个为准
+        known_[id].assign(value, valueLen);
+        present_ |= 1u << id;
+        return;
+    }
+    other_.push_back({ arena_.Append(name, nameLen), arena_.Append(value, valueLen) });
+}
+
+bool HttpRequest::IsKeepAlive() const {     //判断连接是否保持活跃：Connection 为 keep-alive 且版本为 1.1
+    return known_[KnownHeader::CONNECTION] == "keep-alive" && version_ == "1.1";
 }
 
+// 请求头和 Content-Length 指定的请求体到齐后才取出，之前只检查不消费；多出的字节是流水线中的下一个请求，留在缓冲区
 bool HttpRequest::parse(Buffer& buff) {
-    const char CRLF[] = "\r\n";          // 搜索换行符，用于分割HTTP请求的各个部分
     if (buff.ReadableBytes() <= 0) {
         return false;
     }
-    while (buff.ReadableBytes() && state_ != FINISH) {
-        const char* lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF +  2);
-        std::string line(buff.Peek(), lineEnd);     // 从缓冲区获取一行数据
-        switch (state_)
-        {
-            case REQUEST_LINE:
-                if (!ParseRequestLine_(line)) {
-                    return false;
-                }
-                ParsePath_();
-                break;
-            case HEADERS:
-                ParseHeader_(line);
-                if (buff.ReadableBytes() <= 2) {
-                    state_ = FINISH;
-                }
-                break;
-            case BODY:
-                ParseBody_(line);
-                break;
-            default:
-                break;
+    const char* begin = buff.Peek();
+    size_t avail = buff.ReadableBytes();
+    const char* headEnd = static_cast<const char*>(memmem(begin, avail, "\r\n\r\n", 4));
+    if (!headEnd) {
+        if (avail > MAX_HEAD) {
+            LOG_ERROR("Request header too large");
+            return Fail_(buff);
         }
-        if (lineEnd == buff.BeginWrite()) { break; }        // 判断是否已读取完所有数据
-        buff.RetrieveUntil(lineEnd + 2);                    // 从缓冲区移除已解析的数据
+        return true;                        // 请求头还不完整，等待更多数据
     }
-    LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
-    return true;
-}
-
-void HttpRequest::ParsePath_() {
-    if (path_ == "/") {      // 如果路径是根路径
-        path_ = "/index.html";
+    if (static_cast<size_t>(headEnd - begin) > MAX_HEAD) {
+        LOG_ERROR("Request header too large");
+        return Fail_(buff);
+    }
+    const char* lineEnd = static_cast<const char*>(memmem(begin, headEnd + 2 - begin, "\r\n", 2));
+    if (!ParseRequestLine_(begin, lineEnd)) {
+        return Fail_(buff);
     }
-    else {
-        for (auto &item : DEFAULT_HTML) {    // 遍历预设的HTML路径
-            if (item == path_) {
-                path_ += ".html";   // 添加html后缀
-                break;
+    for (const char* line = lineEnd + 2; line < headEnd + 2; ) {
+        const char* eol = static_cast<const char*>(memmem(line, headEnd + 2 - line, "\r\n", 2));
+        if (!ParseHeader_(line, eol)) {
+            return Fail_(buff);
+        }
+        line = eol + 2;
+    }
+    state_ = BODY;
+    if (present_ & (1u << KnownHeader::TRANSFER_ENCODING)) {   // 不支持分块的请求体
+        LOG_ERROR("Request body with Transfer-Encoding");
+        return Fail_(buff);
+    }
+    size_t bodyLen = 0;
+    const string& length = known_[KnownHeader::CONTENT_LENGTH];
+    if (!length.empty()) {
+        for (char c : length) {
+            if (c < '0' || c > '9' || bodyLen > MAX_BODY) {
+                LOG_ERROR("Bad Content-Length");
+                return Fail_(buff);
             }
+            bodyLen = bodyLen * 10 + (c - '0');
         }
+        if (bodyLen > MAX_BODY) {
+            LOG_ERROR("Request body too large");
+            return Fail_(buff);
+        }
+    }
+    size_t total = headEnd + 4 - begin + bodyLen;
+    if (avail < total) {
+        return true;                        // 请求体还没有到齐
     }
+    body_.assign(headEnd + 4, bodyLen);
+    buff.Retrieve(total);
+    state_ = FINISH;
+    if (bodyLen > 0) { ParsePost_(); }
+    LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
+    return true;
 }
 
-bool HttpRequest::ParseRequestLine_(const string& line) {   // 解析请求行
-    regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");     // 使用正则表达式解析请求行
-    smatch subMatch;    // 存储正则匹配结果
-    if (regex_match(line, subMatch, patten)) {  // 如果匹配成功
-        method_ = subMatch[1];  // 设置请求方法
-        path_ = subMatch[2];    // 设置请求路径
-        version_ = subMatch[3]; // 设置HTTP版本
-        state_ = HEADERS;       // 更改解析状态为头部解析
-        return true;
-    }
-    LOG_ERROR("RequestLine error");
+bool HttpRequest::Fail_(Buffer& buff) {    // 请求不合法：丢弃已收到的数据，清空头部使连接随 400 关闭
+    Init();
+    buff.RetrieveAll();
     return false;
 }
 
-void HttpRequest::ParseHeader_(const string& line) {
-    regex patten("^([^:]*): ?(.*)$");
-    smatch subMatch;
-    if (regex_match(line, subMatch, patten)) {
-        header_[subMatch[1]] = subMatch[2]; // 存储头部键值对
-    }
-    else {
-        state_ = BODY;  // 更改解析状态为正文解析
+bool HttpRequest::ParseRequestLine_(const char* begin, const char* end) {   // 解析请求行：方法 SP 目标 SP HTTP/版本
+    const char* sp1 = static_cast<const char*>(memchr(begin, ' ', end - begin));
+    const char* sp2 = sp1 ? static_cast<const char*>(memchr(sp1 + 1, ' ', end - sp1 - 1)) : nullptr;
+    if (!sp1 || !sp2 || sp1 == begin || sp2 == sp1 + 1 || end - sp2 < 6 || memcmp(sp2 + 1, "HTTP/", 5) != 0 ||
+        memchr(sp2 + 1, ' ', end - sp2 - 1)) {
+        LOG_ERROR("RequestLine error");
+        return false;
     }
+    method_.assign(begin, sp1);             // 设置请求方法
+    path_.assign(sp1 + 1, sp2);             // 设置请求路径
+    version_.assign(sp2 + 6, end);          // 设置HTTP版本
+    state_ = HEADERS;                       // 更改解析状态为头部解析
+    return true;
 }
 
-void HttpRequest::ParseBody_(const string& line) {
-    body_ = line;    // 设置正文内容
-    ParsePost_();   // 解析 POST 请求
-    state_ = FINISH;    // 更改解析状态为解析完成
-    LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size());
+bool HttpRequest::ParseHeader_(const char* line, const char* end) {    // 名字: 值，值两侧的空白去掉
+    const char* colon = static_cast<const char*>(memchr(line, ':', end - line));
+    if (!colon || colon == line) {
+        LOG_ERROR("Header line error");
+        return false;
+    }
+    const char* value = colon + 1;
+    while (value < end && (*value == ' ' || *value == '\t')) { value++; }
+    const char* valueEnd = end;
+    while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) { valueEnd--; }
+    SetHeader_(line, colon - line, value, valueEnd - value);    // 存储头部键值对
+    return true;
 }
 
-int HttpRequest::ConverHex(char ch)  {  // 将字符转换为十六进制的方法
+int HttpRequest::ConverHex(char ch)  {  // 将十六进制字符转换为数值，不是十六进制时为 -1
+    if (ch >= '0' && ch <= '9') return ch - '0';
     if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;   // 处理大写字母
     if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;   // 处理小写字母
-    return ch;
+    return -1;
 }
     
-void HttpRequest::ParsePost_() {            // 解析 POST 请求
-    if (method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded") {// 如果是 POST 请求且内容类型为 application/x-www-form-urlencoded
+void HttpRequest::ParsePost_() {            // 解析 POST 请求，登录注册等按路径的处理交给 Router
+    if (method_ == "POST" && IsForm()) {    // 如果是 POST 请求且内容类型为 application/x-www-form-urlencoded
         ParseFromUrlencode_();  // 解析 URL 编码的 POST 数据
-        if (DEFAULT_HTML_TAG.count(path_)) {    // 如果路径在 HTML 标签映射中
-            int tag = DEFAULT_HTML_TAG.find(path_)->second; // 获取 HTML 标签
-            LOG_DEBUG("Tag:%d", tag);
-            if (tag == 0 || tag == 1) {
-                bool isLogin = (tag == 1);   // 判断是否为登录操作
-                if (UserVerify(post_["username"], post_["password"], isLogin)) {    // 验证用户
-                    path_ = "/welcome.html";
-                }
-                else {
-                    path_ = "/error.html";
-                }
-            }
-        }
     }
 }
 
-void HttpRequest::ParseFromUrlencode_() {    // 解析 URL 编码
-    if (body_.size() == 0) { return; }
+bool HttpRequest::IsForm() const {
+    return known_[KnownHeader::CONTENT_TYPE] == "application/x-www-form-urlencoded";
+}
 
-    string key, value;  // 存储键值对
-    int num = 0;
-    int n = body_.size();    // 正文长度
-    int i = 0, j = 0;       // 迭代器
+void HttpRequest::ParseFromUrlencode_() {    // 解析 URL 编码：key=value 以 & 分隔，解码后的键值放在 arena_ 中
                                     /*  POST http://www.example.com HTTP/1.1    
                                         Content-Type:application/x-www-form-urlencoded;charset=utf-8
                                         title=test&sub%5B%5D=1&sub%5B%5D=2&sub%5B%5D=3 */
-
-    for (; i < n; i++) {
-        char ch = body_[i]; // 获取字符
-        switch (ch) {   // 根据字符进行不同处理
-            case '=':
-                key = body_.substr(j, i - j);       
-                j = i + 1;
-                break;
-            case '+':
-                body_[i] = ' ';
-                break;
-            case '%':
-                num = ConverHex(body_[i + 1]) * 16 + ConverHex(body_[i + 2]);
-                body_[i + 2] = num % 10 + '0';
-                body_[i + 1] = num / 10 + '0';
-                i += 2;
-                break;
-            case '&':
-                value = body_.substr(j, i - j);
-                j = i + 1;
-                post_[key] = value;
-                LOG_DEBUG("%s = %s", key.c_str(), value.c_str());
-                break;
-            default :  
-                break;
+    const char* p = body_.data();
+    const char* end = p + body_.size();
+    while (p < end) {
+        const char* amp = static_cast<const char*>(memchr(p, '&', end - p));
+        if (!amp) { amp = end; }
+        const char* eq = static_cast<const char*>(memchr(p, '=', amp - p));
+        Field f;
+        f.name = Decode_(p, eq ? eq : amp);
+        f.value = Decode_(eq ? eq + 1 : amp, amp);
+        if (f.name.len > 0) {
+            post_.push_back(f);
+            LOG_DEBUG("%s = %s", string(arena_.Data(f.name), f.name.len).c_str(),     // arena_ 中的字段没有结尾的 '\0'
+                      string(arena_.Data(f.value), f.value.len).c_str());
         }
+        p = amp + 1;
     }
-    assert( j <= i);
-    if (post_.count(key) == 0 && j < i) {
-        value = body_.substr(j, i - j);
-        post_[key] = value;
+}
+
+Arena::Span HttpRequest::Decode_(const char* begin, const char* end) {     // '+' 为空格，%XX 为一个字节，原地解码
+    Arena::Span s = arena_.Append(begin, end - begin);
+    char* d = arena_.Data(s);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < s.len; i++) {
+        char ch = d[i];
+        if (ch == '+') {
+            ch = ' ';
+        }
+        else if (ch == '%' && i + 2 < s.len && ConverHex(d[i + 1]) >= 0 && ConverHex(d[i + 2]) >= 0) {
+            ch = static_cast<char>(ConverHex(d[i + 1]) * 16 + ConverHex(d[i + 2]));
+            i += 2;
+        }
+        d[n++] = ch;
     }
+    s.len = n;
+    return s;
 }
 
-bool HttpRequest::UserVerify(const string& name, const string& pwd, bool isLogin) {
+bool HttpRequest::UserVerify(const string& name, const string& pwd, bool isLogin, int fd) {
     if (name == "" || pwd == "") { return false; }
     LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
+    TRACE_SCOPE(Trace::MYSQL, fd);
     MYSQL* sql;
-    SqlConnRAII(&sql, SqlConnPool::Instance());
+    SqlConnRAII sqlRAII(&sql, SqlConnPool::Instance());    // 具名对象，函数返回时才归还连接
     assert(sql);
 
     bool flag = false;
@@ -225,7 +266,6 @@ bool HttpRequest::UserVerify(const string& name, const string& pwd, bool isLogin
         }
         flag = true;
     }
-    SqlConnPool::Instance()->FreeConn(sql);
     LOG_DEBUG("UserVerify success!!");
     return flag;
 }
@@ -238,26 +278,25 @@ std::string& HttpRequest::path() {
     return path_;
 }
 
-std::string HttpRequest::method() const {
+const std::string& HttpRequest::method() const {
     return method_;
 }
 
-std::string HttpRequest::version() const {
+const std::string& HttpRequest::version() const {
     return version_;
 }
 
 std::string HttpRequest::GetPost(const std::string& key) const {
     assert(key != "");
-    if (post_.count(key) == 1) {
-        return post_.find(key)->second;
-    }
-    return "";
+    return GetPost(key.c_str());
 }
 
-std::string HttpRequest::GetPost(const char* key) const {
+std::string HttpRequest::GetPost(const char* key) const {     // 同名字段以最后一个为准
     assert(key != nullptr);
-    if (post_.count(key) == 1) {
-        return post_.find(key)->second;
+    size_t len = strlen(key);
+    for (size_t i = post_.size(); i > 0; i--) {
+        const Field& f = post_[i - 1];
+        if (arena_.Equal(f.name, key, len)) { return std::string(arena_.Data(f.value), f.value.len); }
     }
     return "";
-}
\ No newline at end of file
+}
@@ -1,17 +1,20 @@
 #ifndef HTTP_REQUEST_H
 #define HTTP_REQUEST_H
 
-#include <unordered_map>
-#include <unordered_set>
 #include <string>
-#include <regex>
+#include <vector>
 #include <errno.h>
+#include <string.h>
+#include <strings.h>
 #include <mysql/mysql.h>
 
 #include "../buffer/buffer.h"
+#include "../buffer/arena.h"
 #include "../log/log.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/sqlconnRAII.h"
+#include "../trace/trace.h"
+#include "knownheader.h"
 
 class HttpRequest {
 public:
@@ -33,41 +36,65 @@ public:
         CLOSED_CONNECTION,
     };
 
-    HttpRequest() { Init();}
+    static const size_t MAX_HEAD = 16 * 1024;     // 请求行加头部的上限
+    static const size_t MAX_BODY = 1024 * 1024;   // Content-Length 的上限
+
+    HttpRequest() : present_(0), connFd_(-1) { Init();}
     ~HttpRequest() = default;
 
     void Init();
+    // 请求不合法时返回 false；返回 true 但 IsFinished() 为假表示还要等更多数据，缓冲区中的字节不动
     bool parse(Buffer& buff);
+    bool IsFinished() const { return state_ == FINISH; }
+    PARSE_STATE State() const { return state_; }    // 请求头完整、请求体未到齐时为 BODY
+
+    // HTTP/2 流：请求行和头部已由 HPACK 解出，只做路径映射和表单处理
+    void Assign(const std::string& method, const std::string& path,
+                const std::string& contentType, const std::string& body);
 
     std::string path() const;
     std::string& path();
-    std::string method() const;
-    std::string version() const;
+    const std::string& method() const;
+    const std::string& version() const;
     std::string GetPost(const std::string& key) const;// 获取 POST 请求中的数据
     std::string GetPost(const char* key) const;
+    std::string GetHeader(const char* key) const;     // 不区分大小写，不存在时为空
+    const std::string& Header(KnownHeader::ID id) const { return known_[id]; }  // 常见头按编号取，不存在时为空
 
     bool IsKeepAlive() const;   // 检查是否保持连接
+    bool IsForm() const;        // 请求体为 application/x-www-form-urlencoded
+    int ConnFd() const { return connFd_; }      // 所属连接的描述符，作为追踪事件的 id，Init 不清除
+    void SetConnFd(int fd) { connFd_ = fd; }
+                                    // 用户验证：登录时核对密码，注册时插入新用户；fd 为连接描述符，只用于追踪
+    static bool UserVerify(const std::string& name, const std::string& pwd, bool isLogin, int fd = -1);
 
 private:
                                     //用于解析 HTTP 请求的不同部分
-    bool ParseRequestLine_(const std::string& line);
-    void ParseHeader_(const std::string& line);
-    void ParseBody_(const std::string& line);
-                                    //用于进一步解析请求路径和请求正文
-    void ParsePath_();
+    bool ParseRequestLine_(const char* begin, const char* end);
+    bool ParseHeader_(const char* line, const char* end);
+    bool Fail_(Buffer& buff);
+    void SetHeader_(const char* name, size_t nameLen, const char* value, size_t valueLen);
+                                    //用于进一步解析请求正文
     void ParsePost_();
     void ParseFromUrlencode_();
-                                    // 静态函数，用于用户验证
-    static bool UserVerify(const std::string& name, const std::string& pwd, bool isLogin);
+    Arena::Span Decode_(const char* begin, const char* end);
+
+    struct Field {                  // 名字和值都在 arena_ 中
+        Arena::Span name;
+        Arena::Span value;
+    };
                                     //用于存储 HTTP 请求的状态和组成部分
     PARSE_STATE state_;
 
     std::string method_, path_, version_, body_;
-    std::unordered_map<std::string, std::string> header_;
-    std::unordered_map<std::string, std::string> post_;
+    std::string known_[KnownHeader::COUNT];  // 常见头的值，按编号存放，Init 时只清空出现过的
+    uint32_t present_;                       // 出现过的常见头
+    static_assert(KnownHeader::COUNT <= 32, "present_ holds one bit per known header");
+    std::vector<Field> other_;               // 其余的头
+    std::vector<Field> post_;                // 解码后的表单字段，按出现顺序
+    Arena arena_;                            // 本次请求的变长字段，Init 时复位，容量保留
+    int connFd_;
 
-    static const std::unordered_set<std::string> DEFAULT_HTML;
-    static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;
     static int ConverHex(char ch);
 };
 
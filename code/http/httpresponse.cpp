@@ -2,46 +2,52 @@
 
 using namespace std;
 
-const unordered_map<string, string> HttpResponse::SUFFIX_TYPE = {
-    { ".html",  "text/html" },
-    { ".xml",   "text/xml" },
-    { ".xhtml", "application/xhtml+xml" },
-    { ".txt",   "text/plain" },
-    { ".rtf",   "application/rtf" },
-    { ".pdf",   "application/pdf" },
-    { ".word",  "application/nsword" },
-    { ".png",   "image/png" },
-    { ".gif",   "image/gif" },
-    { ".jpg",   "image/jpeg" },
-    { ".jpeg",  "image/jpeg" },
-    { ".au",    "audio/basic" },
-    { ".mpeg",  "video/mpeg" },
-    { ".mpg",   "video/mpeg" },
-    { ".avi",   "video/x-msvideo" },
-    { ".gz",    "application/x-gzip" },
-    { ".tar",   "application/x-tar" },
-    { ".css",   "text/css "},
-    { ".js",    "text/javascript "},
-};
-
-const unordered_map<int, string> HttpResponse::CODE_STATUS = {  // 定义静态成员：HTTP 状态码到描述的映射
-    { 200, "OK" },
-    { 400, "Bad Request" },
-    { 403, "Forbidden" },
-    { 404, "Not Found" },
-};
-
-const unordered_map<int, string> HttpResponse::CODE_PATH = {    // 定义静态成员：HTTP 状态码到错误页面路径的映射
-    { 400, "/400.html" },
-    { 403, "/403.html" },
-    { 404, "/404.html" },
-};
+constexpr HttpResponse::Mime HttpResponse::MIME[];
+constexpr HttpResponse::Status HttpResponse::STATUS[];
+constexpr size_t HttpResponse::MIME_NUM;
+constexpr size_t HttpResponse::STATUS_NUM;
+constexpr PerfectHash<64> HttpResponse::MIME_HASH;
+constexpr DirectIndex<600> HttpResponse::STATUS_INDEX;
+vector<string> HttpResponse::templates_ = HttpResponse::BuildTemplates_(0);
+
+vector<string> HttpResponse::BuildTemplates_(int keepAliveSec) {
+    vector<string> templates(STATUS_NUM * MIME_NUM * 2);
+    for (size_t s = 0; s < STATUS_NUM; s++) {
+        for (size_t m = 0; m < MIME_NUM; m++) {
+            for (int keepAlive = 0; keepAlive < 2; keepAlive++) {
+                string& t = templates[(s * MIME_NUM + m) * 2 + keepAlive];
+                t = "HTTP/1.1 " + to_string(STATUS[s].code) + " " + STATUS[s].text + "\r\n";
+                t += StatusHeaders_(keepAlive, keepAliveSec);
+                t += "Content-Type: ";
+                t += MIME[m].type;
+                t += "\r\nDate: ";
+            }
+        }
+    }
+    return templates;
+}
+
+string HttpResponse::StatusHeaders_(bool keepAlive, int keepAliveSec) {
+    if (!keepAlive) { return "Connection: close\r\n"; }
+    string headers = "Connection: keep-alive\r\n";
+    if (keepAliveSec > 0) {     // 告知客户端服务器实际的空闲超时
+        headers += "Keep-Alive: timeout=" + to_string(keepAliveSec) + "\r\n";
+    }
+    return headers;
+}
+
+void HttpResponse::SetKeepAliveTimeout(int sec) {
+    templates_ = BuildTemplates_(sec);
+}
 
 HttpResponse::HttpResponse() {
     code_ = -1;
-    path_ = srcDir_ = "";
+    path_ = "";
+    srcDir_ = nullptr;
     isKeepAlive_ = false;
+    contentType_ = nullptr;
     mmFile_ = nullptr;
+    fd_ = -1;
     mmFileStat_ = { 0 };
 }
 
@@ -49,31 +55,60 @@ HttpResponse::~HttpResponse() {
     UnmapFile();    // 析构函数中取消文件映射
 }
 
-void HttpResponse::Init(const string& srcDir, string& path, bool isKeepAlive, int code) {
-    assert(srcDir != "");
+void HttpResponse::Init(const char* srcDir, const string& path, bool isKeepAlive, int code) {
+    assert(srcDir && *srcDir);
     if (mmFile_) { UnmapFile(); }   // 如果已有映射文件，先取消映射
     code_ = code;                    // 设置状态码
     isKeepAlive_ = isKeepAlive;
-    path_ = path;
+    contentType_ = nullptr;
+    path_.assign(path);             // 复用容量，长连接上不再分配
     srcDir_ = srcDir;
     mmFile_ = nullptr;
+    fd_ = -1;
     mmFileStat_ = { 0 };
 }
 
 void HttpResponse::MakeResponse(Buffer& buff) { // 构建 HTTP 响应
-    if (stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) {
-        code_ = 404;                // 如果文件不存在或路径是目录，设置状态码为 404
+    Locate_();
+    AddConten_(buff);       // 映射文件并写入响应头
+}
+
+void HttpResponse::MakeBody(string& content) {
+    Locate_();
+    if (!MapFile_()) {
+        char body[256];
+        content.assign(body, ErrorBody_(body, sizeof(body), "File NotFound!"));
+        contentType_ = "text/html";
     }
-    else if (!(mmFileStat_.st_mode & S_IROTH)) {    // 如果文件没有读权限，设置状态码为 403
-        code_ = 403;
+}
+
+const char* HttpResponse::ContentType() const {
+    return contentType_ ? contentType_ : MIME[MimeIndex_()].type;
+}
+
+void HttpResponse::Locate_() {
+    if (code_ < 400) {              // 已经确定的错误（解析失败、路由 404/405），直接换成错误页面
+        int err = FileCache::Lookup(srcDir_, path_.c_str(), path_.size(), &fd_, &mmFileStat_);
+        if (err == EACCES || (err == 0 && !(mmFileStat_.st_mode & S_IROTH))) {
+            code_ = 403;            // 如果文件没有读权限，设置状态码为 403
+        }
+        else if (err) {
+            code_ = 404;            // 文件不存在、路径是目录或越出资源目录，设置状态码为 404
+        }
+        else if (code_ == -1) {
+            code_ = 200;
+        }
     }
-    else if (code_ == -1) {
+    ErrorHtml_();           // 生成错误页面
+}
+
+void HttpResponse::MakeResponse(Buffer& buff, const string& content, const char* contentType) {
+    if (code_ == -1) {
         code_ = 200;
     }
-    ErrorHtml_();           // 生成错误页面
-    AddStateLine_(buff);    // 添加状态行
-    AddHeader_(buff);       // 添加头部
-    AddConten_(buff);       // 添加内容
+    contentType_ = contentType;
+    AddHeaders_(buff, content.size());
+    buff.Append(content);
 }
 
 char* HttpResponse::File() {
@@ -81,56 +116,74 @@ char* HttpResponse::File() {
 }
 
 size_t HttpResponse::FileLen() const {
-    return  mmFileStat_.st_size;
+    return mmFile_ ? mmFileStat_.st_size : 0;
 }
 
-void HttpResponse::ErrorHtml_() {       // 根据状态码生成错误页面路径
-    if (CODE_PATH.count(code_) == 1) {
-        path_ = CODE_PATH.find(code_)->second;
-        stat((srcDir_ + path_).data(), &mmFileStat_);
-    }
+const HttpResponse::Status& HttpResponse::Status_() {   // 未知状态码按 400 处理
+    int i = STATUS_INDEX.Find(code_);
+    if (i >= 0) { return STATUS[i]; }
+    code_ = STATUS[0].code;
+    return STATUS[0];
 }
 
-void HttpResponse::AddStateLine_(Buffer& buff) {     // 添加 HTTP 响应状态行
-    string status;
-    if (CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
-    }
-    else {
-        code_ = 400;     // 默认设置状态码为 400
-        status = CODE_STATUS.find(code_)->second;
+void HttpResponse::ErrorHtml_() {       // 根据状态码生成错误页面路径
+    const Status& status = Status_();
+    if (status.page) {
+        path_ = status.page;
+        if (FileCache::Lookup(srcDir_, path_.c_str(), path_.size(), &fd_, &mmFileStat_) != 0) {
+            fd_ = -1;
+        }
     }
-    buff.Append("HTTP/1.1 " + to_string(code_) + " " + status + "\r\n");
 }
 
-void HttpResponse::AddHeader_(Buffer& buff) {        // 添加 HTTP 响应头部
-    buff.Append("Connection: ");
-    if (isKeepAlive_) {
-        buff.Append("keep-alive\r\n");
-        buff.Append("keep-alive: max=6, timeout=120\r\n");
+// 状态行和固定头部来自预先生成的模板，只补上 Date 和 Content-Length，不分配堆内存
+void HttpResponse::AddHeaders_(Buffer& buff, size_t contentLength) {
+    size_t s = &Status_() - STATUS;
+    if (contentType_) {                 // 指标等动态内容自带类型，没有对应模板
+        const string& t = templates_[(s * MIME_NUM) * 2 + isKeepAlive_];
+        size_t typeAt = t.find("Content-Type: ") + 14;
+        buff.Append(t.data(), typeAt);
+        buff.Append(contentType_, strlen(contentType_));
+        buff.Append("\r\nDate: ", 8);
     }
     else {
-        buff.Append("close\r\n");
+        const string& t = templates_[(s * MIME_NUM + MimeIndex_()) * 2 + isKeepAlive_];
+        buff.Append(t.data(), t.size());
     }
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
+    buff.Append(TimeCache::HttpDate(), TimeCache::HTTP_DATE_LEN);   // 每秒只格式化一次
+    char len[48] = "\r\nContent-Length: ";
+    char* end = len + 18;
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = '0' + contentLength % 10;
+        contentLength /= 10;
+    } while (contentLength);
+    while (n) { *end++ = digits[--n]; }
+    memcpy(end, "\r\n\r\n", 4);
+    buff.Append(len, end + 4 - len);
 }
 
 void HttpResponse::AddConten_(Buffer& buff) {
-    int srcFd = open((srcDir_ + path_).data(), O_RDONLY);
-    if (srcFd < 0) {
-        ErrorConten(buff, "File NotFound!");
+    if (!MapFile_()) {
+        ErrorConten(buff, "File NotFound!");    // 文件未找到错误处理
         return;
     }
+    AddHeaders_(buff, FileLen());
+}
 
-    LOG_DEBUG("file path %s", (srcDir_ + path_).data());
-    int* mmRet = (int*)mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if (*mmRet == -1) {
-        ErrorConten(buff, "File NotFound!");    // 文件未找到错误处理
-        return;
+bool HttpResponse::MapFile_() {          // fd_ 由 Locate_ 从 FileCache 取得，不在这里关闭
+    if (fd_ < 0) { return false; }
+
+    LOG_DEBUG("file path %s%s", srcDir_, path_.c_str());
+    if (mmFileStat_.st_size > 0) {      // 空文件不能 mmap
+        void* mmRet = mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (mmRet == MAP_FAILED) {
+            return false;
+        }
+        mmFile_ = static_cast<char*>(mmRet);     // 设置内存映射文件
     }
-    mmFile_ = (char*)mmRet;     // 设置内存映射文件
-    close(srcFd);               // 关闭文件描述符
-    buff.Append("Content-length: " + to_string(mmFileStat_.st_size) + "\r\n\r\n");
+    return true;
 }
 
 void HttpResponse::UnmapFile() {    // 取消文件映射
@@ -140,33 +193,26 @@ void HttpResponse::UnmapFile() {    // 取消文件映射
     }
 }
 
-string HttpResponse::GetFileType_() {   // 获取文件类型
-    string ::size_type idx = path_.find_last_of('.');
-    if (idx == string::npos) {
-        return "text/plain";    // 如果没有找到文件后缀，默认为纯文本
-    }
-    string suffix = path_.substr(idx);
-    if (SUFFIX_TYPE.count(suffix) == 1) {
-        return SUFFIX_TYPE.find(suffix)->second;
-    }
-    return "text/plain";
+size_t HttpResponse::MimeIndex_() const {  // 按后缀查找类型（不区分大小写），未知后缀为 text/plain
+    size_t dot = path_.find_last_of('.');
+    if (dot == string::npos) { return 0; }
+    int i = MIME_HASH.Find(MIME, path_.data() + dot, path_.size() - dot, MemberOf<Mime, const char*>{ &Mime::suffix });
+    return i < 0 ? 0 : i;
 }
 
-void HttpResponse::ErrorConten(Buffer& buff, string message) {  // 生成错误内容
-    string body;
-    string status;
-    body += "<html><title>Error</title>";
-    body += "<body bgcolor=\"ffffff\">";
-    if (CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
-    }
-    else {
-        status = "Bad Request"; // 默认状态描述
-    }
-    body += to_string(code_) + " : " + status + "\n";
-    body += "<p>" + message + "</p>";
-    body += "<hr><em>TinyWebServer</em></body></html>";
+void HttpResponse::ErrorConten(Buffer& buff, const char* message) {  // 生成错误内容
+    char body[256];
+    int len = ErrorBody_(body, sizeof(body), message);
+    contentType_ = "text/html";
+    AddHeaders_(buff, len);
+    buff.Append(body, len);
+}
 
-    buff.Append("Content-length: " + to_string(body.size())  + "\r\n\r\n");
-    buff.Append(body);
-}
\ No newline at end of file
+int HttpResponse::ErrorBody_(char* body, size_t size, const char* message) {
+    const Status& status = Status_();
+    int len = snprintf(body, size, "<html><title>Error</title><body bgcolor=\"ffffff\">%d : %s\n"
+                       "<p>%s</p><hr><em>TinyWebServer</em></body></html>", status.code, status.text, message);
+    if (len < 0) { len = 0; }
+    if (len >= static_cast<int>(size)) { len = size - 1; }
+    return len;
+}
@@ -1,7 +1,10 @@
 #ifndef HTTP_RESPONSE_H
 #define HTTP_RESPONSE_H
 
-#include <unordered_map>
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include <vector>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
@@ -9,38 +12,101 @@
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "../trace/trace.h"
+#include "phash.h"
+#include "filecache.h"
 
 class HttpResponse {
 public:
     HttpResponse();
     ~HttpResponse();
 
-    void Init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int code = -1);// 初始化 HttpResponse 对象
+    void Init(const char* srcDir, const std::string& path, bool isKeepAlive = false, int code = -1);// 初始化 HttpResponse 对象
     void MakeResponse(Buffer& buff);    // 构建 HTTP 响应内容
+    void MakeResponse(Buffer& buff, const std::string& content, const char* contentType);  // 以内存中的内容作为响应体
+    void MakeBody(std::string& content);    // HTTP/2 使用：只定位并映射文件，映射失败时 content 为错误页面，不生成 HTTP/1.1 头部
+    const char* ContentType() const;        // 响应体的类型
     void UnmapFile();        // 取消文件映射
     char* File();           // 获取文件数据
     size_t FileLen() const; // 获取文件长度
-    void ErrorConten(Buffer& buff, std::string message);    // 生成错误响应内容
+    void ErrorConten(Buffer& buff, const char* message);    // 生成错误响应内容
     int Code() const { return code_; }   // 获取 HTTP 状态码
+
+    static void SetKeepAliveTimeout(int sec);   // 按服务器的空闲超时重建模板中的 Keep-Alive 头，0 不发送
 private:
-    void AddStateLine_(Buffer& buff);   // 添加状态行
-    void AddHeader_(Buffer& buff);      // 添加头部
+    struct Mime {
+        const char* suffix;
+        const char* type;
+    };
+    struct Status {
+        int code;
+        const char* text;
+        const char* page;               // 错误页面，200 为空
+    };
+
+    void AddHeaders_(Buffer& buff, size_t contentLength);   // 模板 + Date + Content-Length
     void AddConten_(Buffer& buff);      // 添加内容
+    void Locate_();                     // 检查文件并确定状态码，错误时换成错误页面
+    bool MapFile_();                    // 映射 fd_，空文件不映射
+    int ErrorBody_(char* body, size_t size, const char* message);
     void ErrorHtml_();                  // 生成错误
-    std::string GetFileType_();         // 获取文件类型
+    const Status& Status_();            // 当前状态码的描述，未知状态码改为 400
+    size_t MimeIndex_() const;          // 按后缀取类型下标
+
+    static std::vector<std::string> BuildTemplates_(int keepAliveSec);
+    static std::string StatusHeaders_(bool keepAlive, int keepAliveSec);
 
     int code_;                          // HTTP状态码
     bool isKeepAlive_;                  // 是否保持连接
+    const char* contentType_;           // 非空时覆盖按后缀推断的类型
 
     std::string path_;                  // 请求路径
-    std::string srcDir_;                // 源文件目录
+    const char* srcDir_;                // 源文件目录，由 FileCache 固定为目录描述符
 
     char* mmFile_;                      // 内存映射的文件数据
+    int fd_;                            // Locate_ 找到的文件，描述符归 FileCache 所有
     struct stat mmFileStat_;            // 文件状态信息
 
-    static const std::unordered_map<std::string ,std::string> SUFFIX_TYPE;   // 静态映射：文件后缀类型
-    static const std::unordered_map<int, std::string> CODE_STATUS;           // 静态映射：HTTP状态码对应的状态
-    static const std::unordered_map<int, std::string> CODE_PATH;             // 静态映射：HTTP状态码对应的路径
+    static constexpr Mime MIME[] = {    // 文件后缀到类型，第一项为无后缀或未知后缀时的类型
+        { "",       "text/plain" },
+        { ".html",  "text/html" },
+        { ".xml",   "text/xml" },
+        { ".xhtml", "application/xhtml+xml" },
+        { ".txt",   "text/plain" },
+        { ".rtf",   "application/rtf" },
+        { ".pdf",   "application/pdf" },
+        { ".word",  "application/nsword" },
+        { ".png",   "image/png" },
+        { ".gif",   "image/gif" },
+        { ".jpg",   "image/jpeg" },
+        { ".jpeg",  "image/jpeg" },
+        { ".au",    "audio/basic" },
+        { ".mpeg",  "video/mpeg" },
+        { ".mpg",   "video/mpeg" },
+        { ".avi",   "video/x-msvideo" },
+        { ".gz",    "application/x-gzip" },
+        { ".tar",   "application/x-tar" },
+        { ".css",   "text/css" },
+        { ".js",    "text/javascript" },
+    };
+    static constexpr Status STATUS[] = {    // 状态码、描述和错误页面，第一项为未知状态码时使用的 400
+        { 400, "Bad Request",   "/400.html" },
+        { 200, "OK",            nullptr },
+        { 403, "Forbidden",     "/403.html" },
+        { 404, "Not Found",     "/404.html" },
+        { 405, "Method Not Allowed", "/405.html" },
+        { 429, "Too Many Requests", nullptr },     // 只以内存内容回复
+    };
+    static constexpr size_t MIME_NUM = sizeof(MIME) / sizeof(MIME[0]);
+    static constexpr size_t STATUS_NUM = sizeof(STATUS) / sizeof(STATUS[0]);
+
+    // 后缀和状态码的查找表在编译期生成，每次响应不再逐项比较
+    static constexpr PerfectHash<64> MIME_HASH =
+        PerfectHash<64>::Make(MIME, MemberOf<Mime, const char*>{ &Mime::suffix });
+    static constexpr DirectIndex<600> STATUS_INDEX =
+        DirectIndex<600>::Make(STATUS, MemberOf<Status, int>{ &Status::code });
+    static_assert(MIME_HASH.seed != 0, "no perfect hash seed for MIME suffixes");
+    static std::vector<std::string> templates_;  // [状态][类型][是否长连接] 的响应头前缀，到 "Date: " 为止
 };
 
 #endif //HTTP_RESPONSE_H
\ No newline at end of file
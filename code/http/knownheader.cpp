@@ -0,0 +1,4 @@
+#include "knownheader.h"
+
+constexpr const char* KnownHeader::NAMES[KnownHeader::COUNT];
+constexpr PerfectHash<128> KnownHeader::TABLE;
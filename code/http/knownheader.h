@@ -0,0 +1,60 @@
+#ifndef KNOWN_HEADER_H
+#define KNOWN_HEADER_H
+
+#include "phash.h"
+
+/*
+ * 常见请求/响应头的编号：名字不区分大小写，经编译期完美哈希一次定位。
+ * HttpRequest 按编号存放这些头的值，反向代理按编号识别逐跳头；其余的头退回小的线性表。
+ */
+class KnownHeader {
+public:
+    enum ID {
+        HOST,
+        CONNECTION,
+        KEEP_ALIVE,
+        PROXY_CONNECTION,
+        TE,
+        UPGRADE,
+        TRANSFER_ENCODING,
+        CONTENT_LENGTH,
+        CONTENT_TYPE,
+        ACCEPT,
+        ACCEPT_ENCODING,
+        ACCEPT_LANGUAGE,
+        USER_AGENT,
+        REFERER,
+        COOKIE,
+        AUTHORIZATION,
+        CACHE_CONTROL,
+        IF_MODIFIED_SINCE,
+        IF_NONE_MATCH,
+        RANGE,
+        ORIGIN,
+        EXPECT,
+        X_FORWARDED_FOR,
+        HTTP2_SETTINGS,
+        SEC_WEBSOCKET_KEY,
+        SEC_WEBSOCKET_VERSION,
+        COUNT,                          // 不在表中
+    };
+
+    static constexpr const char* NAMES[COUNT] = {
+        "Host", "Connection", "Keep-Alive", "Proxy-Connection", "TE", "Upgrade",
+        "Transfer-Encoding", "Content-Length", "Content-Type", "Accept", "Accept-Encoding",
+        "Accept-Language", "User-Agent", "Referer", "Cookie", "Authorization", "Cache-Control",
+        "If-Modified-Since", "If-None-Match", "Range", "Origin", "Expect", "X-Forwarded-For",
+        "HTTP2-Settings", "Sec-WebSocket-Key", "Sec-WebSocket-Version",
+    };
+
+    static ID Find(const char* name, size_t len) {
+        int i = TABLE.Find(NAMES, name, len);
+        return i < 0 ? COUNT : static_cast<ID>(i);
+    }
+
+private:
+    static constexpr PerfectHash<128> TABLE = PerfectHash<128>::Make(NAMES);
+    static_assert(TABLE.seed != 0, "no perfect hash seed for known headers");
+};
+
+#endif //KNOWN_HEADER_H
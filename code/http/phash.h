@@ -0,0 +1,102 @@
+#ifndef PHASH_H
+#define PHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, typename V>
+struct MemberOf {                       // 以结构体的一个成员作为键
+    V T::* member;
+    constexpr const V& operator()(const T& item) const { return item.*member; }
+};
+
+/*
+ * 编译期完美哈希：对一组固定的键（不区分大小写）在编译期搜索种子，使每个键落在不同的槽位。
+ * 查找时算一次哈希、取一个槽位，再核对一次键，不分配内存也不需要探测。
+ * SIZE 为 2 的幂，取键数的 4 倍左右时几十个种子内即可找到；找不到时 seed 为 0，由 static_assert 拦下。
+ */
+template <size_t SIZE>
+struct PerfectHash {
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+
+    struct Self {                       // 键就是数组元素本身
+        constexpr const char* operator()(const char* key) const { return key; }
+    };
+
+    uint32_t seed;
+    int16_t slot[SIZE];                 // 键的下标，-1 表示空槽
+
+    static constexpr char Lower(char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + 32) : c; }
+
+    static constexpr uint32_t Hash(const char* s, size_t len, uint32_t seed) {    // 带种子的 FNV-1a
+        uint32_t h = 2166136261u ^ seed;
+        for (size_t i = 0; i < len; i++) {
+            h = (h ^ static_cast<uint8_t>(Lower(s[i]))) * 16777619u;
+        }
+        return h ^ (h >> 15);
+    }
+
+    static constexpr size_t Length(const char* s) {
+        size_t n = 0;
+        while (s[n]) { n++; }
+        return n;
+    }
+
+    static bool Equal(const char* key, const char* s, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            if (key[i] == '\0' || Lower(key[i]) != Lower(s[i])) { return false; }
+        }
+        return key[len] == '\0';
+    }
+
+    // 返回键的下标，不在集合中时为 -1
+    template <typename T, size_t N, typename Get = Self>
+    int Find(const T (&items)[N], const char* s, size_t len, Get get = Get()) const {
+        int i = slot[Hash(s, len, seed) & (SIZE - 1)];
+        if (i < 0 || !Equal(get(items[i]), s, len)) { return -1; }
+        return i;
+    }
+
+    // 空串不参与（如表示默认项的第一项）
+    template <typename T, size_t N, typename Get = Self>
+    static constexpr PerfectHash Make(const T (&items)[N], Get get = Get()) {
+        PerfectHash t{ 0, {} };
+        for (uint32_t seed = 1; seed < 100000; seed++) {
+            for (size_t i = 0; i < SIZE; i++) { t.slot[i] = -1; }
+            bool ok = true;
+            for (size_t k = 0; k < N && ok; k++) {
+                size_t len = Length(get(items[k]));
+                if (len == 0) { continue; }
+                size_t at = Hash(get(items[k]), len, seed) & (SIZE - 1);
+                if (t.slot[at] >= 0) { ok = false; }
+                t.slot[at] = static_cast<int16_t>(k);
+            }
+            if (ok) {
+                t.seed = seed;
+                return t;
+            }
+        }
+        t.seed = 0;
+        return t;
+    }
+};
+
+// 小整数键（如状态码）的直接下标表，同样在编译期生成
+template <size_t SIZE>
+struct DirectIndex {
+    int16_t slot[SIZE];                 // 键对应的下标，-1 表示不在表中
+
+    int Find(int key) const {
+        return key >= 0 && key < static_cast<int>(SIZE) ? slot[key] : -1;
+    }
+
+    template <typename T, size_t N, typename Get>
+    static constexpr DirectIndex Make(const T (&items)[N], Get get) {
+        DirectIndex t{ {} };
+        for (size_t i = 0; i < SIZE; i++) { t.slot[i] = -1; }
+        for (size_t k = 0; k < N; k++) { t.slot[get(items[k])] = static_cast<int16_t>(k); }
+        return t;
+    }
+};
+
+#endif //PHASH_H
@@ -0,0 +1,896 @@
+#include "proxy.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+
+int Upstream::keepAlive = 32;
+const int64_t Upstream::IDLE_MS;
+const int64_t Upstream::DOWN_MS;
+const size_t ProxySession::MAX_HEAD;
+const size_t ProxySession::PIPE_SIZE;
+const size_t ProxySession::COPY_CHUNK;
+const size_t ProxySession::RELAY_BUDGET;
+vector<unique_ptr<Proxy::Route>> Proxy::routes_;
+
+static int64_t NowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static bool HasToken(const char* value, size_t len, const char* token) {   // Connection 等逗号分隔的取值
+    size_t n = strlen(token);
+    for (size_t i = 0; i + n <= len; i++) {
+        if (strncasecmp(value + i, token, n) == 0) { return true; }
+    }
+    return false;
+}
+
+// Content-Length 只接受纯数字（去掉两侧空白后），否则代理与后端对消息结尾的判断可能不一致
+static bool ParseLength(const char* value, const char* end, uint64_t* length) {
+    static const uint64_t MAX_LENGTH = 1ull << 40;
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) { end--; }
+    if (value == end) { return false; }
+    uint64_t v = 0;
+    for (const char* p = value; p < end; p++) {
+        if (*p < '0' || *p > '9') { return false; }
+        v = v * 10 + (*p - '0');
+        if (v > MAX_LENGTH) { return false; }
+    }
+    *length = v;
+    return true;
+}
+
+static bool BadName(const char* line, size_t nameLen) {    // 名字为空或冒号前有空白（RFC 7230 3.2.4）
+    return nameLen == 0 || line[nameLen - 1] == ' ' || line[nameLen - 1] == '\t';
+}
+
+// 空闲管道的全局池：管道只在一次转发期间借用，长连接空闲时不占描述符
+static mutex pipeMtx;
+static vector<pair<int, int>> pipePool;
+static const size_t PIPE_POOL_MAX = 64;
+
+Upstream::Upstream(const sockaddr_in& addr, const string& name)
+    : addr_(addr), name_(name), outstanding_(0), downUntil_(0) {}
+
+Upstream::~Upstream() {
+    for (auto& item : idle_) { close(item.first); }
+}
+
+size_t Upstream::IdleCount() {
+    lock_guard<mutex> locker(mtx_);
+    return idle_.size();
+}
+
+int Upstream::Acquire(bool fresh, bool* reused, bool* connecting) {
+    *reused = *connecting = false;
+    if (!fresh) {
+        int64_t now = NowMs();
+        lock_guard<mutex> locker(mtx_);
+        while (!idle_.empty()) {        // 后进先出，最近用过的连接最不可能已被后端关闭
+            pair<int, int64_t> item = idle_.back();
+            idle_.pop_back();
+            char byte;                  // 没有残留数据也没有 FIN 才复用
+            if (now - item.second < IDLE_MS && recv(item.first, &byte, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && errno == EAGAIN) {
+                outstanding_++;
+                *reused = true;
+                return item.first;
+            }
+            close(item.first);
+        }
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) { return -1; }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    int ret = connect(fd, reinterpret_cast<const sockaddr*>(&addr_), sizeof(addr_));
+    if (ret < 0 && errno != EINPROGRESS) {
+        LOG_WARN("Proxy: connect %s error: %d", name_.c_str(), errno);
+        close(fd);
+        return -1;
+    }
+    *connecting = ret < 0;
+    outstanding_++;
+    Metrics::Add(Metrics::PROXY_CONNECTS);
+    return fd;
+}
+
+void Upstream::Release(int fd, bool reuse) {
+    outstanding_--;
+    if (reuse) {
+        int64_t now = NowMs();
+        lock_guard<mutex> locker(mtx_);
+        while (!idle_.empty() && now - idle_.front().second >= IDLE_MS) {   // 顺便关掉池底过期的连接
+            close(idle_.front().first);
+            idle_.erase(idle_.begin());
+        }
+        if (static_cast<int>(idle_.size()) < keepAlive) {
+            idle_.emplace_back(fd, now);    // 仍登记在上次使用它的反应堆的 epoll 中（已失效），复用时重新挂上
+            return;
+        }
+    }
+    close(fd);
+}
+
+void Upstream::MarkDown(int64_t now) {
+    downUntil_.store(now + DOWN_MS, std::memory_order_relaxed);
+}
+
+Upstream* Proxy::Route::Pick(int64_t now) {
+    size_t n = upstreams.size();
+    size_t start = next.fetch_add(1, std::memory_order_relaxed) % n;
+    Upstream* best = nullptr;
+    for (int pass = 0; pass < 2 && !best; pass++) {     // 第二轮：都被标记为不可用时仍然要选一个
+        for (size_t i = 0; i < n; i++) {
+            Upstream* u = upstreams[(start + i) % n].get();
+            if (pass == 0 && u->Down(now)) { continue; }
+            if (!best || u->Outstanding() < best->Outstanding()) { best = u; }
+        }
+    }
+    return best;
+}
+
+bool Proxy::Parse_(const string& spec, vector<unique_ptr<Route>>* routes, string* err) {
+    size_t pos = 0;
+    while (true) {
+        pos = spec.find_first_not_of(" \t;", pos);
+        if (pos == string::npos) { break; }
+        size_t end = spec.find_first_of(" \t;", pos);
+        string item = spec.substr(pos, end == string::npos ? string::npos : end - pos);
+        pos = end;
+        size_t eq = item.find('=');
+        if (eq == string::npos || eq == 0 || item[0] != '/') {
+            *err = "route '" + item + "' is not like /prefix=host:port,host:port";
+            return false;
+        }
+        unique_ptr<Route> route(new Route());
+        route->prefix = item.substr(0, eq);
+        route->next = 0;
+        size_t p = eq + 1;
+        while (p <= item.size()) {
+            size_t comma = item.find(',', p);
+            string target = item.substr(p, comma == string::npos ? string::npos : comma - p);
+            p = comma == string::npos ? item.size() + 1 : comma + 1;
+            size_t colon = target.rfind(':');
+            int port = colon == string::npos ? 0 : atoi(target.c_str() + colon + 1);
+            if (colon == string::npos || colon == 0 || port <= 0 || port > 65535) {
+                *err = "upstream '" + target + "' is not host:port";
+                return false;
+            }
+            addrinfo hints, *res = nullptr;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_STREAM;
+            if (getaddrinfo(target.substr(0, colon).c_str(), nullptr, &hints, &res) != 0 || !res) {
+                *err = "upstream '" + target + "' does not resolve";
+                return false;
+            }
+            sockaddr_in addr = *reinterpret_cast<sockaddr_in*>(res->ai_addr);
+            freeaddrinfo(res);
+            addr.sin_port = htons(port);
+            route->upstreams.emplace_back(new Upstream(addr, target));
+        }
+        routes->push_back(move(route));
+    }
+    sort(routes->begin(), routes->end(), [](const unique_ptr<Route>& a, const unique_ptr<Route>& b) {
+        return a->prefix.size() > b->prefix.size();     // 最长前缀优先
+    });
+    return true;
+}
+
+bool Proxy::Parse(const string& spec, string* err) {
+    vector<unique_ptr<Route>> routes;
+    return Parse_(spec, &routes, err);
+}
+
+bool Proxy::Init(const string& spec) {
+    string err;
+    routes_.clear();
+    if (!Parse_(spec, &routes_, &err)) {
+        LOG_ERROR("Proxy: %s", err.c_str());
+        routes_.clear();
+        return false;
+    }
+    for (auto& route : routes_) {
+        string names;
+        for (auto& u : route->upstreams) { names += (names.empty() ? "" : ",") + u->Name(); }
+        LOG_INFO("Proxy: %s -> %s", route->prefix.c_str(), names.c_str());
+    }
+    return true;
+}
+
+bool Proxy::Enabled() {
+    return !routes_.empty();
+}
+
+Proxy::Route* Proxy::Match(const char* target, size_t len) {
+    for (auto& route : routes_) {
+        const string& prefix = route->prefix;
+        if (len >= prefix.size() && memcmp(target, prefix.data(), prefix.size()) == 0) { return route.get(); }
+    }
+    return nullptr;
+}
+
+size_t Proxy::IdleCount() {
+    size_t n = 0;
+    for (auto& route : routes_) {
+        for (auto& u : route->upstreams) { n += u->IdleCount(); }
+    }
+    return n;
+}
+
+ProxySession::DETECT ProxySession::Detect(const Buffer& in) {
+    const char* begin = in.Peek();
+    size_t n = min(in.ReadableBytes(), MAX_HEAD);
+    if (n == 0) { return NOT_PROXY; }
+    const char* lineEnd = static_cast<const char*>(memmem(begin, n, "\r\n", 2));
+    if (!lineEnd) { return n < MAX_HEAD ? NEED_MORE : NOT_PROXY; }     // 请求行还不完整，不知道去哪里
+    const char* sp1 = static_cast<const char*>(memchr(begin, ' ', lineEnd - begin));
+    const char* sp2 = sp1 ? static_cast<const char*>(memchr(sp1 + 1, ' ', lineEnd - sp1 - 1)) : nullptr;
+    if (!sp2 || !Proxy::Match(sp1 + 1, sp2 - sp1 - 1)) { return NOT_PROXY; }
+    if (!memmem(begin, n, "\r\n\r\n", 4) && n < MAX_HEAD) { return NEED_MORE; }    // 过长的请求头由 Start 回复 431
+    return MATCHED;
+}
+
+ProxySession::ProxySession()
+    : state_(IDLE), route_(nullptr), upstream_(nullptr), upFd_(-1), reused_(false), tries_(0),
+      clientFd_(-1), tls_(nullptr), splice_(false), headRequest_(false), clientKeepAlive_(false),
+      requestOff_(0), bodyLeft_(0), bodySent_(false), responded_(false), outOff_(0), left_(0),
+      chunked_(false), chunk_(CHUNK_SIZE), chunkLeft_(0), lineLen_(0), inPipe_(0),
+      status_(0), keepAlive_(false), upReuse_(false), sent_(0), progress_(0) {
+    pipe_[0] = pipe_[1] = -1;
+}
+
+ProxySession::~ProxySession() {
+    Abort();
+}
+
+void ProxySession::Start(Buffer& in, int clientFd, TlsSession* tls, const in_addr& ip, bool draining, bool limited) {
+    clientFd_ = clientFd;
+    tls_ = tls;
+    splice_ = !tls->Active() || tls->KtlsSend();
+    route_ = nullptr;
+    upstream_ = nullptr;
+    tries_ = 0;
+    bodySent_ = responded_ = false;
+    status_ = 0;
+    keepAlive_ = upReuse_ = false;
+    sent_ = 0;
+    out_.clear();
+    outOff_ = 0;
+    left_ = 0;
+    chunked_ = false;
+    in_.Retrieve(in_.ReadableBytes());
+    Metrics::Add(Metrics::PROXY_REQUESTS);
+    if (!ParseRequest_(in, ip)) { return; }
+    if (limited) {              // 请求行已解析，访问日志能记下被拒的请求
+        Reply_(429);
+        return;
+    }
+    clientKeepAlive_ = clientKeepAlive_ && !draining;
+    route_ = Proxy::Match(path_.data(), path_.size());
+    if (!route_) {              // Detect 已匹配过，只有配置错误时才会走到这里
+        Reply_(502);
+        return;
+    }
+    Dispatch_(false);
+}
+
+// 请求行原样转发（版本改为 HTTP/1.1），去掉逐跳头部，后端连接一律长连接；
+// 分块编码的请求体需要逐块解析才能找到请求结尾，不支持，回复 411
+bool ProxySession::ParseRequest_(Buffer& in, const in_addr& ip) {
+    const char* begin = in.Peek();
+    size_t n = min(in.ReadableBytes(), MAX_HEAD);
+    const char* end = static_cast<const char*>(memmem(begin, n, "\r\n\r\n", 4));
+    const char* lineEnd = static_cast<const char*>(memmem(begin, n, "\r\n", 2));
+    const char* sp1 = lineEnd ? static_cast<const char*>(memchr(begin, ' ', lineEnd - begin)) : nullptr;
+    const char* sp2 = sp1 ? static_cast<const char*>(memchr(sp1 + 1, ' ', lineEnd - sp1 - 1)) : nullptr;
+    method_.clear();
+    path_.clear();
+    version_.clear();
+    headRequest_ = false;
+    clientKeepAlive_ = false;
+    if (sp2) {
+        method_.assign(begin, sp1);
+        path_.assign(sp1 + 1, sp2);
+        if (lineEnd - sp2 == 9 && memcmp(sp2 + 1, "HTTP/1.", 7) == 0) {
+            version_.assign(sp2 + 6, lineEnd);  // 与 HttpRequest::version() 一致，只存 "1.x"
+        }
+    }
+    if (!end) {
+        Reply_(431);
+        return false;
+    }
+    if (version_.empty()) {
+        Reply_(400);
+        return false;
+    }
+    headRequest_ = method_ == "HEAD";
+    bool connClose = false, connKeep = false, chunked = false, hasLength = false;
+    uint64_t length = 0;
+    const char* xff = nullptr;
+    size_t xffLen = 0;
+    request_.clear();
+    request_.append(method_).append(" ").append(path_).append(" HTTP/1.1\r\n");
+    for (const char* line = lineEnd + 2; line < end + 2; ) {
+        const char* eol = static_cast<const char*>(memmem(line, end + 2 - line, "\r\n", 2));
+        const char* colon = static_cast<const char*>(memchr(line, ':', eol - line));
+        if (!colon || BadName(line, colon - line)) {
+            Reply_(400);
+            return false;
+        }
+        size_t nameLen = colon - line;
+        const char* value = colon + 1;
+        while (value < eol && (*value == ' ' || *value == '\t')) { value++; }
+        size_t valueLen = eol - value;
+        switch (KnownHeader::Find(line, nameLen)) {
+            case KnownHeader::CONNECTION:
+                connClose = connClose || HasToken(value, valueLen, "close");
+                connKeep = connKeep || HasToken(value, valueLen, "keep-alive");
+                break;
+            case KnownHeader::TRANSFER_ENCODING:
+                chunked = true;
+                break;
+            case KnownHeader::X_FORWARDED_FOR:
+                xff = value;
+                xffLen = valueLen;
+                break;
+            case KnownHeader::KEEP_ALIVE:           // 逐跳头不转发
+            case KnownHeader::PROXY_CONNECTION:
+            case KnownHeader::TE:
+            case KnownHeader::UPGRADE:
+                break;
+            case KnownHeader::CONTENT_LENGTH: {
+                uint64_t v = 0;
+                if (!ParseLength(value, eol, &v) || (hasLength && v != length)) {
+                    Reply_(400);
+                    return false;
+                }
+                length = v;
+                hasLength = true;
+                request_.append(line, eol + 2 - line);
+                break;
+            }
+            default:
+                request_.append(line, eol + 2 - line);
+                break;
+        }
+        line = eol + 2;
+    }
+    clientKeepAlive_ = version_[2] == '1' ? !connClose : connKeep;
+    if (chunked) {
+        Reply_(411);
+        return false;
+    }
+    char addr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &ip, addr, sizeof(addr));
+    request_.append("X-Forwarded-For: ");
+    if (xff) { request_.append(xff, xffLen).append(", "); }
+    request_.append(addr).append("\r\n");
+    if (tls_->Active()) { request_.append("X-Forwarded-Proto: https\r\n"); }
+    request_.append("Connection: keep-alive\r\n\r\n");
+    in.Retrieve(end + 4 - begin);
+    size_t take = static_cast<size_t>(min<uint64_t>(length, in.ReadableBytes()));   // 已到达的请求体随请求头一起发出
+    request_.append(in.Peek(), take);
+    in.Retrieve(take);
+    bodyLeft_ = length - take;
+    return true;
+}
+
+bool ProxySession::Dispatch_(bool fresh) {
+    int64_t now = NowMs();
+    while (tries_ <= static_cast<int>(route_->upstreams.size())) {
+        tries_++;
+        upstream_ = route_->Pick(now);
+        bool connecting = false;
+        upFd_ = upstream_->Acquire(fresh, &reused_, &connecting);
+        if (upFd_ < 0) {
+            upstream_->MarkDown(now);
+            continue;
+        }
+        if (reused_) { Metrics::Add(Metrics::PROXY_REUSED); }
+        requestOff_ = 0;
+        state_ = connecting ? CONNECT : SEND_HEAD;
+        return true;
+    }
+    Reply_(502);
+    return false;
+}
+
+// 连接失败，或者复用的连接在收到响应之前就被后端关闭（空闲超时与复用撞在一起）时，
+// 请求还没有任何副作用可见，换一个连接重发；已转发过 request_ 之外的请求体则无法重发
+bool ProxySession::Retry_(bool connectFailed) {
+    bool stale = reused_ && !responded_ && !bodySent_;
+    ReleaseUpstream_(false);
+    if (connectFailed) {
+        LOG_WARN("Proxy: connect %s failed", upstream_->Name().c_str());
+        upstream_->MarkDown(NowMs());
+    }
+    if ((!connectFailed && !stale) || tries_ > static_cast<int>(route_->upstreams.size())) {
+        Reply_(502);
+        return false;
+    }
+    Metrics::Add(Metrics::PROXY_RETRIES);
+    return Dispatch_(stale);
+}
+
+void ProxySession::Reply_(int code) {
+    const char* text = code == 400 ? "Bad Request" : code == 411 ? "Length Required" :
+                       code == 431 ? "Request Header Fields Too Large" :
+                       code == 429 ? "Too Many Requests" : "Bad Gateway";
+    ReleaseUpstream_(false);
+    if (code == 502) {
+        Metrics::Add(Metrics::PROXY_ERRORS);
+        LOG_WARN("Proxy: %s %s: bad gateway", method_.c_str(), path_.c_str());
+    }
+    status_ = code;
+    keepAlive_ = false;
+    char buff[256];
+    int len = snprintf(buff, sizeof(buff), "HTTP/1.1 %d %s\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n"
+                       "Connection: close\r\n\r\n%s\n", code, text, strlen(text) + 1, text);
+    out_.assign(buff, len);
+    outOff_ = 0;
+    state_ = REPLY;
+}
+
+// 状态行和头部原样转发，换掉逐跳头部；1xx 临时响应丢弃（请求体总是整个发完才读响应）
+bool ProxySession::ParseResponse_() {
+    const char* begin = in_.Peek();
+    const char* end = static_cast<const char*>(memmem(begin, in_.ReadableBytes(), "\r\n\r\n", 4));
+    const char* lineEnd = static_cast<const char*>(memmem(begin, end + 2 - begin, "\r\n", 2));
+    if (lineEnd - begin < 12 || memcmp(begin, "HTTP/1.", 7) != 0 || begin[8] != ' ' ||
+        !isdigit(begin[9]) || !isdigit(begin[10]) || !isdigit(begin[11])) {
+        return false;
+    }
+    int code = (begin[9] - '0') * 100 + (begin[10] - '0') * 10 + (begin[11] - '0');
+    if (code < 200) {
+        if (code == 101) { return false; }      // 不代理协议升级
+        in_.Retrieve(end + 4 - begin);
+        return true;
+    }
+    bool http11 = begin[7] == '1';
+    bool connClose = false, connKeep = false, hasLength = false, otherCoding = false;
+    uint64_t length = 0;
+    chunked_ = false;
+    out_.assign("HTTP/1.1").append(begin + 8, lineEnd + 2);
+    for (const char* line = lineEnd + 2; line < end + 2; ) {
+        const char* eol = static_cast<const char*>(memmem(line, end + 2 - line, "\r\n", 2));
+        const char* colon = static_cast<const char*>(memchr(line, ':', eol - line));
+        if (!colon || BadName(line, colon - line)) { return false; }
+        size_t nameLen = colon - line;
+        const char* value = colon + 1;
+        while (value < eol && (*value == ' ' || *value == '\t')) { value++; }
+        size_t valueLen = eol - value;
+        KnownHeader::ID id = KnownHeader::Find(line, nameLen);
+        if (id == KnownHeader::CONNECTION) {
+            connClose = connClose || HasToken(value, valueLen, "close");
+            connKeep = connKeep || HasToken(value, valueLen, "keep-alive");
+            line = eol + 2;
+            continue;
+        }
+        if (id == KnownHeader::KEEP_ALIVE || id == KnownHeader::PROXY_CONNECTION) {
+            line = eol + 2;
+            continue;
+        }
+        if (id == KnownHeader::TRANSFER_ENCODING) {     // 分块的响应体原样转发给客户端
+            chunked_ = valueLen >= 7 && strncasecmp(eol - 7, "chunked", 7) == 0;
+            otherCoding = !chunked_;        // 其他编码只能读到后端关闭为止
+        }
+        else if (id == KnownHeader::CONTENT_LENGTH) {
+            uint64_t v = 0;
+            if (!ParseLength(value, eol, &v) || (hasLength && v != length)) { return false; }
+            length = v;
+            hasLength = true;
+        }
+        out_.append(line, eol + 2 - line);
+        line = eol + 2;
+    }
+    bool noBody = headRequest_ || code == 204 || code == 304;
+    if (noBody) { chunked_ = false; }
+    bool untilClose = !noBody && !chunked_ && (!hasLength || otherCoding);
+    left_ = noBody ? 0 : chunked_ ? 0 : untilClose ? -1 : static_cast<int64_t>(length);
+    chunk_ = CHUNK_SIZE;
+    chunkLeft_ = 0;
+    lineLen_ = 0;
+    status_ = code;
+    upReuse_ = (http11 ? !connClose : connKeep) && !untilClose;
+    keepAlive_ = clientKeepAlive_ && !untilClose;
+    out_.append(keepAlive_ ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+    outOff_ = 0;
+    in_.Retrieve(end + 4 - begin);
+    if (in_.ReadableBytes() > 0) {      // 随响应头一起读到的响应体
+        AppendBody_(in_.Peek(), in_.ReadableBytes());
+        in_.Retrieve(in_.ReadableBytes());
+    }
+    state_ = RELAY;
+    return true;
+}
+
+void ProxySession::AppendBody_(const char* data, size_t len) {
+    size_t take = len;
+    if (chunked_) {
+        take = Chunk_(data, len);
+    }
+    else if (left_ >= 0) {
+        take = static_cast<size_t>(min<int64_t>(len, left_));
+        left_ -= take;
+    }
+    out_.append(data, take);
+    if (take < len) { upReuse_ = false; }      // 后端多发了数据，连接状态不可信
+}
+
+size_t ProxySession::Chunk_(const char* data, size_t len) {
+    size_t i = 0;
+    while (i < len && chunk_ != CHUNK_DONE) {
+        char c = data[i];
+        switch (chunk_) {
+            case CHUNK_SIZE:
+                if (isxdigit(c) && chunkLeft_ < (1ULL << 56)) {
+                    chunkLeft_ = chunkLeft_ * 16 + (isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+                }
+                else if (c == '\n') {
+                    chunk_ = chunkLeft_ ? CHUNK_DATA : CHUNK_TRAILER;
+                    lineLen_ = 0;
+                }
+                else if (c != '\r') {
+                    chunk_ = CHUNK_EXT;         // 块扩展，忽略到行尾
+                }
+                i++;
+                break;
+            case CHUNK_EXT:
+                if (c == '\n') {
+                    chunk_ = chunkLeft_ ? CHUNK_DATA : CHUNK_TRAILER;
+                    lineLen_ = 0;
+                }
+                i++;
+                break;
+            case CHUNK_DATA: {
+                size_t n = static_cast<size_t>(min<uint64_t>(chunkLeft_, len - i));
+                i += n;
+                chunkLeft_ -= n;
+                if (chunkLeft_ == 0) { chunk_ = CHUNK_CRLF; }
+                break;
+            }
+            case CHUNK_CRLF:
+                if (c == '\n') { chunk_ = CHUNK_SIZE; }
+                i++;
+                break;
+            case CHUNK_TRAILER:                 // 末尾的 trailer 行，空行结束
+                if (c == '\n') {
+                    if (lineLen_ == 0) { chunk_ = CHUNK_DONE; }
+                    lineLen_ = 0;
+                }
+                else if (c != '\r') {
+                    lineLen_++;
+                }
+                i++;
+                break;
+            default:
+                break;
+        }
+    }
+    return i;
+}
+
+bool ProxySession::BodyDone_() const {
+    return chunked_ ? chunk_ == CHUNK_DONE : left_ == 0;
+}
+
+ProxySession::WAIT ProxySession::Step(Buffer& in) {
+    while (true) {
+        switch (state_) {
+            case IDLE:
+                return DONE;
+            case CONNECT: {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                if (getsockopt(upFd_, SOL_SOCKET, SO_ERROR, &err, &len) < 0) { err = errno; }
+                if (err == 0) {
+                    sockaddr_in peer;
+                    len = sizeof(peer);
+                    if (getpeername(upFd_, reinterpret_cast<sockaddr*>(&peer), &len) < 0) { return UPSTREAM_WRITE; }
+                    state_ = SEND_HEAD;
+                    break;
+                }
+                Retry_(true);
+                break;
+            }
+            case SEND_HEAD: {
+                ssize_t n = send(upFd_, request_.data() + requestOff_, request_.size() - requestOff_, MSG_NOSIGNAL);
+                if (n < 0) {
+                    if (errno == EAGAIN) { return UPSTREAM_WRITE; }
+                    if (errno != EINTR) { Retry_(false); }
+                    break;
+                }
+                requestOff_ += n;
+                progress_ += n;
+                if (requestOff_ == request_.size()) { state_ = bodyLeft_ > 0 ? SEND_BODY : READ_HEAD; }
+                break;
+            }
+            case SEND_BODY: {
+                WAIT wait;
+                if (SendBody_(in, &wait)) { return wait; }
+                break;
+            }
+            case READ_HEAD: {
+                if (memmem(in_.Peek(), in_.ReadableBytes(), "\r\n\r\n", 4)) {
+                    if (!ParseResponse_()) { Reply_(502); }
+                    break;
+                }
+                if (in_.ReadableBytes() > MAX_HEAD) {
+                    Reply_(502);
+                    break;
+                }
+                int err = 0;
+                ssize_t n = in_.ReadFd(upFd_, &err);
+                if (n > 0) {
+                    responded_ = true;
+                    progress_ += n;
+                    break;
+                }
+                if (n < 0 && err == EAGAIN) { return UPSTREAM_READ; }
+                if (n < 0 && err == EINTR) { break; }
+                if (responded_) { Reply_(502); }
+                else { Retry_(false); }
+                break;
+            }
+            case RELAY: {
+                WAIT wait;
+                if (Relay_(&wait)) { return wait; }
+                break;
+            }
+            case REPLY: {
+                ssize_t n = ClientWrite_(out_.data() + outOff_, out_.size() - outOff_);
+                if (n < 0) {
+                    if (errno == EAGAIN) { return CLIENT_WRITE; }
+                    if (errno == EINTR) { break; }
+                    return Fail_();
+                }
+                outOff_ += n;
+                if (outOff_ == out_.size()) { return Finish_(); }
+                break;
+            }
+        }
+    }
+}
+
+// 先用读缓冲区里已有的请求体，之后明文连接经管道 splice，TLS 连接解密后再写往后端
+bool ProxySession::SendBody_(Buffer& in, WAIT* wait) {
+    while (bodyLeft_ > 0 || inPipe_ > 0) {
+        if (inPipe_ > 0) {
+            ssize_t n = splice(pipe_[0], nullptr, upFd_, nullptr, inPipe_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n < 0 && errno == EAGAIN) {
+                *wait = UPSTREAM_WRITE;
+                return true;
+            }
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n <= 0) {
+                Reply_(502);
+                return false;
+            }
+            inPipe_ -= n;
+            progress_ += n;
+            Metrics::Add(Metrics::PROXY_SPLICED, n);
+            continue;
+        }
+        if (in.ReadableBytes() > 0) {
+            size_t take = static_cast<size_t>(min<uint64_t>(bodyLeft_, in.ReadableBytes()));
+            ssize_t n = send(upFd_, in.Peek(), take, MSG_NOSIGNAL);
+            if (n < 0 && errno == EAGAIN) {
+                *wait = UPSTREAM_WRITE;
+                return true;
+            }
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n <= 0) {
+                Reply_(502);
+                return false;
+            }
+            in.Retrieve(n);
+            bodyLeft_ -= n;
+            bodySent_ = true;
+            progress_ += n;
+            continue;
+        }
+        ssize_t n;
+        int err = 0;
+        if (!tls_->Active() && (pipe_[0] >= 0 || OpenPipe_())) {
+            n = splice(clientFd_, nullptr, pipe_[1], nullptr, static_cast<size_t>(min<uint64_t>(bodyLeft_, PIPE_SIZE)),
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                inPipe_ += n;
+                bodyLeft_ -= n;
+                bodySent_ = true;
+            }
+            err = errno;
+        }
+        else {
+            n = tls_->Active() ? tls_->Read(in, &err) : in.ReadFd(clientFd_, &err);
+        }
+        if (n > 0) {
+            Metrics::Add(Metrics::BYTES_IN, n);
+            progress_ += n;
+            continue;
+        }
+        if (n < 0 && err == EINTR) { continue; }
+        if (n < 0 && err == EAGAIN) {
+            *wait = CLIENT_READ;
+            return true;
+        }
+        *wait = Fail_();        // 客户端在请求体中途关闭
+        return true;
+    }
+    state_ = READ_HEAD;
+    return false;
+}
+
+// 响应头和已读到用户态的响应体先写出；之后能 splice 时经管道直接搬运，分块编码或 TLS 连接复制转发
+bool ProxySession::Relay_(WAIT* wait) {
+    size_t budget = RELAY_BUDGET;
+    while (true) {
+        if (outOff_ < out_.size()) {
+            ssize_t n = ClientWrite_(out_.data() + outOff_, out_.size() - outOff_);
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n < 0) {
+                *wait = errno == EAGAIN ? CLIENT_WRITE : Fail_();
+                return true;
+            }
+            outOff_ += n;
+            continue;
+        }
+        out_.clear();
+        outOff_ = 0;
+        if (inPipe_ > 0) {
+            ssize_t n = splice(pipe_[0], nullptr, clientFd_, nullptr, inPipe_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n <= 0) {
+                *wait = (n < 0 && errno == EAGAIN) ? CLIENT_WRITE : Fail_();
+                return true;
+            }
+            inPipe_ -= n;
+            sent_ += n;
+            progress_ += n;
+            Metrics::Add(Metrics::BYTES_OUT, n);
+            Metrics::Add(Metrics::PROXY_SPLICED, n);
+            continue;
+        }
+        if (BodyDone_()) {
+            *wait = Finish_();
+            return true;
+        }
+        if (budget == 0) {      // 让出线程，客户端套接字可写时马上回来
+            *wait = CLIENT_WRITE;
+            return true;
+        }
+        ssize_t n;
+        int err = 0;
+        if (splice_ && !chunked_ && (pipe_[0] >= 0 || OpenPipe_())) {
+            size_t want = left_ < 0 ? PIPE_SIZE : static_cast<size_t>(min<int64_t>(left_, PIPE_SIZE));
+            n = splice(upFd_, nullptr, pipe_[1], nullptr, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            err = errno;
+            if (n > 0) {
+                inPipe_ += n;
+                if (left_ > 0) { left_ -= n; }
+            }
+        }
+        else {
+            in_.EnsureWriteable(COPY_CHUNK);
+            n = in_.ReadFd(upFd_, &err);
+            if (n > 0) {
+                AppendBody_(in_.Peek(), in_.ReadableBytes());
+                in_.Retrieve(in_.ReadableBytes());
+            }
+        }
+        if (n > 0) {
+            progress_ += n;
+            budget -= min<size_t>(budget, n);
+            continue;
+        }
+        if (n < 0 && err == EINTR) { continue; }
+        if (n < 0 && err == EAGAIN) {
+            *wait = UPSTREAM_READ;
+            return true;
+        }
+        if (n == 0 && left_ < 0 && !chunked_) {     // 没有长度的响应以后端关闭为结尾
+            left_ = 0;
+            upReuse_ = false;
+            continue;
+        }
+        LOG_WARN("Proxy: %s closed in the middle of a response", upstream_->Name().c_str());
+        *wait = Fail_();        // 响应头已发出，只能断开客户端，让它知道响应不完整
+        return true;
+    }
+}
+
+ProxySession::WAIT ProxySession::Finish_() {
+    ReleaseUpstream_(upReuse_);
+    ClosePipe_();
+    state_ = IDLE;
+    return DONE;
+}
+
+ProxySession::WAIT ProxySession::Fail_() {
+    Metrics::Add(Metrics::PROXY_ERRORS);
+    ReleaseUpstream_(false);
+    ClosePipe_();
+    state_ = IDLE;
+    return FAILED;
+}
+
+void ProxySession::Abort() {
+    if (state_ != IDLE) { ReleaseUpstream_(false); }
+    ClosePipe_();
+    state_ = IDLE;
+}
+
+uint64_t ProxySession::TakeProgress() {
+    uint64_t n = progress_;
+    progress_ = 0;
+    return n;
+}
+
+void ProxySession::ReleaseUpstream_(bool reuse) {
+    if (upFd_ < 0) { return; }
+    upstream_->Release(upFd_, reuse);
+    upFd_ = -1;
+}
+
+ssize_t ProxySession::ClientWrite_(const char* data, size_t len) {
+    ssize_t n;
+    if (tls_->Active()) {
+        iovec iov = { const_cast<char*>(data), len };
+        n = tls_->Writev(clientFd_, &iov, 1);
+    }
+    else {
+        n = send(clientFd_, data, len, MSG_NOSIGNAL);
+    }
+    if (n > 0) {
+        sent_ += n;
+        progress_ += n;
+        Metrics::Add(Metrics::BYTES_OUT, n);
+    }
+    return n;
+}
+
+bool ProxySession::OpenPipe_() {
+    {
+        lock_guard<mutex> locker(pipeMtx);
+        if (!pipePool.empty()) {
+            pipe_[0] = pipePool.back().first;
+            pipe_[1] = pipePool.back().second;
+            pipePool.pop_back();
+            return true;
+        }
+    }
+    if (pipe2(pipe_, O_NONBLOCK | O_CLOEXEC) < 0) {
+        pipe_[0] = pipe_[1] = -1;
+        return false;           // 描述符不够时退回复制
+    }
+    fcntl(pipe_[1], F_SETPIPE_SZ, static_cast<int>(PIPE_SIZE));    // 超过 pipe-max-size 时保持默认大小
+    return true;
+}
+
+void ProxySession::ClosePipe_() {
+    if (pipe_[0] < 0) { return; }
+    if (inPipe_ == 0) {         // 空管道还回池中
+        lock_guard<mutex> locker(pipeMtx);
+        if (pipePool.size() < PIPE_POOL_MAX) {
+            pipePool.emplace_back(pipe_[0], pipe_[1]);
+            pipe_[0] = pipe_[1] = -1;
+            return;
+        }
+    }
+    close(pipe_[0]);
+    close(pipe_[1]);
+    pipe_[0] = pipe_[1] = -1;
+    inPipe_ = 0;
+}
@@ -0,0 +1,189 @@
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../buffer/buffer.h"
+#include "../log/log.h"
+#include "../metrics/metrics.h"
+#include "../tls/tls.h"
+#include "knownheader.h"
+
+/*
+ * 反向代理：请求目标匹配路由前缀时转发给后端，不经过 HttpRequest 解析。
+ * 后端套接字非阻塞，挂在客户端所属反应堆的 epoll 上，事件带着客户端描述符，由工作线程推进同一个会话；
+ * 一次只挂客户端或后端中的一个套接字，会话不需要加锁。
+ * 每个后端地址有自己的空闲长连接池，同一路由的多个后端按在途请求数最少选择；
+ * 响应体经管道 splice 从后端套接字直接搬到客户端套接字，不经过用户态（TLS 未开启 kTLS 时退回复制）。
+ */
+class Upstream {                        // 一个后端地址：空闲长连接池和在途请求数
+public:
+    Upstream(const sockaddr_in& addr, const std::string& name);
+    ~Upstream();
+
+    const std::string& Name() const { return name_; }
+    int Outstanding() const { return outstanding_.load(std::memory_order_relaxed); }
+    bool Down(int64_t now) const { return now < downUntil_.load(std::memory_order_relaxed); }
+    size_t IdleCount();
+
+    // 取一个空闲连接，没有时发起非阻塞 connect（*connecting 为真表示要等可写）；失败返回 -1
+    int Acquire(bool fresh, bool* reused, bool* connecting);
+    void Release(int fd, bool reuse);   // 请求结束：reuse 时放回池中，否则关闭
+    void MarkDown(int64_t now);         // 连接失败，短时间内不再优先选择
+
+    static int keepAlive;               // 每个后端最多保留的空闲连接
+
+private:
+    static const int64_t IDLE_MS = 30000;   // 空闲超过此时长的连接不再复用，避开后端的空闲超时
+    static const int64_t DOWN_MS = 1000;
+
+    const sockaddr_in addr_;
+    const std::string name_;
+    std::atomic<int> outstanding_;
+    std::atomic<int64_t> downUntil_;
+    std::mutex mtx_;
+    std::vector<std::pair<int, int64_t>> idle_;     // 描述符和放回的时间，后进先出
+};
+
+class Proxy {                           // 路由表：启动时由配置建立，之后只读
+public:
+    struct Route {
+        std::string prefix;
+        std::vector<std::unique_ptr<Upstream>> upstreams;
+        std::atomic<unsigned> next;     // 在途请求数相同时轮流选择
+
+        Upstream* Pick(int64_t now);    // 在途请求最少的可用后端，都不可用时忽略 Down
+    };
+
+    // 格式："/api/=127.0.0.1:9001,127.0.0.1:9002 /app/=10.0.0.5:8080"，按最长前缀匹配
+    static bool Parse(const std::string& spec, std::string* err);
+    static bool Init(const std::string& spec);
+    static bool Enabled();
+    static Route* Match(const char* target, size_t len);
+    static size_t IdleCount();          // 各后端池中的空闲连接总数
+
+private:
+    static bool Parse_(const std::string& spec, std::vector<std::unique_ptr<Route>>* routes, std::string* err);
+
+    static std::vector<std::unique_ptr<Route>> routes_;
+};
+
+class ProxySession {                    // 每个客户端连接一个，一次转发一个请求，只由处理该连接的线程访问
+public:
+    enum WAIT {                         // Step 返回：下一步等待的事件，或者请求已结束
+        UPSTREAM_READ,
+        UPSTREAM_WRITE,
+        CLIENT_READ,
+        CLIENT_WRITE,
+        DONE,                           // 响应已转发完，连接按 KeepAlive 继续或关闭
+        FAILED,                         // 响应已开始后出错，只能关闭客户端连接
+    };
+
+    enum DETECT { NOT_PROXY, NEED_MORE, MATCHED };
+
+    static const size_t MAX_HEAD = 16 * 1024;   // 请求头和响应头的上限
+
+    static DETECT Detect(const Buffer& in);     // 看请求行的目标是否匹配路由，匹配时等请求头完整
+
+    ProxySession();
+    ~ProxySession();
+
+    // 取出请求头和已到达的请求体，之后由 Step 推进；请求本身有错或 limited（已被限速）时直接排入错误响应
+    void Start(Buffer& in, int clientFd, TlsSession* tls, const in_addr& ip, bool draining, bool limited);
+    WAIT Step(Buffer& in);              // in 为客户端读缓冲区：TLS 连接的请求体从这里读，多读的留给下一个请求
+    void Abort();                       // 客户端连接关闭，后端连接不再复用
+
+    bool Active() const { return state_ != IDLE; }
+    int UpstreamFd() const { return upFd_; }
+    bool KeepAlive() const { return keepAlive_; }
+    int Status() const { return status_; }
+    size_t BytesSent() const { return sent_; }
+    uint64_t TakeProgress();            // 上次调用以来两个方向转发的字节数，供超时检查
+
+    const std::string& Method() const { return method_; }
+    const std::string& Path() const { return path_; }
+    const std::string& Version() const { return version_; }
+
+private:
+    enum STATE {
+        IDLE,
+        CONNECT,                        // 非阻塞 connect 进行中
+        SEND_HEAD,                      // 请求头和已缓冲的请求体写往后端
+        SEND_BODY,                      // 请求体剩余部分：客户端 -> 后端
+        READ_HEAD,                      // 等后端响应头
+        RELAY,                          // 响应头和响应体：后端 -> 客户端
+        REPLY,                          // 代理自己生成的错误响应
+    };
+
+    enum CHUNK { CHUNK_SIZE, CHUNK_EXT, CHUNK_DATA, CHUNK_CRLF, CHUNK_TRAILER, CHUNK_DONE };
+
+    static const size_t PIPE_SIZE = 256 * 1024;
+    static const size_t COPY_CHUNK = 16 * 1024;
+    static const size_t RELAY_BUDGET = 1 << 20;     // 每次 Step 最多转发的响应体，之后让出线程
+
+    bool ParseRequest_(Buffer& in, const in_addr& ip);
+    bool Dispatch_(bool fresh);         // 选后端并取连接，失败时排入 502
+    bool Retry_(bool connectFailed);    // 还没有收到响应的字节时换一个连接重发，不能重发时排入 502
+    void Reply_(int code);
+    bool ParseResponse_();
+    void AppendBody_(const char* data, size_t len);     // 响应头之后读到的响应体，按分帧截断
+    size_t Chunk_(const char* data, size_t len);        // 跟踪分块编码，返回属于本响应的字节数
+    bool BodyDone_() const;
+    bool SendBody_(Buffer& in, WAIT* wait);     // 返回 true 表示要等 *wait，否则状态已前进
+    bool Relay_(WAIT* wait);
+    WAIT Finish_();
+    WAIT Fail_();
+    void ReleaseUpstream_(bool reuse);
+    ssize_t ClientWrite_(const char* data, size_t len);
+    bool OpenPipe_();
+    void ClosePipe_();
+
+    STATE state_;
+    Proxy::Route* route_;
+    Upstream* upstream_;
+    int upFd_;
+    bool reused_;
+    int tries_;
+
+    int clientFd_;
+    TlsSession* tls_;
+    bool splice_;                       // 客户端是明文或 kTLS，响应体可以直接 splice 到套接字
+
+    std::string method_;
+    std::string path_;
+    std::string version_;
+    bool headRequest_;
+    bool clientKeepAlive_;
+
+    std::string request_;               // 改写后的请求头和已缓冲的请求体，重试时重发
+    size_t requestOff_;
+    uint64_t bodyLeft_;                 // 仍需从客户端读取的请求体
+    bool bodySent_;                     // 已转发过 request_ 之外的请求体，不能再重试
+    bool responded_;                    // 已收到后端响应的字节
+
+    Buffer in_;                         // 后端的响应头，以及不能 splice 时的响应体
+    std::string out_;                   // 待写给客户端的数据
+    size_t outOff_;
+    int64_t left_;                      // 响应体还需转发的字节，-1 表示读到后端关闭为止
+    bool chunked_;
+    CHUNK chunk_;
+    uint64_t chunkLeft_;
+    size_t lineLen_;
+
+    int pipe_[2];
+    size_t inPipe_;
+
+    int status_;
+    bool keepAlive_;
+    bool upReuse_;                      // 响应完整且后端没有要求关闭，连接可以放回池中
+    size_t sent_;
+    uint64_t progress_;
+};
+
+#endif //PROXY_H
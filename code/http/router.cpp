@@ -0,0 +1,246 @@
+#include "router.h"
+
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+const int Router::MAX_PARAMS;
+
+Router::Build::Build() {
+    for (int& h : handler) { h = -1; }
+}
+
+Router* Router::Instance() {
+    static Router inst;
+    return &inst;
+}
+
+int Router::MethodBit(const string& method) {
+    switch (method.size()) {
+        case 3:
+            if (method == "GET") { return GET; }
+            if (method == "PUT") { return PUT; }
+            break;
+        case 4:
+            if (method == "HEAD") { return HEAD; }
+            if (method == "POST") { return POST; }
+            break;
+        case 5:
+            if (method == "PATCH") { return PATCH; }
+            break;
+        case 6:
+            if (method == "DELETE") { return DELETE; }
+            break;
+        case 7:
+            if (method == "OPTIONS") { return OPTIONS; }
+            break;
+        default:
+            break;
+    }
+    return OTHER;
+}
+
+int Router::Index_(int bit) {
+    return __builtin_ctz(static_cast<unsigned>(bit));
+}
+
+string Router::Match::Param(const char* key) const {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(name[i], key) == 0) { return string(value[i], len[i]); }
+    }
+    return "";
+}
+
+Router::Build* Router::Insert_(Build* root, const string& pattern) {
+    if (pattern.empty() || pattern[0] != '/') { return nullptr; }
+    Build* node = root;
+    int params = 0;
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+        bool segStart = pos > 0 && pattern[pos - 1] == '/';
+        if (segStart && (pattern[pos] == ':' || pattern[pos] == '*')) {
+            bool wildcard = pattern[pos] == '*';
+            size_t end = pattern.find('/', pos);
+            if (end == string::npos) { end = pattern.size(); }
+            if (wildcard && end != pattern.size()) { return nullptr; }     // 通配只能在末尾
+            string name = pattern.substr(pos + 1, end - pos - 1);
+            if (name.empty() || ++params > MAX_PARAMS) { return nullptr; }
+            unique_ptr<Build>& child = wildcard ? node->wildcard : node->param;
+            string& childName = wildcard ? node->wildcardName : node->paramName;
+            if (!child) {
+                child.reset(new Build());
+                childName = name;
+            }
+            else if (childName != name) {   // 同一位置的参数必须同名，否则取值有歧义
+                return nullptr;
+            }
+            node = child.get();
+            pos = end;
+            continue;
+        }
+        char ch = pattern[pos++];
+        auto it = find_if(node->next.begin(), node->next.end(),
+                          [ch](const pair<char, unique_ptr<Build>>& e) { return e.first == ch; });
+        if (it == node->next.end()) {
+            node->next.emplace_back(ch, unique_ptr<Build>(new Build()));
+            it = node->next.end() - 1;
+        }
+        node = it->second.get();
+    }
+    return node;
+}
+
+bool Router::Add(int methods, const string& pattern, Handler handler) {
+    if (frozen_) {
+        LOG_ERROR("Router: add %s after freeze", pattern.c_str());
+        return false;
+    }
+    Build* node = Insert_(root_.get(), pattern);
+    if (!node || (methods & ANY) == 0) {
+        LOG_ERROR("Router: bad pattern %s", pattern.c_str());
+        return false;
+    }
+    for (int i = 0; i < 8; i++) {
+        if ((methods & (1 << i)) && node->handler[i] >= 0) {
+            LOG_ERROR("Router: duplicate route %s", pattern.c_str());
+            return false;
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        if (methods & (1 << i)) { node->handler[i] = static_cast<int>(handlers_.size()); }
+    }
+    handlers_.push_back(move(handler));
+    return true;
+}
+
+// 逐字节树中只有一个静态子节点、本身不终止也没有参数的节点并入边上的标签
+void Router::Freeze() {
+    if (frozen_) { return; }
+    nodes_.clear();
+    pool_.clear();
+    nodes_.emplace_back();
+    Fill_(0, root_.get(), "", "");
+    root_.reset();
+    frozen_ = true;
+    LOG_INFO("Router: %zu routes, %zu nodes", handlers_.size(), nodes_.size());
+}
+
+void Router::Fill_(uint32_t at, const Build* node, const string& label, const string& name) {
+    Node n;
+    n.label = pool_.size();
+    n.labelLen = label.size();
+    pool_ += label;
+    n.name = pool_.size();
+    n.nameLen = name.size();
+    pool_.append(name).push_back('\0');             // Match 中的参数名直接指向这里
+    for (int i = 0; i < 8; i++) { n.handler[i] = static_cast<int16_t>(node->handler[i]); }
+
+    vector<pair<string, const Build*>> edges;
+    for (const auto& e : node->next) {
+        string edge(1, e.first);
+        const Build* cur = e.second.get();
+        while (cur->next.size() == 1 && !cur->param && !cur->wildcard &&
+               all_of(cur->handler, cur->handler + 8, [](int h) { return h < 0; })) {
+            edge += cur->next[0].first;
+            cur = cur->next[0].second.get();
+        }
+        edges.emplace_back(move(edge), cur);
+    }
+    sort(edges.begin(), edges.end());               // 首字节各不相同，按首字节二分
+    n.child = nodes_.size();
+    n.childCount = edges.size();
+    nodes_.resize(nodes_.size() + edges.size());
+    n.param = node->param ? static_cast<int32_t>(nodes_.size()) : -1;
+    if (node->param) { nodes_.emplace_back(); }
+    n.wildcard = node->wildcard ? static_cast<int32_t>(nodes_.size()) : -1;
+    if (node->wildcard) { nodes_.emplace_back(); }
+    nodes_[at] = n;                                 // 先占好位置，递归中 nodes_ 会增长
+
+    for (size_t i = 0; i < edges.size(); i++) {
+        Fill_(n.child + i, edges[i].second, edges[i].first, "");
+    }
+    if (node->param) { Fill_(n.param, node->param.get(), "", node->paramName); }
+    if (node->wildcard) { Fill_(n.wildcard, node->wildcard.get(), "", node->wildcardName); }
+}
+
+int Router::Handler_(uint32_t n, int method) const {
+    const Node& node = nodes_[n];
+    if (method == ANY) {
+        for (int16_t h : node.handler) {
+            if (h >= 0) { return h; }
+        }
+        return -1;
+    }
+    int h = node.handler[Index_(method)];
+    if (h < 0 && method == HEAD) { h = node.handler[Index_(GET)]; }    // HEAD 默认同 GET
+    return h;
+}
+
+bool Router::Match_(uint32_t n, const char* p, const char* end, int method, Match* match, int* handler) const {
+    const Node& node = nodes_[n];
+    if (p == end && (*handler = Handler_(n, method)) >= 0) { return true; }
+    if (p < end && node.childCount > 0) {           // 静态边
+        uint32_t lo = node.child, hi = node.child + node.childCount;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            unsigned char c = pool_[nodes_[mid].label];
+            if (c < static_cast<unsigned char>(*p)) { lo = mid + 1; }
+            else { hi = mid; }
+        }
+        if (lo < node.child + node.childCount) {
+            const Node& c = nodes_[lo];
+            if (pool_[c.label] == *p && static_cast<size_t>(end - p) >= c.labelLen &&
+                memcmp(pool_.data() + c.label, p, c.labelLen) == 0 &&
+                Match_(lo, p + c.labelLen, end, method, match, handler)) {
+                return true;
+            }
+        }
+    }
+    if (node.param >= 0 && p < end && *p != '/' && match->count < MAX_PARAMS) {     // 参数段
+        const char* q = static_cast<const char*>(memchr(p, '/', end - p));
+        if (!q) { q = end; }
+        int k = match->count++;
+        match->name[k] = pool_.data() + nodes_[node.param].name;
+        match->value[k] = p;
+        match->len[k] = q - p;
+        if (Match_(node.param, q, end, method, match, handler)) { return true; }
+        match->count--;
+    }
+    if (node.wildcard >= 0 && match->count < MAX_PARAMS &&
+        (*handler = Handler_(node.wildcard, method)) >= 0) {  // 通配：剩余部分
+        int k = match->count++;
+        match->name[k] = pool_.data() + nodes_[node.wildcard].name;
+        match->value[k] = p;
+        match->len[k] = end - p;
+        return true;
+    }
+    return false;
+}
+
+const Router::Handler* Router::Find(int method, const char* path, size_t len, Match* match, bool* allowed) const {
+    match->count = 0;
+    *allowed = true;
+    if (!frozen_) { return nullptr; }
+    const char* end = static_cast<const char*>(memchr(path, '?', len));     // 查询串不参与匹配
+    if (!end) { end = path + len; }
+    int h;
+    if (Match_(0, path, end, method, match, &h)) { return &handlers_[h]; }
+    match->count = 0;
+    *allowed = !Match_(0, path, end, ANY, match, &h);  // 只在未命中时再查一次，区分 404 和 405
+    match->count = 0;
+    return nullptr;
+}
+
+void Router::Dispatch(HttpRequest& request, Reply& reply) const {
+    if (!frozen_) { return; }                       // 没有路由表时按路径返回文件
+    Match match;
+    bool allowed;
+    const string& path = request.path();
+    const Handler* handler = Find(MethodBit(request.method()), path.data(), path.size(), &match, &allowed);
+    if (handler) {
+        (*handler)(request, match, reply);
+        return;
+    }
+    reply.code = allowed ? 404 : 405;
+}
@@ -0,0 +1,105 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../log/log.h"
+#include "httprequest.h"
+
+/*
+ * 路由表：方法 + 路径模式 -> 处理函数，启动时注册，Freeze 后编译成只读的压缩前缀树。
+ * 模式由 '/' 分隔的段组成：普通段逐字节匹配，":name" 匹配一个非空的段，末尾的 "*name" 匹配剩余部分（可为空）。
+ * 同一位置上静态边优先，其次参数段，最后通配，失败或方法未注册时回溯；匹配只读路径本身，耗时与路径长度成正比，不分配内存。
+ * 冻结后只读，各工作线程无锁查找。
+ */
+class Router {
+public:
+    enum METHOD {
+        GET = 1 << 0,
+        HEAD = 1 << 1,
+        POST = 1 << 2,
+        PUT = 1 << 3,
+        DELETE = 1 << 4,
+        OPTIONS = 1 << 5,
+        PATCH = 1 << 6,
+        OTHER = 1 << 7,                 // 其余方法
+        ANY = 0xff,
+    };
+
+    static const int MAX_PARAMS = 4;
+
+    struct Match {                      // 查找结果，参数值指向请求路径，处理函数改写路径前先取出
+        int count;
+        const char* name[MAX_PARAMS];
+        const char* value[MAX_PARAMS];
+        size_t len[MAX_PARAMS];
+
+        std::string Param(const char* key) const;   // 不存在时为空
+    };
+
+    struct Reply {                      // 处理函数的结果：默认按（可能被改写的）请求路径返回 srcDir 下的文件
+        int code;
+        const char* contentType;        // 非空时以 content 作为响应体
+        std::string content;
+
+        void Reset() { code = 200; contentType = nullptr; content.clear(); }
+    };
+
+    typedef std::function<void(HttpRequest& request, const Match& match, Reply& reply)> Handler;
+
+    static Router* Instance();
+    static int MethodBit(const std::string& method);
+
+    bool Add(int methods, const std::string& pattern, Handler handler);    // 模式非法或重复时返回 false
+    void Freeze();
+    bool Frozen() const { return frozen_; }
+
+    // 返回处理函数；没有该方法的路由但路径能匹配其他方法时 *allowed 为假
+    const Handler* Find(int method, const char* path, size_t len, Match* match, bool* allowed) const;
+
+    // 查表并调用处理函数：没有匹配的路由为 404，方法不允许为 405（都换成对应的错误页面）
+    void Dispatch(HttpRequest& request, Reply& reply) const;
+
+private:
+    struct Build {                      // 注册期的逐字节前缀树，Freeze 时压缩
+        Build();
+        std::vector<std::pair<char, std::unique_ptr<Build>>> next;
+        std::unique_ptr<Build> param;
+        std::string paramName;
+        std::unique_ptr<Build> wildcard;
+        std::string wildcardName;
+        int handler[8];                 // 按方法位的下标，-1 表示未注册
+    };
+
+    struct Node {                       // 冻结后的节点，边上的字节和参数名都在 pool_ 中
+        uint32_t label;
+        uint32_t labelLen;
+        uint32_t child;                 // 静态子节点在 nodes_ 中连续存放，按首字节排序
+        uint32_t childCount;
+        int32_t param;                  // 参数子节点下标，-1 表示没有
+        int32_t wildcard;               // 通配子节点下标（终止节点），-1 表示没有
+        uint32_t name;                  // 本节点是参数或通配节点时的名字
+        uint32_t nameLen;
+        int16_t handler[8];
+    };
+
+    Router() : frozen_(false), root_(new Build()) {}
+
+    static Build* Insert_(Build* root, const std::string& pattern);     // 返回模式的终止节点，模式非法时为空
+    static int Index_(int bit);
+    void Fill_(uint32_t at, const Build* node, const std::string& label, const std::string& name);
+    int Handler_(uint32_t n, int method) const;    // 节点上该方法的处理函数下标，method 为 ANY 时取任意一个
+    bool Match_(uint32_t n, const char* p, const char* end, int method, Match* match, int* handler) const;
+
+    bool frozen_;
+    std::unique_ptr<Build> root_;
+    std::vector<Handler> handlers_;
+    std::vector<Node> nodes_;           // nodes_[0] 为根，对应空标签
+    std::string pool_;
+};
+
+#endif //ROUTER_H
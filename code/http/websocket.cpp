@@ -0,0 +1,373 @@
+#include "websocket.h"
+#include <limits.h>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+const char* const WebSocketSession::PATH = "/ws";
+size_t WebSocketSession::maxMessage = 64 * 1024;
+size_t WebSocketSession::maxQueue = 1 << 20;
+const size_t WebSocketSession::MAX_CONTROL;
+
+static const char GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static uint32_t Rol(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+static void Sha1(const string& in, uint8_t digest[20]) {     // 只用于握手，不追求速度
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    string msg = in;
+    msg.push_back(static_cast<char>(0x80));
+    while (msg.size() % 64 != 56) { msg.push_back('\0'); }
+    uint64_t bits = static_cast<uint64_t>(in.size()) * 8;
+    for (int i = 7; i >= 0; i--) { msg.push_back(static_cast<char>(bits >> (i * 8))); }
+    for (size_t off = 0; off < msg.size(); off += 64) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(msg.data()) + off;
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (static_cast<uint32_t>(p[4 * i]) << 24) | (p[4 * i + 1] << 16) | (p[4 * i + 2] << 8) | p[4 * i + 3];
+        }
+        for (int i = 16; i < 80; i++) { w[i] = Rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1); }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+            uint32_t t = Rol(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = Rol(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (int i = 0; i < 20; i++) { digest[i] = static_cast<uint8_t>(h[i / 4] >> (24 - 8 * (i % 4))); }
+}
+
+static string Base64Encode(const uint8_t* p, size_t len) {
+    static const char TABLE[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    string out;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = p[i] << 16;
+        if (i + 1 < len) { v |= p[i + 1] << 8; }
+        if (i + 2 < len) { v |= p[i + 2]; }
+        out.push_back(TABLE[(v >> 18) & 63]);
+        out.push_back(TABLE[(v >> 12) & 63]);
+        out.push_back(i + 1 < len ? TABLE[(v >> 6) & 63] : '=');
+        out.push_back(i + 2 < len ? TABLE[v & 63] : '=');
+    }
+    return out;
+}
+
+// 掩码按 4 字节循环，把它铺满一个向量寄存器后整块异或；每块长度是 4 的倍数，尾部接着按下标取掩码字节
+static void Unmask(char* data, size_t len, const uint8_t key[4]) {
+    uint8_t* p = reinterpret_cast<uint8_t*>(data);
+    size_t i = 0;
+    uint32_t k;
+    memcpy(&k, key, 4);
+#if defined(__AVX2__)
+    __m256i m32 = _mm256_set1_epi32(static_cast<int>(k));
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i), _mm256_xor_si256(v, m32));
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i m16 = _mm_set1_epi32(static_cast<int>(k));
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), _mm_xor_si128(v, m16));
+    }
+#else
+    uint64_t m8 = (static_cast<uint64_t>(k) << 32) | k;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, p + i, 8);
+        v ^= m8;
+        memcpy(p + i, &v, 8);
+    }
+#endif
+    for (; i < len; i++) { p[i] ^= key[i & 3]; }
+}
+
+bool WebSocketSession::IsUpgrade(const HttpRequest& request) {
+    if (request.method() != "GET" || request.path() != PATH) { return false; }
+    if (!strcasestr(request.Header(KnownHeader::UPGRADE).c_str(), "websocket")) { return false; }
+    return !request.Header(KnownHeader::SEC_WEBSOCKET_KEY).empty() && request.Header(KnownHeader::SEC_WEBSOCKET_VERSION) == "13";
+}
+
+WsFrame WebSocketSession::Encode(int opcode, const char* data, size_t len) {
+    shared_ptr<string> frame = make_shared<string>();
+    frame->reserve(len + 10);
+    frame->push_back(static_cast<char>(0x80 | opcode));
+    if (len < 126) {
+        frame->push_back(static_cast<char>(len));
+    }
+    else if (len <= 0xffff) {
+        frame->push_back(126);
+        frame->push_back(static_cast<char>(len >> 8));
+        frame->push_back(static_cast<char>(len));
+    }
+    else {
+        frame->push_back(127);
+        for (int i = 7; i >= 0; i--) { frame->push_back(static_cast<char>(static_cast<uint64_t>(len) >> (i * 8))); }
+    }
+    frame->append(data, len);
+    return frame;
+}
+
+WebSocketSession::WebSocketSession(int fd, int owner) :
+    fd_(fd), owner_(owner), slot_(SIZE_MAX), fragment_(0),
+    offset_(0), bytes_(0), idle_(false), closing_(false), overflow_(false) {}
+
+size_t WebSocketSession::Accept(const string& key) {
+    uint8_t digest[20];
+    Sha1(key + GUID, digest);
+    string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                      "Sec-WebSocket-Accept: " + Base64Encode(digest, sizeof(digest)) + "\r\n\r\n";
+    size_t len = response.size();
+    Push_(make_shared<const string>(move(response)), true);
+    return len;
+}
+
+void WebSocketSession::OnData(Buffer& in) {
+    while (in.ReadableBytes() >= 2) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(in.Peek());
+        size_t avail = in.ReadableBytes();
+        bool fin = p[0] & 0x80;
+        int opcode = p[0] & 0x0f;
+        if ((p[0] & 0x70) || !(p[1] & 0x80)) {          // 没有协商扩展，保留位必须为 0；客户端的帧必须加掩码
+            Close(PROTOCOL_ERROR);
+            in.RetrieveAll();
+            return;
+        }
+        uint64_t len = p[1] & 0x7f;
+        size_t head = 2;
+        if (len == 126) {
+            if (avail < 4) { return; }
+            len = (p[2] << 8) | p[3];
+            head = 4;
+        }
+        else if (len == 127) {
+            if (avail < 10) { return; }
+            len = 0;
+            for (int i = 2; i < 10; i++) { len = (len << 8) | p[i]; }
+            head = 10;
+        }
+        if ((opcode & 0x8) && (len > MAX_CONTROL || !fin)) {     // 控制帧不能分片，负载不超过 125 字节
+            Close(PROTOCOL_ERROR);
+            in.RetrieveAll();
+            return;
+        }
+        if (len > maxMessage - message_.size()) {       // 按帧头长度提前拒绝，不等整帧进入缓冲区
+            Close(TOO_BIG);
+            in.RetrieveAll();
+            return;
+        }
+        head += 4;
+        if (avail < head + len) { return; }
+        char* payload = const_cast<char*>(in.Peek()) + head;
+        Unmask(payload, len, p + head - 4);             // 在读缓冲区中原地去掩码，完整的单帧消息不再复制
+        bool ok = OnFrame_(opcode, fin, payload, len);
+        in.Retrieve(head + len);
+        if (!ok) {
+            in.RetrieveAll();
+            return;
+        }
+    }
+}
+
+bool WebSocketSession::OnFrame_(int opcode, bool fin, char* payload, size_t len) {
+    switch (opcode) {
+        case CLOSE: {
+            uint16_t code = NORMAL;
+            if (len >= 2) { code = (static_cast<uint8_t>(payload[0]) << 8) | static_cast<uint8_t>(payload[1]); }
+            if (len == 1 || (len >= 2 && (code < 1000 || code >= 5000))) { code = PROTOCOL_ERROR; }
+            Close(code);                                // 回送对端的状态码，写完后关闭连接
+            return false;
+        }
+        case PING:
+            Push_(Encode(PONG, payload, len), true);
+            return true;
+        case PONG:
+            return true;
+        case TEXT:
+        case BINARY:
+            if (fragment_) { break; }
+            if (fin) {
+                OnMessage_(opcode, payload, len);
+                return true;
+            }
+            fragment_ = opcode;
+            message_.assign(payload, len);
+            return true;
+        case CONTINUATION:
+            if (!fragment_) { break; }
+            message_.append(payload, len);
+            if (fin) {
+                OnMessage_(fragment_, message_.data(), message_.size());
+                fragment_ = 0;
+                message_.clear();
+            }
+            return true;
+        default:
+            break;
+    }
+    Close(PROTOCOL_ERROR);
+    return false;
+}
+
+void WebSocketSession::OnMessage_(int opcode, const char* data, size_t len) {    // 收到的消息转发给所有订阅的连接
+    Metrics::Add(Metrics::WS_MESSAGES);
+    WebSocketHub::Instance()->Broadcast(data, len, opcode == BINARY);
+}
+
+bool WebSocketSession::Push(const WsFrame& frame) {
+    return Push_(frame, false);
+}
+
+bool WebSocketSession::Push_(const WsFrame& frame, bool control) {    // 自己的控制帧不计入上限
+    lock_guard<mutex> locker(mtx_);
+    if (closing_ || overflow_) { return false; }
+    if (!control && bytes_ + frame->size() > maxQueue) {
+        overflow_ = true;           // 帧可能正在被写出，不能在这里清空队列；连接多半挂着写事件，也要唤醒反应堆来断开
+        idle_ = false;
+        return true;
+    }
+    queue_.push_back(frame);
+    bytes_ += frame->size();
+    if (!idle_) { return false; }
+    idle_ = false;
+    return true;
+}
+
+bool WebSocketSession::Close(uint16_t code) {
+    char payload[2] = { static_cast<char>(code >> 8), static_cast<char>(code) };
+    WsFrame frame = Encode(CLOSE, payload, sizeof(payload));
+    lock_guard<mutex> locker(mtx_);
+    if (closing_ || overflow_) { return false; }
+    closing_ = true;
+    queue_.push_back(frame);
+    bytes_ += frame->size();
+    if (!idle_) { return false; }
+    idle_ = false;
+    return true;
+}
+
+size_t WebSocketSession::Collect(vector<iovec>& iov, size_t budget) {
+    iov.clear();
+    size_t total = 0;
+    lock_guard<mutex> locker(mtx_);
+    size_t offset = offset_;
+    for (const WsFrame& frame : queue_) {       // 其他线程只会在队尾追加，已有元素和帧内容都不会移动
+        if (total >= budget || iov.size() >= IOV_MAX) { break; }
+        iov.push_back({ const_cast<char*>(frame->data()) + offset, frame->size() - offset });
+        total += frame->size() - offset;
+        offset = 0;
+    }
+    return total;
+}
+
+void WebSocketSession::Consume(size_t n) {
+    lock_guard<mutex> locker(mtx_);
+    bytes_ -= n;
+    while (n > 0) {
+        size_t rest = queue_.front()->size() - offset_;
+        if (n < rest) {
+            offset_ += n;
+            return;
+        }
+        n -= rest;
+        offset_ = 0;
+        queue_.pop_front();
+    }
+}
+
+size_t WebSocketSession::Pending() {
+    lock_guard<mutex> locker(mtx_);
+    return bytes_;
+}
+
+bool WebSocketSession::Closing() {
+    lock_guard<mutex> locker(mtx_);
+    return closing_;
+}
+
+bool WebSocketSession::Overflow() {
+    lock_guard<mutex> locker(mtx_);
+    return overflow_;
+}
+
+bool WebSocketSession::Arm(bool write) {
+    lock_guard<mutex> locker(mtx_);
+    bool want = write || bytes_ > 0;
+    idle_ = !want;
+    return want;
+}
+
+WebSocketHub* WebSocketHub::Instance() {
+    static WebSocketHub hub;
+    return &hub;
+}
+
+void WebSocketHub::SetWaker(Waker waker) {
+    lock_guard<mutex> locker(mtx_);
+    waker_ = move(waker);
+}
+
+void WebSocketHub::Add(const shared_ptr<WebSocketSession>& session) {
+    lock_guard<mutex> locker(mtx_);
+    session->slot_ = sessions_.size();
+    sessions_.push_back(session);
+    if (goingAway_) { session->Close(WebSocketSession::GOING_AWAY); }
+}
+
+void WebSocketHub::Remove(const WebSocketSession* session) {
+    lock_guard<mutex> locker(mtx_);
+    size_t i = session->slot_;
+    if (i >= sessions_.size() || sessions_[i].get() != session) { return; }
+    if (i + 1 < sessions_.size()) {             // 与末尾交换后删除，顺序无关
+        sessions_[i] = move(sessions_.back());
+        sessions_[i]->slot_ = i;
+    }
+    sessions_.pop_back();
+}
+
+// 持锁期间只做入队和唤醒（唤醒按反应堆合并，多数情况下只是一次加锁追加），不做任何套接字写
+size_t WebSocketHub::Broadcast(const char* data, size_t len, bool binary) {
+    WsFrame frame = WebSocketSession::Encode(binary ? WebSocketSession::BINARY : WebSocketSession::TEXT, data, len);
+    lock_guard<mutex> locker(mtx_);
+    for (const auto& session : sessions_) {
+        if (session->Push(frame) && waker_) { waker_(session->owner_, session->fd_); }
+    }
+    Metrics::Add(Metrics::WS_BROADCASTS);
+    Metrics::Add(Metrics::WS_FRAMES, sessions_.size());
+    return sessions_.size();
+}
+
+void WebSocketHub::GoAway() {
+    lock_guard<mutex> locker(mtx_);
+    if (goingAway_) { return; }
+    goingAway_ = true;
+    for (const auto& session : sessions_) {
+        if (session->Close(WebSocketSession::GOING_AWAY) && waker_) { waker_(session->owner_, session->fd_); }
+    }
+}
+
+size_t WebSocketHub::Size() {
+    lock_guard<mutex> locker(mtx_);
+    return sessions_.size();
+}
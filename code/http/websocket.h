@@ -0,0 +1,120 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../buffer/buffer.h"
+#include "../log/log.h"
+#include "../metrics/metrics.h"
+#include "httprequest.h"
+
+/*
+ * WebSocket（RFC 6455）：请求路径上完成 Upgrade 握手后，连接交给 WebSocketSession。
+ * 收到的帧在读缓冲区中原地去掩码（SSE2/AVX2 每次 16/32 字节），完整的消息交给 WebSocketHub 广播。
+ * 广播只编码一次，同一个引用计数的帧挂到每个订阅连接的发送队列，由各连接的工作线程写出；
+ * 发送队列超过上限的慢连接被断开，不拖累其他连接，也不会无限占用内存。
+ */
+typedef std::shared_ptr<const std::string> WsFrame;
+
+class WebSocketSession {
+public:
+    enum OPCODE {
+        CONTINUATION = 0x0,
+        TEXT = 0x1,
+        BINARY = 0x2,
+        CLOSE = 0x8,
+        PING = 0x9,
+        PONG = 0xA,
+    };
+
+    enum CLOSE_CODE {
+        NORMAL = 1000,
+        GOING_AWAY = 1001,
+        PROTOCOL_ERROR = 1002,
+        TOO_BIG = 1009,
+    };
+
+    static const char* const PATH;      // 接受升级的请求路径
+    static size_t maxMessage;           // 单条消息（含分片）上限
+    static size_t maxQueue;             // 发送队列上限，超过即视为慢连接
+
+    static bool IsUpgrade(const HttpRequest& request);     // GET PATH，带 Upgrade: websocket 和 Sec-WebSocket-Key
+    static WsFrame Encode(int opcode, const char* data, size_t len);   // 服务端帧不加掩码
+
+    WebSocketSession(int fd, int owner);
+
+    int Fd() const { return fd_; }
+    int Owner() const { return owner_; }   // 连接所属的反应堆
+
+    // 以下由处理该连接的工作线程调用
+    size_t Accept(const std::string& key);  // 排入 101 响应，返回其长度
+    void OnData(Buffer& in);                // 处理收到的完整帧，协议错误时排入关闭帧
+    size_t Collect(std::vector<iovec>& iov, size_t budget);    // 队首的若干帧，写完之前帧不会出队
+    void Consume(size_t n);
+
+    // 以下可由任意线程调用，返回 true 表示连接正在等读事件，需要反应堆改挂写事件
+    bool Push(const WsFrame& frame);
+    bool Close(uint16_t code);              // 排入关闭帧，之后不再接受新的帧
+
+    size_t Pending();
+    bool Closing();
+    bool Overflow();
+
+    bool Arm(bool write);                   // 反应堆线程重新挂 epoll 前调用：返回是否要写事件，否则记下空闲
+
+private:
+    friend class WebSocketHub;
+
+    bool Push_(const WsFrame& frame, bool control);
+    bool OnFrame_(int opcode, bool fin, char* payload, size_t len);
+    void OnMessage_(int opcode, const char* data, size_t len);
+
+    static const size_t MAX_CONTROL = 125;
+
+    const int fd_;
+    const int owner_;
+    size_t slot_;                   // 在 WebSocketHub 中的下标，由其加锁维护
+
+    int fragment_;                  // 分片消息的类型，0 表示不在分片中
+    std::string message_;           // 分片消息的累积内容
+
+    std::mutex mtx_;                // 保护以下发送队列状态
+    std::deque<WsFrame> queue_;
+    size_t offset_;                 // 队首帧已写出的字节数
+    size_t bytes_;                  // 队列中尚未写出的字节数
+    bool idle_;                     // 已挂读事件且队列为空，下一次 Push 需要唤醒
+    bool closing_;
+    bool overflow_;
+};
+
+class WebSocketHub {
+public:
+    typedef std::function<void(int owner, int fd)> Waker;
+
+    static WebSocketHub* Instance();
+
+    void SetWaker(Waker waker);         // 请求连接所属反应堆改挂写事件
+    void Add(const std::shared_ptr<WebSocketSession>& session);
+    void Remove(const WebSocketSession* session);
+
+    size_t Broadcast(const char* data, size_t len, bool binary = false);    // 返回收到的连接数
+    void GoAway();                      // 服务器排空：所有连接发送 1001 后关闭
+    size_t Size();
+
+private:
+    WebSocketHub() : goingAway_(false) {}
+
+    std::mutex mtx_;
+    std::vector<std::shared_ptr<WebSocketSession>> sessions_;
+    Waker waker_;
+    bool goingAway_;
+};
+
+#endif //WEBSOCKET_H
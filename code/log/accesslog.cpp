@@ -0,0 +1,103 @@
+#include "accesslog.h"
+#include <assert.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "timecache.h"
+
+using namespace std;
+
+AccessLog::AccessLog() {
+    isOpen_ = false;
+    sampleRate_ = 0;
+    slowUs_ = 0;
+    fp_ = nullptr;
+    dropped_ = 0;
+}
+
+AccessLog::~AccessLog() {
+    if (writeThread_ && writeThread_->joinable()) {
+        while (!deque_->empty()) {
+            deque_->flush();
+        }
+        deque_->Close();
+        writeThread_->join();
+    }
+    if (fp_) {
+        fclose(fp_);
+    }
+}
+
+AccessLog* AccessLog::Instance() {
+    static AccessLog inst;
+    return &inst;
+}
+
+void AccessLog::init(const char* path, int sampleRate, int slowMs, int maxQueueSize) {
+    assert(path && sampleRate >= 0 && slowMs >= 0 && maxQueueSize > 0);
+    sampleRate_ = sampleRate;
+    slowUs_ = static_cast<int64_t>(slowMs) * 1000;
+    if (sampleRate_ == 0 && slowUs_ == 0) { return; }   // 未开启
+
+    string fileName = string(path) + "/access.log";
+    fp_ = fopen(fileName.c_str(), "a");
+    if (fp_ == nullptr) {
+        mkdir(path, 0777);
+        fp_ = fopen(fileName.c_str(), "a");
+    }
+    assert(fp_ != nullptr);
+
+    deque_.reset(new BlockDeque<string>(maxQueueSize));
+    writeThread_.reset(new thread([this] { AsyncWrite_(); }));
+    isOpen_ = true;
+}
+
+bool AccessLog::SetAffinity(const cpu_set_t& cpus) {
+    if (!writeThread_) { return false; }
+    return pthread_setaffinity_np(writeThread_->native_handle(), sizeof(cpus), &cpus) == 0;
+}
+
+bool AccessLog::ShouldLog(const AccessRecord& rec) const {
+    if (!isOpen_) { return false; }
+    if (rec.status >= 400) { return true; }                     // 错误总是记录
+    if (slowUs_ > 0 && rec.totalUs >= slowUs_) { return true; }  // 慢请求总是记录
+    if (sampleRate_ == 0) { return false; }
+    static thread_local uint32_t seq = 0;                        // 线程私有计数，不共享缓存行
+    return ++seq % static_cast<uint32_t>(sampleRate_) == 0;
+}
+
+void AccessLog::Write(const AccessRecord& rec) {
+    static thread_local string line;
+    char prefix[TimeCache::LOG_PREFIX_LEN];
+    char ip[INET_ADDRSTRLEN] = {0};
+    char tail[160];
+    size_t prefixLen = TimeCache::FormatLogPrefix(prefix);
+    inet_ntop(AF_INET, &rec.ip, ip, sizeof(ip));
+
+    line.clear();
+    line.append(prefix, prefixLen);
+    line += ip;
+    line += " \"";
+    line += rec.method->empty() ? "-" : *rec.method;
+    line += ' ';
+    line += rec.path->empty() ? "-" : *rec.path;
+    line += " HTTP/";
+    line += rec.version->empty() ? "-" : *rec.version;
+    int n = snprintf(tail, sizeof(tail), "\" %d %zu queue=%lldus parse=%lldus total=%lldus\n",
+                    rec.status, rec.bytes, static_cast<long long>(rec.queueUs),
+                    static_cast<long long>(rec.parseUs), static_cast<long long>(rec.totalUs));
+    line.append(tail, n);
+
+    if (!deque_->try_push(line)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);   // 后台写不过来时丢弃，不阻塞工作线程
+    }
+}
+
+void AccessLog::AsyncWrite_() {
+    string str;
+    while (deque_->pop(str)) {
+        fputs(str.c_str(), fp_);
+        if (deque_->empty()) {
+            fflush(fp_);            // 队列取空时再刷盘，避免逐行 fflush
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <sched.h>
+#include <atomic>
+#include <memory>
+#include <netinet/in.h>
+#include "blockqueue.h"
+
+// 单个请求的访问记录，字段在 HttpConn::process 和写完成时填充
+struct AccessRecord {
+    struct in_addr ip;
+    const std::string* method;
+    const std::string* path;
+    const std::string* version;
+    int status;
+    size_t bytes;           // 实际发送的字节数（头部 + 文件）
+    int64_t queueUs;        // 读事件就绪到工作线程开始处理
+    int64_t parseUs;        // HttpRequest::parse 耗时
+    int64_t totalUs;        // 读事件就绪到响应写完
+};
+
+// 访问日志：按 1/N 采样写入独立文件，错误和慢请求总是记录。
+// 采样计数是线程私有的，格式化在调用线程完成，落盘由后台线程负责，队列满时直接丢弃。
+class AccessLog {
+public:
+    static AccessLog* Instance();
+
+    // sampleRate: 每 N 个请求记录一个，0 关闭；slowMs: 超过该耗时总是记录，0 关闭
+    void init(const char* path, int sampleRate, int slowMs, int maxQueueSize = 4096);
+
+    bool IsOpen() const { return isOpen_; }
+    bool SetAffinity(const cpu_set_t& cpus);    // 绑定写线程，需在 init 之后调用
+
+    bool ShouldLog(const AccessRecord& rec) const;   // 采样判断，未命中时调用方无需格式化
+
+    void Write(const AccessRecord& rec);
+
+    size_t DropCount() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    AccessLog();
+    ~AccessLog();
+    void AsyncWrite_();
+
+    bool isOpen_;
+    int sampleRate_;
+    int64_t slowUs_;
+    FILE* fp_;
+    std::atomic<size_t> dropped_;
+    std::unique_ptr<BlockDeque<std::string>> deque_;
+    std::unique_ptr<std::thread> writeThread_;
+};
+
+#endif //ACCESS_LOG_H
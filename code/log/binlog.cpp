@@ -0,0 +1,267 @@
+#include "binlog.h"
+#include <stdio.h>
+#include <assert.h>
+
+namespace BinLog {
+
+void Encoder::Raw_(ArgType type, const void* data, size_t n) {
+    if (len_ + 1 + n > cap_) { return; }    // 放不下的参数直接丢弃
+    buf_[len_++] = static_cast<char>(type);
+    memcpy(buf_ + len_, data, n);
+    len_ += n;
+    argc_++;
+}
+
+void Encoder::Str_(const char* s, size_t n) {
+    if (!s) { s = "(null)"; n = 6; }
+    if (n > MAX_STR) { n = MAX_STR; }
+    if (len_ + 3 > cap_) { return; }
+    if (len_ + 3 + n > cap_) { n = cap_ - len_ - 3; }
+    uint16_t len16 = static_cast<uint16_t>(n);
+    buf_[len_++] = static_cast<char>(ARG_STR);
+    memcpy(buf_ + len_, &len16, sizeof(len16));
+    memcpy(buf_ + len_ + sizeof(len16), s, n);
+    len_ += sizeof(len16) + n;
+    argc_++;
+}
+
+namespace {
+
+struct Arg {                // 解码后的单个参数
+    ArgType type;
+    int64_t i;
+    uint64_t u;
+    double d;
+    const char* s;
+    uint16_t slen;
+};
+
+class ArgReader {
+public:
+    ArgReader(const char* args, size_t len, uint8_t argc): p_(args), end_(args + len), left_(argc) {}
+
+    bool Next(Arg& a) {
+        if (left_ == 0 || p_ >= end_) { return false; }
+        a.type = static_cast<ArgType>(*p_++);
+        if (a.type == ARG_STR) {
+            if (end_ - p_ < 2) { return false; }
+            memcpy(&a.slen, p_, 2);
+            p_ += 2;
+            if (end_ - p_ < a.slen) { return false; }
+            a.s = p_;
+            p_ += a.slen;
+        }
+        else {
+            if (end_ - p_ < 8) { return false; }
+            memcpy(&a.u, p_, 8);
+            memcpy(&a.i, p_, 8);
+            memcpy(&a.d, p_, 8);
+            p_ += 8;
+        }
+        left_--;
+        return true;
+    }
+
+private:
+    const char* p_;
+    const char* end_;
+    uint8_t left_;
+};
+
+void AppendSpec(std::string& out, const char* spec, const Arg* a, bool has) {
+    char buf[128];
+    char conv = spec[strlen(spec) - 1];
+    int n = 0;
+    if (!has) {
+        out += "<?>";
+        return;
+    }
+    switch (conv) {
+        case 'c':
+            n = snprintf(buf, sizeof(buf), spec, static_cast<int>(a->i));
+            break;
+        case 'd': case 'i':
+            n = snprintf(buf, sizeof(buf), spec, a->type == ARG_DOUBLE ? static_cast<long long>(a->d) :
+                                                  static_cast<long long>(a->i));
+            break;
+        case 'u': case 'x': case 'X': case 'o':
+            n = snprintf(buf, sizeof(buf), spec, a->type == ARG_DOUBLE ? static_cast<unsigned long long>(a->d) :
+                                                  static_cast<unsigned long long>(a->u));
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            n = snprintf(buf, sizeof(buf), spec, a->type == ARG_DOUBLE ? a->d :
+                                                  a->type == ARG_INT ? static_cast<double>(a->i) : static_cast<double>(a->u));
+            break;
+        case 'p':
+            n = snprintf(buf, sizeof(buf), spec, reinterpret_cast<void*>(static_cast<uintptr_t>(a->u)));
+            break;
+        case 's':
+            if (a->type == ARG_STR) {
+                std::string s(a->s, a->slen);   // 带宽度/精度时交给 snprintf，否则直接拷贝
+                if (spec[1] == 's') {
+                    out += s;
+                    return;
+                }
+                n = snprintf(buf, sizeof(buf), spec, s.c_str());
+            }
+            else {
+                out += "<?>";
+                return;
+            }
+            break;
+        default:
+            out += spec;
+            return;
+    }
+    if (n > 0) { out.append(buf, n < static_cast<int>(sizeof(buf)) ? n : sizeof(buf) - 1); }
+}
+
+}   // namespace
+
+void Format(const char* fmt, const char* args, size_t argsLen, uint8_t argc, std::string& out) {
+    ArgReader reader(args, argsLen, argc);
+    const char* p = fmt;
+    while (*p) {
+        const char* pct = strchr(p, '%');
+        if (!pct) {
+            out += p;
+            break;
+        }
+        out.append(p, pct - p);
+        p = pct + 1;
+        if (*p == '%') {
+            out += '%';
+            p++;
+            continue;
+        }
+        char spec[32] = "%";                    // 重建说明符：保留标志/宽度/精度，按参数类型加长度修饰
+        size_t k = 1;
+        while (*p && strchr("-+ #0123456789.", *p) && k < 20) { spec[k++] = *p++; }
+        while (*p && strchr("hlLqjzt", *p)) { p++; }
+        if (!*p) { break; }
+        char conv = *p++;
+        if (strchr("diuxXo", conv)) {
+            spec[k++] = 'l';
+            spec[k++] = 'l';
+        }
+        spec[k++] = conv;
+        spec[k] = '\0';
+        Arg a = {};
+        bool has = reader.Next(a);
+        AppendSpec(out, spec, &a, has);
+    }
+}
+
+void AppendJsonEscaped(const char* s, size_t n, std::string& out) {
+    static const char HEX[] = "0123456789abcdef";
+    for (size_t i = 0; i < n; i++) {
+        unsigned char ch = static_cast<unsigned char>(s[i]);
+        switch (ch) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (ch < 0x20) {
+                    out += "\\u00";
+                    out += HEX[ch >> 4];
+                    out += HEX[ch & 0xf];
+                }
+                else {
+                    out += static_cast<char>(ch);
+                }
+        }
+    }
+}
+
+void FormatArgsJson(const char* args, size_t argsLen, uint8_t argc, std::string& out) {
+    ArgReader reader(args, argsLen, argc);
+    Arg a = {};
+    char buf[32];
+    bool first = true;
+    out += '[';
+    while (reader.Next(a)) {
+        if (!first) { out += ','; }
+        first = false;
+        switch (a.type) {
+            case ARG_INT: out.append(buf, snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(a.i))); break;
+            case ARG_UINT: out.append(buf, snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(a.u))); break;
+            case ARG_DOUBLE: out.append(buf, snprintf(buf, sizeof(buf), "%.17g", a.d)); break;
+            case ARG_PTR: out.append(buf, snprintf(buf, sizeof(buf), "\"0x%llx\"", static_cast<unsigned long long>(a.u))); break;
+            case ARG_STR:
+                out += '"';
+                AppendJsonEscaped(a.s, a.slen, out);
+                out += '"';
+                break;
+            default: out += "null"; break;
+        }
+    }
+    out += ']';
+}
+
+const char* LevelName(int level) {
+    switch (level) {
+        case 0: return "debug";
+        case 2: return "warn";
+        case 3: return "error";
+        default: return "info";
+    }
+}
+
+void AppendTextLine(const char* prefix, size_t prefixLen, int level, const char* fmt,
+                    const char* args, size_t argsLen, uint8_t argc, std::string& out) {
+    static const char* const TITLE[] = { "[debug]: ", "[info] : ", "[warn] : ", "[error]: " };
+    out.append(prefix, prefixLen);
+    out += TITLE[level >= 0 && level < 4 ? level : 1];
+    Format(fmt, args, argsLen, argc, out);
+    out += '\n';
+}
+
+void AppendJsonLine(const char* prefix, size_t prefixLen, int level, const char* fmt,
+                    const char* args, size_t argsLen, uint8_t argc, std::string& out) {
+    std::string msg;
+    Format(fmt, args, argsLen, argc, msg);
+    out += "{\"time\":\"";
+    out.append(prefix, prefixLen > 0 ? prefixLen - 1 : 0);  // 去掉前缀末尾的空格
+    out += "\",\"level\":\"";
+    out += LevelName(level);
+    out += "\",\"msg\":\"";
+    AppendJsonEscaped(msg.data(), msg.size(), out);
+    out += "\",\"fmt\":\"";
+    AppendJsonEscaped(fmt, strlen(fmt), out);
+    out += "\",\"args\":";
+    FormatArgsJson(args, argsLen, argc, out);
+    out += "}\n";
+}
+
+ByteRing::ByteRing(size_t capacity): head_(0), tail_(0) {
+    size_t cap = MAX_RECORD * 2;
+    while (cap < capacity) { cap <<= 1; }    // 容量取2的幂，用掩码取模
+    cap_ = cap;
+    mask_ = cap - 1;
+    buf_.reset(new char[cap_]);
+    scratch_.reset(new char[MAX_RECORD + sizeof(RecordHead)]);
+}
+
+bool ByteRing::Push(const void* data, size_t len) {
+    assert(len <= MAX_RECORD + sizeof(RecordHead));
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    uint64_t tail = tail_.load(std::memory_order_acquire);
+    if (cap_ - (head - tail) < len) { return false; }
+    size_t pos = head & mask_;
+    size_t first = len < cap_ - pos ? len : cap_ - pos;    // 环尾放不下时分两段拷贝
+    memcpy(buf_.get() + pos, data, first);
+    memcpy(buf_.get(), static_cast<const char*>(data) + first, len - first);
+    head_.store(head + len, std::memory_order_release);
+    return true;
+}
+
+void ByteRing::CopyOut_(uint64_t pos, void* dst, size_t len) const {
+    size_t off = pos & mask_;
+    size_t first = len < cap_ - off ? len : cap_ - off;
+    memcpy(dst, buf_.get() + off, first);
+    memcpy(static_cast<char*>(dst) + first, buf_.get(), len - first);
+}
+
+}   // namespace BinLog
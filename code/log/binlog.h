@@ -0,0 +1,144 @@
+#ifndef BIN_LOG_H
+#define BIN_LOG_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+
+/*
+ * 延迟格式化日志：调用线程只保存格式串指针和原始参数，vsnprintf 推迟到后台线程，
+ * 或者以二进制写入文件后由 logdecode 离线解码。
+ *
+ * 二进制文件格式（小端）：
+ *   "BINLOG1\n"                                     文件头
+ *   'F' u32 id, u16 len, char[len]                  格式串定义，每个文件内首次出现时写入
+ *   'R' u32 id, u8 level, u8 argc, i64 timeNs,
+ *       u16 argsLen, char[argsLen]                  一条日志记录
+ * 参数编码：u8 类型 + 负载，整数/浮点/指针为8字节，字符串为 u16 长度 + 字节。
+ */
+namespace BinLog {
+
+enum ArgType : uint8_t {
+    ARG_INT = 'i',
+    ARG_UINT = 'u',
+    ARG_DOUBLE = 'f',
+    ARG_STR = 's',
+    ARG_PTR = 'p',
+};
+
+static const char FILE_MAGIC[] = "BINLOG1\n";
+static const size_t FILE_MAGIC_LEN = 8;
+static const size_t MAX_RECORD = 2048;      // 单条记录上限，超长字符串会被截断
+static const size_t MAX_STR = 512;
+
+struct RecordHead {         // 环形缓冲区中的记录头，后面紧跟编码后的参数
+    uint16_t size;          // 整条记录的字节数（含头部）
+    uint8_t level;
+    uint8_t argc;
+    uint32_t reserved;
+    int64_t timeNs;         // CLOCK_REALTIME 纳秒
+    const char* format;     // 字符串字面量，进程内一直有效
+};
+
+class Encoder {             // 把参数按类型依次写入定长缓冲区
+public:
+    Encoder(char* buf, size_t cap): buf_(buf), cap_(cap), len_(0), argc_(0) {}
+
+    template<class T>
+    void Add(const T& v) {
+        Dispatch_(v, std::integral_constant<int,
+            std::is_floating_point<T>::value ? 1 :
+            (std::is_integral<T>::value || std::is_enum<T>::value) ? (std::is_signed<T>::value ? 2 : 3) :
+            std::is_pointer<T>::value ? 4 : 0>());
+    }
+    void Add(const char* s) { Str_(s, s ? strlen(s) : 0); }
+    void Add(char* s) { Add(static_cast<const char*>(s)); }
+    void Add(const std::string& s) { Str_(s.data(), s.size()); }
+
+    size_t Size() const { return len_; }
+    uint8_t Argc() const { return argc_; }
+
+private:
+    template<class T> void Dispatch_(const T& v, std::integral_constant<int, 1>) { Double_(static_cast<double>(v)); }
+    template<class T> void Dispatch_(const T& v, std::integral_constant<int, 2>) { Int_(static_cast<int64_t>(v)); }
+    template<class T> void Dispatch_(const T& v, std::integral_constant<int, 3>) { Uint_(static_cast<uint64_t>(v)); }
+    template<class T> void Dispatch_(const T& v, std::integral_constant<int, 4>) { Ptr_(static_cast<const void*>(v)); }
+
+    void Int_(int64_t v) { Raw_(ARG_INT, &v, sizeof(v)); }
+    void Uint_(uint64_t v) { Raw_(ARG_UINT, &v, sizeof(v)); }
+    void Double_(double v) { Raw_(ARG_DOUBLE, &v, sizeof(v)); }
+    void Ptr_(const void* p) { uint64_t v = reinterpret_cast<uintptr_t>(p); Raw_(ARG_PTR, &v, sizeof(v)); }
+    void Str_(const char* s, size_t n);
+    void Raw_(ArgType type, const void* data, size_t n);
+
+    char* buf_;
+    size_t cap_;
+    size_t len_;
+    uint8_t argc_;
+};
+
+// 按 printf 格式串把编码后的参数格式化追加到 out；长度修饰符按实际参数类型重建
+void Format(const char* fmt, const char* args, size_t argsLen, uint8_t argc, std::string& out);
+
+// 以 JSON 数组形式追加原始参数，用于结构化输出
+void FormatArgsJson(const char* args, size_t argsLen, uint8_t argc, std::string& out);
+
+// 追加 JSON 转义后的字符串（不含引号）
+void AppendJsonEscaped(const char* s, size_t n, std::string& out);
+
+const char* LevelName(int level);
+
+// 生成与文本模式一致的一行日志："<时间前缀>[info] : <消息>\n"
+void AppendTextLine(const char* prefix, size_t prefixLen, int level, const char* fmt,
+                    const char* args, size_t argsLen, uint8_t argc, std::string& out);
+
+// 生成一行 JSON：{"time":..,"level":..,"msg":..,"fmt":..,"args":[..]}
+void AppendJsonLine(const char* prefix, size_t prefixLen, int level, const char* fmt,
+                    const char* args, size_t argsLen, uint8_t argc, std::string& out);
+
+class ByteRing {            // 单生产者单消费者字节环，每个写日志的线程独占一个
+public:
+    explicit ByteRing(size_t capacity);
+
+    bool Push(const void* data, size_t len);                // 生产者：空间不足返回 false
+
+    template<class F>
+    size_t Drain(F&& consume) {                             // 消费者：逐条取出记录
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        size_t n = 0;
+        while (tail < head) {
+            uint16_t size;
+            CopyOut_(tail, &size, sizeof(size));
+            CopyOut_(tail, scratch_.get(), size);
+            consume(reinterpret_cast<const RecordHead*>(scratch_.get()));
+            tail += size;
+            n++;
+        }
+        tail_.store(tail, std::memory_order_release);
+        return n;
+    }
+
+    size_t Used() const {
+        return head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_relaxed);
+    }
+    size_t Capacity() const { return cap_; }
+
+private:
+    void CopyOut_(uint64_t pos, void* dst, size_t len) const;
+
+    std::unique_ptr<char[]> buf_;
+    std::unique_ptr<char[]> scratch_;       // 消费者侧的对齐拷贝区
+    size_t cap_;
+    size_t mask_;
+    std::atomic<uint64_t> head_;            // 生产者写入位置
+    char pad_[64];                          // 隔开读写位置，避免伪共享
+    std::atomic<uint64_t> tail_;            // 消费者读取位置
+};
+
+}   // namespace BinLog
+
+#endif //BIN_LOG_H
@@ -4,7 +4,9 @@
 #include <mutex>
 #include <deque>
 #include <condition_variable>
+#include <chrono>
 #include <sys/time.h>
+#include <assert.h>
 
 template <class T> 
 class BlockDeque {
@@ -33,9 +35,13 @@ public:
 
     void push_front(const T& item);// 在队列前端添加元素
 
+    bool try_push(const T& item);// 非阻塞地在队列后端添加元素，队列已满或已关闭时返回 false
+
     bool pop(T &item);// 从队列前端移除元素
 
     bool pop(T &item, int timeout);// 具有超时机制的从队列前端移除元素
+    
+    bool pop(T &item, std::chrono::milliseconds timeout);// 毫秒级超时，超时或关闭时返回 false
 
     void flush();// 唤醒一个等待的消费者线程
 
@@ -118,7 +124,9 @@ void BlockDeque<T>::push_back(const T& item) {
         condProducer_.wait(locker);
     } 
     deq_.push_back(item);
-    condConsumer_.notify_one();
+    if (deq_.size() == 1) {     // 消费者只会在队列为空时等待，非空时不必每次唤醒
+        condConsumer_.notify_one();
+    }
 }
 
 template<class T>
@@ -128,7 +136,22 @@ void BlockDeque<T>::push_front(const T & item) {
         condProducer_.wait(locker);
     }
     deq_.push_front(item);
-    condConsumer_.notify_one();
+    if (deq_.size() == 1) {
+        condConsumer_.notify_one();
+    }
+}
+
+template<class T>
+bool BlockDeque<T>::try_push(const T& item) {
+    std::lock_guard<std::mutex> locker(mtx_);   // 判满与插入在同一把锁内，不会在 condProducer_ 上等待
+    if (isClose_ || deq_.size() >= capacity_) {
+        return false;
+    }
+    deq_.push_back(item);
+    if (deq_.size() == 1) {
+        condConsumer_.notify_one();
+    }
+    return true;
 }
 
 template<class T>
@@ -176,4 +199,19 @@ bool BlockDeque<T>::pop(T& item, int timeout) {
     return true;
 }
 
+template<class T>
+bool BlockDeque<T>::pop(T& item, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> locker(mtx_);
+    if (deq_.empty()) {
+        condConsumer_.wait_for(locker, timeout);
+        if (isClose_ || deq_.empty()) {
+            return false;
+        }
+    }
+    item = std::move(deq_.front());
+    deq_.pop_front();
+    condProducer_.notify_one();
+    return true;
+}
+
 #endif
\ No newline at end of file
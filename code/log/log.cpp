@@ -1,48 +1,100 @@
 #include "log.h"
+#include <algorithm>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 using namespace std;
 
+const int Log::FLUSH_MS;        // 以引用方式传给 chrono，需要类外定义
+
+static time_t DayEnd(const struct tm& t) {     // 次日零点
+    struct tm next = t;
+    next.tm_mday += 1;
+    next.tm_hour = next.tm_min = next.tm_sec = 0;
+    next.tm_isdst = -1;
+    return mktime(&next);
+}
+
+static size_t FileSize(FILE* fp) {
+    struct stat st;
+    return fstat(fileno(fp), &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+}
+
 Log::Log() {
-    linecount_ = 0;
     isAsync_ = false;
     writeThread_ = nullptr;
     deque_ = nullptr;
-    toDay_ = 0;
+    dayEnd_ = 0;
+    retryAt_ = 0;
+    fileSeq_ = 0;
+    maxBytes_ = 0;
+    fileBytes_ = 0;
+    compress_ = false;
+    keep_ = 0;
+    compressStop_ = false;
     fp_ = nullptr;
+    mode_ = MODE_TEXT;
+    ringSize_ = 0;
+    drainStop_ = false;
+    dropped_ = 0;
+    dictFp_ = nullptr;
+    level_ = 1;
+    unflushed_ = 0;
+    lastFlushMs_ = 0;
+    flushWanted_ = false;
 }
 
 Log::~Log() {
     if (writeThread_ && writeThread_->joinable()) {
-        while (!deque_->empty()) {
-            deque_->flush();    // 等待队列清空
+        if (deque_ && !IsDeferred()) {
+            while (!deque_->empty()) {
+                deque_->flush();    // 等待队列清空
+            }
+        }
+        drainStop_ = true;      // 延迟模式的后台线程取空所有环后退出
+        drainCond_.notify_one();
+        if (deque_) {
+            deque_->Close();    // 关闭队列
         }
-        deque_->Close();        // 关闭队列
         writeThread_->join();   // 等待写线程结束
     }
+    if (compressThread_) {
+        {
+            lock_guard<mutex> locker(compressMtx_);
+            compressStop_ = true;
+        }
+        compressCond_.notify_one();
+        compressThread_->join();
+    }
     if (fp_) {
         lock_guard<mutex> locker(mtx_);
-        flush();    // 刷新缓冲区
+        Flush_();    // 刷新缓冲区
         fclose(fp_);
     }
 }
 
-int Log::GetLevel() {   // 获取日志等级
-    lock_guard<mutex> locker(mtx_);
-    return level_;
-}
-
-void Log::SetLevel(int level) { // 设置日志等级
-    lock_guard<mutex> locker(mtx_);
-    level_ = level;
+bool Log::SetAffinity(const cpu_set_t& cpus) {
+    if (!writeThread_) { return false; }
+    return pthread_setaffinity_np(writeThread_->native_handle(), sizeof(cpus), &cpus) == 0;
 }
 
 void Log::init(int level = 1, const char* path, const char* suffix,  // 初始化日志系统
-    int maxQueueSize) {
+    int maxQueueSize, int mode) {
         isOpen_ = true;
         level_ = level;
-        if (maxQueueSize > 0) { // 如果设置了最大队列大小，使用异步写入
+        if (!writeThread_) { mode_ = mode; }  // 后台线程启动后不再切换模式
+        if (IsDeferred()) {    // 延迟格式化模式：每线程一个环，容量按每行128字节估算
+            isAsync_ = false;
+            ringSize_ = static_cast<size_t>(maxQueueSize > 0 ? maxQueueSize : 1024) * 128;
+        }
+        else if (maxQueueSize > 0) { // 如果设置了最大队列大小，使用异步写入
             isAsync_ = true;
-            if (!deque_) {
+            if (!deque_ && !writeThread_) {
                 unique_ptr<BlockDeque<std::string>> newDeque(new BlockDeque<std::string>);
                 deque_ = move(newDeque);
 
@@ -54,74 +106,57 @@ void Log::init(int level = 1, const char* path, const char* suffix,  // 初始
             isAsync_ = false;    // 否则使用同步写入
         }
 
-        linecount_ = 0;
-
         time_t timer = time(nullptr);
-        struct tm *sysTime = localtime(&timer);
-        struct tm t = *sysTime;
+        struct tm t;
+        localtime_r(&timer, &t);
         path_ = path;
         suffix_ = suffix;
-        char fileName[LOG_NAME_LEN] = {0};
-        snprintf(fileName, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s",
-                path_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, suffix_);
-        toDay_ = t.tm_mday;
+        fileSeq_ = 0;
+        string fileName;
+        FILE* fp = OpenFile_(t, true, fileName);
+        assert(fp != nullptr);
+        dayEnd_ = DayEnd(t);
 
         {
             lock_guard<mutex> locker(mtx_);
             buff_.RetrieveAll();
             if (fp_) {
-                flush();
+                Flush_();
                 fclose(fp_);
             }
+            fp_ = fp;
+            fileBytes_ = FileSize(fp_);
+            unflushed_ = 0;
+            lastFlushMs_ = NowMs_();
+        }
+        {
+            lock_guard<mutex> locker(compressMtx_);
+            curFile_ = fileName;
+        }
 
-            fp_ = fopen(fileName, "a");
-            if (fp_ == nullptr) {
-                mkdir(path_, 0777);
-                fp_ = fopen(fileName, "a");
-            }
-            assert(fp_ != nullptr);
+        if (!writeThread_) {   // 文件就绪后再启动后台线程：延迟模式格式化，同步模式定时刷新
+            std::unique_ptr<std::thread> NewThread(new thread(FlushLogThread));
+            writeThread_ = move(NewThread);
         }
+        if ((compress_ || keep_ > 0) && !compressThread_) {
+            compressThread_.reset(new thread([this] { CompressLoop_(); }));
+        }
+}
+
+void Log::SetRotate(size_t maxBytes, bool compress, int keep) {
+    maxBytes_ = maxBytes;
+    compress_ = compress;
+    keep_ = keep;
 }
 
 void Log::write(int level, const char* format, ...) {
-    struct timeval now = {0, 0};
-    gettimeofday(&now, nullptr);
-    time_t tSec = now.tv_sec;
-    struct tm *sysTime = localtime(&tSec);  // 获取当前时间
-    struct tm t = *sysTime;
+    char prefix[TimeCache::LOG_PREFIX_LEN];
+    size_t prefixLen = TimeCache::FormatLogPrefix(prefix);   // 每线程缓存的时间前缀
     va_list vaList;
 
-    if (toDay_ != t.tm_mday || (linecount_ && (linecount_ % MAX_LINES == 0))) {
-        unique_lock<mutex> locker(mtx_);
-        locker.unlock();
-
-        char newFile[LOG_NAME_LEN];
-        char tail[36] = {0};
-        snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
-
-        if (toDay_ != t.tm_mday) {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s%s%s", path_, tail, suffix_);
-            toDay_ = t.tm_mday;
-            linecount_ = 0;
-        }
-        else {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, (linecount_ / MAX_LINES), suffix_);
-        }
-
-        locker.lock();
-        flush();
-        fclose(fp_);
-        fp_ = fopen(newFile, "a");
-        assert(fp_ != nullptr);
-    }
-
     {
         unique_lock<mutex> locker(mtx_);
-        linecount_++;
-        int n = snprintf(buff_.BeginWrite(), 128, "%d-%02d-%02d %02d:%02d:%02d.%06ld ",
-                    t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
-                    t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec);
-        buff_.HasWritten(n);
+        buff_.Append(prefix, prefixLen);
         AppendLogLevelTitle_(level);
 
         va_start(vaList, format);
@@ -131,16 +166,186 @@ void Log::write(int level, const char* format, ...) {
         buff_.HasWritten(m);
         buff_.Append("\n\0", 2);
 
+        size_t len = buff_.ReadableBytes() - 1;     // 不含结尾的 '\0'
         if (isAsync_ && deque_ && !deque_->full()) {
-            deque_->push_back(buff_.RetrieveAllToStr());
+            deque_->push_back(std::string(buff_.Peek(), len));
+            if (level >= ERROR_LEVEL) {
+                flushWanted_ = true;    // 写线程写完这一行后刷新
+                deque_->flush();
+            }
         }
         else {
-            fputs(buff_.Peek(), fp_);
+            fwrite(buff_.Peek(), 1, len, fp_);
+            MaybeFlush_(len, level >= ERROR_LEVEL);
         }
         buff_.RetrieveAll();
     }
 }
 
+void Log::RotateIfNeeded_() {   // 按天或按大小切换日志文件
+    time_t now = time(nullptr);
+    bool newDay = now >= dayEnd_;
+    if (!newDay && (maxBytes_ == 0 || fileBytes_.load(std::memory_order_relaxed) < maxBytes_)) {
+        return;
+    }
+    if (now < retryAt_) { return; }
+    struct tm t;
+    localtime_r(&now, &t);
+    int seq = fileSeq_;
+    fileSeq_ = newDay ? 0 : fileSeq_ + 1;
+    string name;
+    FILE* fp = OpenFile_(t, newDay, name);
+    if (!fp) {          // 打不开新文件时继续写旧文件，过一段时间再试；dayEnd_ 和序号不变
+        fileSeq_ = seq;
+        retryAt_ = now + RETRY_SEC;
+        return;
+    }
+    retryAt_ = 0;
+    dayEnd_ = DayEnd(t);
+
+    FILE* old;
+    {
+        lock_guard<mutex> locker(mtx_);
+        old = fp_;
+        fp_ = fp;
+        fileBytes_ = FileSize(fp_);
+        unflushed_ = 0;
+        lastFlushMs_ = NowMs_();
+    }
+    fclose(old);        // 旧文件剩余的缓冲在锁外写出
+
+    lock_guard<mutex> locker(compressMtx_);
+    if (compressThread_ && name != curFile_) {      // 重新打开的是同一个文件时，它仍在写，不能压缩
+        compressQueue_.push_back(curFile_);
+        compressCond_.notify_one();
+    }
+    curFile_ = name;
+}
+
+FILE* Log::OpenFile_(const struct tm& t, bool append, string& name) {
+    char file[LOG_NAME_LEN];
+    char tail[36] = {0};
+    snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+    struct stat st;
+    for (;; fileSeq_++) {
+        if (fileSeq_ == 0) {
+            snprintf(file, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
+        }
+        else {
+            snprintf(file, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, fileSeq_, suffix_);
+        }
+        string gz = string(file) + ".gz";
+        if (stat(gz.c_str(), &st) == 0) { continue; }           // 已压缩过的文件名不再使用
+        if (!append && stat(file, &st) == 0) { continue; }      // 按大小切分时总是换一个新文件
+        break;
+    }
+
+    FILE* fp = fopen(file, "a");
+    if (fp == nullptr) {
+        mkdir(path_, 0777);
+        fp = fopen(file, "a");
+    }
+    if (fp == nullptr) { return nullptr; }
+    setvbuf(fp, nullptr, _IOFBF, FLUSH_BYTES);     // 缓冲区与刷新阈值一致，未到阈值不会提前写出
+    name = file;
+    return fp;
+}
+
+void Log::CompressLoop_() {
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);     // 只使用空闲的 CPU
+    if (compress_) {
+        vector<string> left = ListSegments_(true);     // 上次运行切出后未来得及压缩的文件
+        lock_guard<mutex> locker(compressMtx_);
+        compressQueue_.insert(compressQueue_.begin(), left.begin(), left.end());
+    }
+    Prune_();
+    while (true) {
+        string name;
+        {
+            unique_lock<mutex> locker(compressMtx_);
+            compressCond_.wait(locker, [this] { return compressStop_ || !compressQueue_.empty(); });
+            if (compressStop_) { break; }       // 未压缩的文件留给下次启动
+            name = move(compressQueue_.front());
+            compressQueue_.pop_front();
+        }
+        if (compress_ && !Compress_(name)) {
+            LOG_WARN("Log: compress %s failed", name.c_str());
+        }
+        Prune_();
+    }
+}
+
+bool Log::Compress_(const string& name) {   // 先写临时文件，完成后改名，再删除原文件
+    string gz = name + ".gz";
+    string tmp = gz + ".tmp";
+    FILE* in = fopen(name.c_str(), "rb");
+    if (!in) { return false; }
+    gzFile out = gzopen(tmp.c_str(), "wb6");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+    char buf[64 * 1024];
+    size_t n;
+    bool ok = true;
+    while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        ok = gzwrite(out, buf, static_cast<unsigned>(n)) == static_cast<int>(n);
+    }
+    ok = ok && !ferror(in);
+    struct stat st;
+    bool hasTime = fstat(fileno(in), &st) == 0;
+    fclose(in);
+    ok = gzclose(out) == Z_OK && ok;
+    if (ok && hasTime) {
+        struct timespec times[2] = { st.st_atim, st.st_mtim };     // 保留原文件的修改时间，清理时按它排序
+        utimensat(AT_FDCWD, tmp.c_str(), times, 0);
+    }
+    if (!ok || rename(tmp.c_str(), gz.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    unlink(name.c_str());
+    return true;
+}
+
+void Log::Prune_() {
+    if (keep_ <= 0) { return; }
+    vector<string> files = ListSegments_(false);
+    for (size_t i = 0; i + keep_ < files.size(); i++) {
+        unlink(files[i].c_str());
+    }
+}
+
+vector<string> Log::ListSegments_(bool onlyPlain) {    // 按修改时间从旧到新
+    string cur;
+    {
+        lock_guard<mutex> locker(compressMtx_);
+        cur = curFile_;
+    }
+    vector<pair<int64_t, string>> found;
+    DIR* dir = opendir(path_);
+    if (!dir) { return {}; }
+    size_t sufLen = strlen(suffix_);
+    while (struct dirent* ent = readdir(dir)) {
+        const char* n = ent->d_name;
+        size_t len = strlen(n);
+        if (!isdigit(static_cast<unsigned char>(n[0]))) { continue; }     // 只处理按日期命名的文件，跳过 access.log 等
+        bool gz = len > 3 && strcmp(n + len - 3, ".gz") == 0;
+        if (gz && onlyPlain) { continue; }
+        size_t end = gz ? len - 3 : len;
+        if (end < sufLen || strncmp(n + end - sufLen, suffix_, sufLen) != 0) { continue; }
+        string full = string(path_) + "/" + n;
+        struct stat st;
+        if (full == cur || stat(full.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) { continue; }
+        found.emplace_back(static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec, move(full));
+    }
+    closedir(dir);
+    sort(found.begin(), found.end());
+    vector<string> files;
+    for (auto& f : found) { files.push_back(move(f.second)); }
+    return files;
+}
+
 void Log::AppendLogLevelTitle_(int level) {
     switch (level) {
         case 0:
@@ -162,17 +367,66 @@ void Log::AppendLogLevelTitle_(int level) {
 }
 
 void Log::flush() {
-    if (isAsync_) {
-        deque_->flush();     // 如果是异步，刷新队列
+    if (IsDeferred()) {
+        drainCond_.notify_one();    // 延迟模式由后台线程负责写文件
+        return;
+    }
+    if (isAsync_ && deque_) {
+        flushWanted_ = true;
+        deque_->flush();     // 队列中的日志由写线程写完后刷新
     }
+    lock_guard<mutex> locker(mtx_);
+    if (fp_) { Flush_(); }
+}
+
+void Log::Flush_() {
     fflush(fp_);    // 刷新文件缓冲区
+    unflushed_ = 0;
+    lastFlushMs_ = NowMs_();
 }
 
-void Log::AsynWrite_() {     // 异步写入处理
+void Log::MaybeFlush_(size_t len, bool force) {
+    unflushed_ += len;
+    fileBytes_.fetch_add(len, std::memory_order_relaxed);
+    if (unflushed_ == 0) { return; }
+    if (force || unflushed_ >= FLUSH_BYTES || NowMs_() - lastFlushMs_ >= FLUSH_MS) {
+        Flush_();
+    }
+}
+
+int64_t Log::NowMs_() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+void Log::AsynWrite_() {     // 异步写入处理：队列空闲 FLUSH_MS 后也会醒来检查刷新
     string str = "";
-    while (deque_->pop(str)) {
-        lock_guard<mutex> locker(mtx_);
-        fputs(str.c_str(), fp_);    // 将字符串写入文件
+    while (true) {
+        bool got = deque_->pop(str, std::chrono::milliseconds(FLUSH_MS));
+        if (!got && drainStop_) { break; }
+        // 有 ERROR 或显式刷新请求时，等队列取空（请求前入队的行都已写出）再刷新
+        bool force = flushWanted_ && deque_->empty() && flushWanted_.exchange(false);
+        {
+            lock_guard<mutex> locker(mtx_);
+            if (got) { fwrite(str.data(), 1, str.size(), fp_); }
+            MaybeFlush_(got ? str.size() : 0, force);
+        }
+        RotateIfNeeded_();
+    }
+}
+
+void Log::TimedFlush_() {
+    while (!drainStop_) {
+        {
+            unique_lock<mutex> locker(drainMtx_);
+            drainCond_.wait_for(locker, std::chrono::milliseconds(FLUSH_MS));
+        }
+        {
+            lock_guard<mutex> locker(mtx_);
+            MaybeFlush_(0, false);
+        }
+        RotateIfNeeded_();
     }
 }
 
@@ -182,5 +436,117 @@ Log* Log::Instance() {   // 获取 Log 类的单例
 }
 
 void Log::FlushLogThread() {    // 日志刷新线程函数
-    Log::Instance()->AsynWrite_();
+    Log* log = Log::Instance();
+    if (log->IsDeferred()) {
+        log->DeferredWrite_();
+    }
+    else if (log->deque_) {
+        log->AsynWrite_();
+    }
+    else {
+        log->TimedFlush_();
+    }
+}
+
+BinLog::ByteRing* Log::LocalRing_() {   // 每个线程首次写日志时注册自己的环
+    static thread_local BinLog::ByteRing* ring = nullptr;
+    if (!ring) {
+        lock_guard<mutex> locker(ringMtx_);
+        rings_.emplace_back(new BinLog::ByteRing(ringSize_));
+        ring = rings_.back().get();
+    }
+    return ring;
+}
+
+void Log::PushRecord_(const char* rec, size_t len) {
+    BinLog::ByteRing* ring = LocalRing_();
+    size_t half = ring->Capacity() / 2;
+    size_t used = ring->Used();
+    if (!ring->Push(rec, len)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);    // 环满时丢弃，不阻塞调用线程
+    }
+    else if (used < half && used + len >= half) {
+        drainCond_.notify_one();        // 只在越过半满时唤醒一次，平时由后台线程定时轮询
+    }
+}
+
+void Log::DeferredWrite_() {
+    while (true) {
+        size_t n = DrainRings_();
+        RotateIfNeeded_();
+        if (n > 0) { continue; }
+        if (drainStop_) { break; }
+        unique_lock<mutex> locker(drainMtx_);
+        drainCond_.wait_for(locker, std::chrono::milliseconds(5));
+    }
+}
+
+size_t Log::DrainRings_() {
+    size_t n = 0;
+    lock_guard<mutex> ringLocker(ringMtx_);
+    lock_guard<mutex> locker(mtx_);
+    for (auto& ring : rings_) {
+        n += ring->Drain([this](const BinLog::RecordHead* rec) { EmitRecord_(rec); });
+    }
+    MaybeFlush_(0, false);
+    return n;
+}
+
+void Log::EmitRecord_(const BinLog::RecordHead* rec) {
+    struct timeval tv;
+    tv.tv_sec = rec->timeNs / 1000000000;
+    tv.tv_usec = (rec->timeNs % 1000000000) / 1000;
+    char prefix[TimeCache::LOG_PREFIX_LEN];
+    size_t prefixLen = TimeCache::FormatLogPrefix(prefix, tv);
+
+    if (mode_ == MODE_BINARY) {
+        EmitBinary_(rec);
+        return;
+    }
+
+    const char* args = reinterpret_cast<const char*>(rec + 1);
+    size_t argsLen = rec->size - sizeof(BinLog::RecordHead);
+    line_.clear();
+    if (mode_ == MODE_JSON) {
+        BinLog::AppendJsonLine(prefix, prefixLen, rec->level, rec->format, args, argsLen, rec->argc, line_);
+    }
+    else {
+        BinLog::AppendTextLine(prefix, prefixLen, rec->level, rec->format, args, argsLen, rec->argc, line_);
+    }
+    fwrite(line_.data(), 1, line_.size(), fp_);
+    MaybeFlush_(line_.size(), rec->level >= ERROR_LEVEL);
+}
+
+void Log::EmitBinary_(const BinLog::RecordHead* rec) {
+    if (dictFp_ != fp_) {           // 新文件：写文件头并重置格式串编号
+        fmtIds_.clear();
+        dictFp_ = fp_;
+        fseek(fp_, 0, SEEK_END);
+        if (ftell(fp_) == 0) {
+            fwrite(BinLog::FILE_MAGIC, 1, BinLog::FILE_MAGIC_LEN, fp_);
+        }
+    }
+    auto it = fmtIds_.find(rec->format);
+    uint32_t id;
+    if (it == fmtIds_.end()) {      // 首次出现的格式串先写定义
+        id = static_cast<uint32_t>(fmtIds_.size());
+        fmtIds_[rec->format] = id;
+        uint16_t len = static_cast<uint16_t>(strlen(rec->format));
+        fputc('F', fp_);
+        fwrite(&id, sizeof(id), 1, fp_);
+        fwrite(&len, sizeof(len), 1, fp_);
+        fwrite(rec->format, 1, len, fp_);
+    }
+    else {
+        id = it->second;
+    }
+    uint16_t argsLen = static_cast<uint16_t>(rec->size - sizeof(BinLog::RecordHead));
+    fputc('R', fp_);
+    fwrite(&id, sizeof(id), 1, fp_);
+    fwrite(&rec->level, sizeof(rec->level), 1, fp_);
+    fwrite(&rec->argc, sizeof(rec->argc), 1, fp_);
+    fwrite(&rec->timeNs, sizeof(rec->timeNs), 1, fp_);
+    fwrite(&argsLen, sizeof(argsLen), 1, fp_);
+    fwrite(rec + 1, 1, argsLen, fp_);
+    MaybeFlush_(sizeof(BinLog::RecordHead) + argsLen, rec->level >= ERROR_LEVEL);
 }
\ No newline at end of file
@@ -4,64 +4,158 @@
 #include <mutex>
 #include <string>
 #include <thread>
+#include <sched.h>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+#include <condition_variable>
 #include <sys/time.h>
 #include <string.h>
 #include <stdarg.h>  // vastart va_end
 #include <assert.h>
 #include <sys/stat.h>    //mkdir
+#include <deque>
 #include "blockqueue.h"
+#include "timecache.h"
+#include "binlog.h"
 #include "../buffer/buffer.h"
 
 class Log {
 public:
+    enum MODE {
+        MODE_TEXT = 0,      // 调用线程格式化，原有行为
+        MODE_DEFERRED,      // 调用线程只记录参数，后台线程格式化为文本
+        MODE_BINARY,        // 二进制记录直接落盘，由 logdecode 离线解码
+        MODE_JSON,          // 后台线程格式化为 JSON lines
+    };
+
     void init(int level, const char* path = "./log",
                 const char* suffix = ".log",
-                int maxQueueCapacity = 1024);
+                int maxQueueCapacity = 1024,
+                int mode = MODE_TEXT);
     static Log* Instance();
     static void FlushLogThread();
 
+    // 按大小切分文件（0 只按天切分），旧文件由低优先级线程压缩为 .gz，最多保留 keep 个（0 不限），需在 init 之前调用
+    void SetRotate(size_t maxBytes, bool compress, int keep);
+
     void write(int level, const char* format, ...);
-    void flush();
+    void flush();                               // 立即落盘，平时由后台线程按字节数或时间批量刷新
+
+    template<class... Args>
+    void WriteDeferred(int level, const char* format, const Args&... args);
 
-    int GetLevel();
-    void SetLevel(int level);
+    int GetLevel() const { return level_.load(std::memory_order_relaxed); }
+    void SetLevel(int level) { level_.store(level, std::memory_order_relaxed); }
     bool IsOpen() { return isOpen_; }
+    bool SetAffinity(const cpu_set_t& cpus);    // 绑定后台写线程，需在 init 之后调用
+    bool IsDeferred() const { return mode_ != MODE_TEXT; }
+    size_t DropCount() const { return dropped_.load(std::memory_order_relaxed); }  // 环满被丢弃的记录数
 
 private:
     Log();
     void AppendLogLevelTitle_(int level);
     virtual ~Log();
     void AsynWrite_();
+    // 只在后台线程调用：新文件在锁外打开，持锁只交换 fp_，旧文件在锁外关闭并交给压缩线程
+    void RotateIfNeeded_();
+    FILE* OpenFile_(const struct tm& t, bool newDay, std::string& name);
+    void CompressLoop_();                       // 压缩线程：压缩切出的文件并清理超出保留数的旧文件
+    bool Compress_(const std::string& name);
+    void Prune_();
+    std::vector<std::string> ListSegments_(bool onlyPlain);    // 目录中的历史日志文件，不含当前文件
+    void Flush_();                              // 调用者需持有 mtx_
+    void MaybeFlush_(size_t len, bool force);   // 记入未刷新字节，达到阈值时刷新；调用者需持有 mtx_
+    void TimedFlush_();                         // 同步模式的后台线程：定时刷新
+    static int64_t NowMs_();
+
+    void PushRecord_(const char* rec, size_t len);
+    BinLog::ByteRing* LocalRing_();
+    void DeferredWrite_();                      // 后台线程：轮询各线程的环并输出
+    size_t DrainRings_();
+    void EmitRecord_(const BinLog::RecordHead* rec);
+    void EmitBinary_(const BinLog::RecordHead* rec);
 
     static const int LOG_PATH_LEN = 256;
     static const int LOG_NAME_LEN = 256;
-    static const int MAX_LINES = 50000;
+    static const size_t FLUSH_BYTES = 64 * 1024;    // 未刷新字节达到该值即刷新，同时作为 stdio 缓冲区大小
+    static const int FLUSH_MS = 50;                 // 最长刷新间隔，崩溃时最多丢失这段时间的日志
+    static const int ERROR_LEVEL = 3;               // 该级别及以上立即刷新
+    static const int RETRY_SEC = 60;                // 新文件打不开时，隔这么久再试
     const char* path_;
     const char* suffix_;
 
-    int MAX_LINES_;
-    
-    int linecount_;
-    int toDay_;
+    time_t dayEnd_;             // 当天结束的时间，之后由后台线程切换到新一天的文件
+    time_t retryAt_;            // 上次切换失败后，到这个时间前不再尝试
+    int fileSeq_;               // 当天按大小切出的序号
+    size_t maxBytes_;
+    std::atomic<size_t> fileBytes_;     // 当前文件已写入的字节数
 
     bool isOpen_;
 
     Buffer buff_;   // 缓冲区
-    int level_;
+    std::atomic<int> level_;    // 每条日志都要检查，不加锁
     bool isAsync_;
+    size_t unflushed_;          // 上次刷新后写入 stdio 的字节数
+    int64_t lastFlushMs_;
+    std::atomic<bool> flushWanted_;     // 异步模式：队列中有 ERROR 日志，写线程取空队列后刷新
 
     FILE* fp_;
     std::unique_ptr<BlockDeque<std::string>> deque_;    // 阻塞队列
     std::unique_ptr<std::thread> writeThread_;          // 写线程
     std::mutex mtx_;                                     // 互斥锁
+
+    int mode_;
+    size_t ringSize_;                                    // 每线程环形缓冲区字节数
+    std::vector<std::unique_ptr<BinLog::ByteRing>> rings_;
+    std::mutex ringMtx_;                                 // 保护 rings_ 的注册与遍历
+    std::mutex drainMtx_;
+    std::condition_variable drainCond_;                  // 唤醒后台格式化线程
+    std::atomic<bool> drainStop_;
+    std::atomic<size_t> dropped_;
+    std::string line_;                                   // 后台线程复用的格式化缓冲
+    std::unordered_map<const char*, uint32_t> fmtIds_;   // 二进制模式：格式串 -> 文件内编号
+    FILE* dictFp_;                                       // fmtIds_ 所属的文件
+
+    bool compress_;
+    int keep_;
+    std::string curFile_;                                // 当前文件名，压缩线程据此跳过，受 compressMtx_ 保护
+    std::deque<std::string> compressQueue_;              // 待压缩的文件
+    std::mutex compressMtx_;
+    std::condition_variable compressCond_;
+    bool compressStop_;
+    std::unique_ptr<std::thread> compressThread_;
 };
 
+template<class... Args>
+void Log::WriteDeferred(int level, const char* format, const Args&... args) {
+    char rec[sizeof(BinLog::RecordHead) + BinLog::MAX_RECORD];
+    BinLog::Encoder enc(rec + sizeof(BinLog::RecordHead), BinLog::MAX_RECORD);
+    int expand[] = { 0, (enc.Add(args), 0)... };    // 按顺序编码每个参数
+    (void)expand;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    BinLog::RecordHead head;
+    head.size = static_cast<uint16_t>(sizeof(head) + enc.Size());
+    head.level = static_cast<uint8_t>(level);
+    head.argc = enc.Argc();
+    head.reserved = 0;
+    head.timeNs = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    head.format = format;
+    memcpy(rec, &head, sizeof(head));
+    PushRecord_(rec, head.size);
+}
+
 #define LOG_BASE(level, format, ...) \
     do {\
         Log* log = Log::Instance();\
         if (log->IsOpen() && log->GetLevel() <= level) {\
-            log->write(level, format, ##__VA_ARGS__);\
-            log->flush();\
+            if (log->IsDeferred()) {\
+                log->WriteDeferred(level, format, ##__VA_ARGS__);\
+            } else {\
+                log->write(level, format, ##__VA_ARGS__);\
+            }\
         }\
     }while (0);
     
@@ -0,0 +1,55 @@
+#include "timecache.h"
+#include <stdio.h>
+#include <string.h>
+
+TimeCache::Cache& TimeCache::Local_() {
+    static thread_local Cache cache = { -1, -1, {}, {0}, {0} };
+    return cache;
+}
+
+size_t TimeCache::FormatLogPrefix(char* buf, struct tm* t) {
+    struct timeval now = {0, 0};
+    gettimeofday(&now, nullptr);
+    return FormatLogPrefix(buf, now, t);
+}
+
+size_t TimeCache::FormatLogPrefix(char* buf, const struct timeval& now, struct tm* t) {
+    Cache& c = Local_();
+    if (now.tv_sec != c.logSec) {       // 秒数变化才重新计算日期部分
+        time_t sec = now.tv_sec;
+        localtime_r(&sec, &c.local);
+        char tmp[64];
+        snprintf(tmp, sizeof(tmp), "%04d-%02d-%02d %02d:%02d:%02d.000000 ",
+                c.local.tm_year + 1900, c.local.tm_mon + 1, c.local.tm_mday,
+                c.local.tm_hour, c.local.tm_min, c.local.tm_sec);
+        memcpy(c.prefix, tmp, LOG_PREFIX_LEN);
+        c.logSec = now.tv_sec;
+    }
+    memcpy(buf, c.prefix, LOG_PREFIX_LEN);
+    long usec = now.tv_usec;
+    for (int i = 25; i >= 20; i--) {    // 只改写6位微秒
+        buf[i] = static_cast<char>('0' + usec % 10);
+        usec /= 10;
+    }
+    if (t) { *t = c.local; }
+    return LOG_PREFIX_LEN;
+}
+
+const char* TimeCache::HttpDate() {
+    static const char* const WEEK[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+    static const char* const MONTH[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                         "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+    Cache& c = Local_();
+    time_t sec = time(nullptr);
+    if (sec != c.dateSec) {
+        struct tm g;
+        char tmp[64];
+        gmtime_r(&sec, &g);
+        snprintf(tmp, sizeof(tmp), "%s, %02d %s %04d %02d:%02d:%02d GMT",
+                WEEK[g.tm_wday], g.tm_mday, MONTH[g.tm_mon], g.tm_year + 1900,
+                g.tm_hour, g.tm_min, g.tm_sec);
+        memcpy(c.date, tmp, HTTP_DATE_LEN);
+        c.dateSec = sec;
+    }
+    return c.date;
+}
@@ -0,0 +1,35 @@
+#ifndef TIME_CACHE_H
+#define TIME_CACHE_H
+
+#include <time.h>
+#include <stddef.h>
+#include <sys/time.h>
+
+// 每线程缓存的时间格式化结果：只有秒数变化时才重新调用 localtime_r/gmtime_r，
+// 同一秒内只需改写微秒部分，避免每行日志都进入 glibc 的全局时区锁。
+class TimeCache {
+public:
+    static const size_t LOG_PREFIX_LEN = 27;    // "YYYY-mm-dd HH:MM:SS.uuuuuu "
+    static const size_t HTTP_DATE_LEN = 29;     // "Sun, 06 Nov 1994 08:49:37 GMT"
+
+    // 写入日志时间前缀（不含结尾'\0'），buf 至少 LOG_PREFIX_LEN 字节；t 可选，返回本地时间
+    static size_t FormatLogPrefix(char* buf, struct tm* t = nullptr);
+
+    // 同上，但使用给定时间（延迟格式化时使用记录中的时间戳）
+    static size_t FormatLogPrefix(char* buf, const struct timeval& now, struct tm* t = nullptr);
+
+    // 当前秒对应的 RFC 1123 日期字符串，线程内有效直到下一次调用
+    static const char* HttpDate();
+
+private:
+    struct Cache {
+        time_t logSec;                      // 日志前缀对应的秒
+        time_t dateSec;                     // Date 头部对应的秒
+        struct tm local;                    // 本地时间
+        char prefix[LOG_PREFIX_LEN + 1];    // 缓存的日志前缀
+        char date[HTTP_DATE_LEN + 1];       // 缓存的 HTTP 日期
+    };
+    static Cache& Local_();
+};
+
+#endif //TIME_CACHE_H
@@ -1,10 +1,11 @@
 #include <unistd.h>
 #include "server/webserver.h"
 
-int main() {
-    WebServer server(
-        1025, 3, 60000, false,
-        3306, "root", "root", "yourdb",
-        12, 6, true, 0, 1024);
+int main(int argc, char* argv[]) {
+    ServerConfig config;                // 默认值，可被配置文件和命令行覆盖
+    if (!config.ParseArgs(argc, argv) || !config.Validate()) {
+        return 1;
+    }
+    WebServer server(config);
     server.Start();
-}
\ No newline at end of file
+}
@@ -0,0 +1,205 @@
+#include "metrics.h"
+#include <stdio.h>
+
+using namespace std;
+
+const char* const Metrics::PATH = "/metrics";
+const char* const Metrics::CONTENT_TYPE = "text/plain; version=0.0.4";
+
+static const char* const COUNTER_NAME[] = {
+    "webserver_accepts_total",
+    "webserver_rejects_total",
+    "webserver_shed_total",
+    "webserver_limited_total",
+    "webserver_timeouts_total",
+    "webserver_bytes_in_total",
+    "webserver_bytes_out_total",
+    "webserver_h2_connections_total",
+    "webserver_h2_streams_total",
+    "webserver_tls_handshakes_total",
+    "webserver_tls_resumed_total",
+    "webserver_tls_ktls_total",
+    "webserver_tls_handshake_failures_total",
+    "webserver_websocket_upgrades_total",
+    "webserver_websocket_messages_total",
+    "webserver_websocket_broadcasts_total",
+    "webserver_websocket_frames_queued_total",
+    "webserver_websocket_slow_consumer_drops_total",
+    "webserver_proxy_requests_total",
+    "webserver_proxy_upstream_connects_total",
+    "webserver_proxy_reused_connections_total",
+    "webserver_proxy_retries_total",
+    "webserver_proxy_errors_total",
+    "webserver_proxy_spliced_bytes_total",
+};
+
+static const char* const COUNTER_HELP[] = {
+    "Accepted client connections.",
+    "Connections rejected because the server was full.",
+    "Requests rejected with 503 by admission control.",
+    "Connections or requests rejected with 429 by per-client limits.",
+    "Connections closed by the keep-alive, header, body or write timeout.",
+    "Bytes read from clients.",
+    "Bytes written to clients.",
+    "Connections that switched to HTTP/2 (prior knowledge or h2c upgrade).",
+    "HTTP/2 request streams.",
+    "Completed TLS handshakes.",
+    "TLS handshakes resumed from the session cache or a ticket.",
+    "TLS connections whose send side was offloaded to kernel TLS.",
+    "Failed TLS handshakes.",
+    "Connections upgraded to WebSocket.",
+    "WebSocket messages received from clients.",
+    "Messages broadcast to all WebSocket connections.",
+    "Broadcast frames queued on WebSocket connections.",
+    "WebSocket connections closed because their send queue exceeded websocket_queue_bytes.",
+    "Requests forwarded to a proxy upstream.",
+    "New connections opened to proxy upstreams.",
+    "Proxied requests sent on a pooled keep-alive upstream connection.",
+    "Proxied requests re-sent after a connect failure or a stale pooled connection.",
+    "Proxied requests answered with 502 or cut off in the middle of the response.",
+    "Bytes moved between sockets with splice by the proxy.",
+};
+
+static const char* const HISTOGRAM_NAME[] = {
+    "webserver_request_duration_seconds",
+    "webserver_queue_wait_seconds",
+    "webserver_parse_duration_seconds",
+};
+
+static const char* const HISTOGRAM_HELP[] = {
+    "Time from read readiness to the last byte of the response.",
+    "Time tasks spent in the thread pool queue.",
+    "Time spent in HttpRequest::parse.",
+};
+
+Metrics* Metrics::Instance() {
+    static Metrics inst;
+    return &inst;
+}
+
+Metrics::Shard& Metrics::Local_() {     // 线程首次使用时注册自己的分片
+    static thread_local Shard* shard = nullptr;
+    if (!shard) {
+        shard = Instance()->Register_();
+    }
+    return *shard;
+}
+
+Metrics::Shard* Metrics::Register_() {
+    lock_guard<mutex> locker(mtx_);
+    shards_.emplace_back(new Shard());  // 值初始化，所有计数为0
+    return shards_.back().get();
+}
+
+int Metrics::BucketIndex_(uint64_t v) {     // HDR 风格的对数-线性分桶
+    if (v < (1u << SUB_BITS)) {
+        return static_cast<int>(v);
+    }
+    if (v >= (1ull << MAX_EXP)) {
+        return OVERFLOW_BUCKET;
+    }
+    int msb = 63 - __builtin_clzll(v);
+    int sub = static_cast<int>((v >> (msb - SUB_BITS)) & ((1 << SUB_BITS) - 1));
+    return ((msb - SUB_BITS + 1) << SUB_BITS) + sub;
+}
+
+void Metrics::Observe(HISTOGRAM h, int64_t us) {
+    if (us < 0) { us = 0; }
+    Histogram& hist = Local_().hist[h];
+    Bump_(hist.buckets[BucketIndex_(us)], 1);
+    Bump_(hist.count, 1);
+    Bump_(hist.sum, static_cast<uint64_t>(us));
+}
+
+void Metrics::AddGauge(const string& name, const string& help,
+                       function<double()> fn, const char* type) {
+    lock_guard<mutex> locker(mtx_);
+    gauges_.push_back({ name, help, type, move(fn) });
+}
+
+static void AppendHeader(string& out, const char* name, const char* help, const char* type) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+string Metrics::Render() {
+    uint64_t counters[COUNTER_NUM] = {0};
+    vector<uint64_t> status(MAX_STATUS, 0);
+    vector<uint64_t> buckets(HISTOGRAM_NUM * BUCKET_NUM, 0);
+    uint64_t count[HISTOGRAM_NUM] = {0};
+    uint64_t sum[HISTOGRAM_NUM] = {0};
+    vector<Gauge> gauges;
+    {
+        lock_guard<mutex> locker(mtx_);    // 汇总各线程分片
+        for (auto& shard : shards_) {
+            for (int i = 0; i < COUNTER_NUM; i++) {
+                counters[i] += shard->counters[i].load(memory_order_relaxed);
+            }
+            for (int i = 0; i < MAX_STATUS; i++) {
+                status[i] += shard->status[i].load(memory_order_relaxed);
+            }
+            for (int h = 0; h < HISTOGRAM_NUM; h++) {
+                for (int i = 0; i < BUCKET_NUM; i++) {
+                    buckets[h * BUCKET_NUM + i] += shard->hist[h].buckets[i].load(memory_order_relaxed);
+                }
+                count[h] += shard->hist[h].count.load(memory_order_relaxed);
+                sum[h] += shard->hist[h].sum.load(memory_order_relaxed);
+            }
+        }
+        gauges = gauges_;
+    }
+
+    string out;
+    char line[160];
+    for (int i = 0; i < COUNTER_NUM; i++) {
+        AppendHeader(out, COUNTER_NAME[i], COUNTER_HELP[i], "counter");
+        out.append(line, snprintf(line, sizeof(line), "%s %llu\n", COUNTER_NAME[i],
+                                  static_cast<unsigned long long>(counters[i])));
+    }
+
+    AppendHeader(out, "webserver_requests_total", "Completed requests by status code.", "counter");
+    for (int code = 0; code < MAX_STATUS; code++) {
+        if (status[code] == 0) { continue; }
+        if (code == 0) {
+            out.append(line, snprintf(line, sizeof(line), "webserver_requests_total{code=\"other\"} %llu\n",
+                                      static_cast<unsigned long long>(status[code])));
+        }
+        else {
+            out.append(line, snprintf(line, sizeof(line), "webserver_requests_total{code=\"%d\"} %llu\n",
+                                      code, static_cast<unsigned long long>(status[code])));
+        }
+    }
+
+    for (int h = 0; h < HISTOGRAM_NUM; h++) {   // 只在2的幂边界输出累计桶，细分桶用于内部精度
+        AppendHeader(out, HISTOGRAM_NAME[h], HISTOGRAM_HELP[h], "histogram");
+        uint64_t cumulative = 0;
+        int idx = 0;
+        for (int p = SUB_BITS; p <= MAX_EXP; p++) {
+            int bound = (p - SUB_BITS + 1) << SUB_BITS;    // 第一个 >= 2^p 的桶
+            for (; idx < bound; idx++) {                   // 最后一次 bound 为 OVERFLOW_BUCKET，不含溢出桶
+                cumulative += buckets[h * BUCKET_NUM + idx];
+            }
+            out.append(line, snprintf(line, sizeof(line), "%s_bucket{le=\"%g\"} %llu\n", HISTOGRAM_NAME[h],
+                                      static_cast<double>(1ull << p) / 1e6,
+                                      static_cast<unsigned long long>(cumulative)));
+        }
+        out.append(line, snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n", HISTOGRAM_NAME[h],
+                                  static_cast<unsigned long long>(count[h])));
+        out.append(line, snprintf(line, sizeof(line), "%s_sum %.6f\n", HISTOGRAM_NAME[h], sum[h] / 1e6));
+        out.append(line, snprintf(line, sizeof(line), "%s_count %llu\n", HISTOGRAM_NAME[h],
+                                  static_cast<unsigned long long>(count[h])));
+    }
+
+    for (auto& g : gauges) {
+        AppendHeader(out, g.name.c_str(), g.help.c_str(), g.type.c_str());
+        out.append(line, snprintf(line, sizeof(line), "%s %.17g\n", g.name.c_str(), g.fn()));
+    }
+    return out;
+}
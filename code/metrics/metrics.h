@@ -0,0 +1,114 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+// 指标统计：每个线程写自己的分片（单写者，relaxed 读改写，不加锁也不共享缓存行），
+// 渲染 /metrics 时再汇总所有分片，输出 Prometheus 文本格式。
+class Metrics {
+public:
+    enum COUNTER {
+        ACCEPTS = 0,        // 接受的连接
+        REJECTS,            // 因连接数已满被拒绝的连接
+        SHEDS,              // 准入控制拒绝的请求
+        LIMITED,            // 超过单个客户端限额被拒绝的连接或请求
+        TIMEOUTS,           // 因空闲、请求头、请求体或写超时关闭的连接
+        BYTES_IN,           // 读取的字节数
+        BYTES_OUT,          // 发送的字节数
+        H2_CONNS,           // 切换到 HTTP/2 的连接
+        H2_STREAMS,         // HTTP/2 请求流
+        TLS_HANDSHAKES,     // 完成的 TLS 握手
+        TLS_RESUMED,        // 其中通过会话缓存或票据恢复的
+        TLS_KTLS,           // 其中发送方向交给内核 TLS 的
+        TLS_FAILURES,       // 失败的 TLS 握手
+        WS_UPGRADES,        // 升级为 WebSocket 的连接
+        WS_MESSAGES,        // 收到的 WebSocket 消息
+        WS_BROADCASTS,      // 广播次数
+        WS_FRAMES,          // 广播排入各连接发送队列的帧
+        WS_DROPS,           // 发送队列超限被断开的慢连接
+        PROXY_REQUESTS,     // 转发给后端的请求
+        PROXY_CONNECTS,     // 新建的后端连接
+        PROXY_REUSED,       // 复用池中空闲连接的请求
+        PROXY_RETRIES,      // 连接失败或复用的连接已被关闭后重发的请求
+        PROXY_ERRORS,       // 回复 502 或响应中途断开的请求
+        PROXY_SPLICED,      // 经管道 splice 转发的字节数
+        COUNTER_NUM,
+    };
+
+    enum HISTOGRAM {
+        REQUEST_TIME = 0,   // 读事件就绪到响应写完
+        QUEUE_WAIT,         // 线程池任务排队时间
+        PARSE_TIME,         // 请求解析时间
+        HISTOGRAM_NUM,
+    };
+
+    static const char* const PATH;              // 暴露指标的请求路径
+    static const char* const CONTENT_TYPE;
+
+    static Metrics* Instance();
+
+    static void Add(COUNTER c, uint64_t n = 1) {
+        Bump_(Local_().counters[c], n);
+    }
+
+    static void CountStatus(int code) {
+        Bump_(Local_().status[code >= 100 && code < MAX_STATUS ? code : 0], 1);
+    }
+
+    static void Observe(HISTOGRAM h, int64_t us);   // 记录一次耗时（微秒）
+
+    // 渲染时回调取值的指标，type 为 "gauge" 或 "counter"
+    void AddGauge(const std::string& name, const std::string& help,
+                  std::function<double()> fn, const char* type = "gauge");
+
+    std::string Render();
+
+private:
+    static const int MAX_STATUS = 600;
+    static const int SUB_BITS = 3;                          // 每个2的幂区间再细分 8 个桶，相对误差约 12.5%
+    static const int MAX_EXP = 27;                          // 最大约 2^27 微秒（134 秒）
+    static const int OVERFLOW_BUCKET = (MAX_EXP - SUB_BITS + 1) << SUB_BITS;   // 更大的值单独计数，只计入 +Inf
+    static const int BUCKET_NUM = OVERFLOW_BUCKET + 1;
+
+    struct Histogram {
+        std::atomic<uint64_t> buckets[BUCKET_NUM];
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;                          // 微秒
+    };
+
+    struct Shard {
+        char padHead[64];                                   // 与相邻的堆块隔开缓存行
+        std::atomic<uint64_t> counters[COUNTER_NUM];
+        std::atomic<uint64_t> status[MAX_STATUS];
+        Histogram hist[HISTOGRAM_NUM];
+        char padTail[64];
+    };
+
+    struct Gauge {
+        std::string name;
+        std::string help;
+        std::string type;
+        std::function<double()> fn;
+    };
+
+    Metrics() = default;
+
+    static void Bump_(std::atomic<uint64_t>& c, uint64_t n) {   // 只有所属线程写，无需原子加
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    static Shard& Local_();
+    static int BucketIndex_(uint64_t v);
+    Shard* Register_();
+
+    std::mutex mtx_;                                        // 保护 shards_ 与 gauges_
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::vector<Gauge> gauges_;
+};
+
+#endif //METRICS_H
@@ -0,0 +1,92 @@
+#include "affinity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fstream>
+
+using namespace std;
+
+namespace Affinity {
+
+bool ParseList(const string& list, vector<int>& cpus) {
+    cpus.clear();
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == string::npos) { end = list.size(); }
+        string item = list.substr(pos, end - pos);
+        pos = end + 1;
+        if (item.empty()) { continue; }
+        char* rest = nullptr;
+        long first = strtol(item.c_str(), &rest, 10);
+        long last = first;
+        if (*rest == '-') { last = strtol(rest + 1, &rest, 10); }
+        if (rest == item.c_str() || *rest != '\0' || first < 0 || last < first || last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (long c = first; c <= last; c++) { cpus.push_back(static_cast<int>(c)); }
+    }
+    return true;
+}
+
+string FormatList(const vector<int>& cpus) {
+    string out;
+    for (size_t i = 0; i < cpus.size(); i++) {
+        if (i) { out += ','; }
+        out += to_string(cpus[i]);
+    }
+    return out;
+}
+
+cpu_set_t ToSet(const vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus) { CPU_SET(c, &set); }
+    return set;
+}
+
+bool Pin(pthread_t thread, const vector<int>& cpus) {
+    if (cpus.empty()) { return true; }
+    cpu_set_t set = ToSet(cpus);
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+bool PinSelf(const vector<int>& cpus) {
+    return Pin(pthread_self(), cpus);
+}
+
+int CpuCount() {
+    long n = sysconf(_SC_NPROCESSORS_CONF);
+    return n > 0 ? static_cast<int>(n) : 1;
+}
+
+int NodeOf(int cpu) {       // /sys/devices/system/cpu/cpuN/ 下有 nodeM 链接
+    string dirName = "/sys/devices/system/cpu/cpu" + to_string(cpu);
+    DIR* dir = opendir(dirName.c_str());
+    if (!dir) { return 0; }
+    int node = 0;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != nullptr) {
+        if (strncmp(ent->d_name, "node", 4) == 0 && ent->d_name[4] >= '0' && ent->d_name[4] <= '9') {
+            node = atoi(ent->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+vector<int> NodeCpus(int node) {
+    vector<int> cpus;
+    ifstream in("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+    string list;
+    if (!in || !getline(in, list) || !ParseList(list, cpus) || cpus.empty()) {
+        cpus.clear();
+        for (int c = 0; c < CpuCount(); c++) { cpus.push_back(c); }
+    }
+    return cpus;
+}
+
+}   // namespace Affinity
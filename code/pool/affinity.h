@@ -0,0 +1,26 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <sched.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+// CPU 绑定与 NUMA 拓扑（读取 /sys，不依赖 libnuma）。
+// 内存按首次访问分配到所在节点，因此线程先绑核、再分配自己的数据即可保持本地性。
+namespace Affinity {
+
+bool ParseList(const std::string& list, std::vector<int>& cpus);   // "0-3,8,10-11"，空串得到空集合
+std::string FormatList(const std::vector<int>& cpus);
+
+cpu_set_t ToSet(const std::vector<int>& cpus);
+bool Pin(pthread_t thread, const std::vector<int>& cpus);   // cpus 为空时不做任何事
+bool PinSelf(const std::vector<int>& cpus);
+
+int CpuCount();                         // 已配置的 CPU 数
+int NodeOf(int cpu);                    // CPU 所在 NUMA 节点，无法获知时为 0
+std::vector<int> NodeCpus(int node);    // 节点上的全部 CPU，无法获知时返回所有 CPU
+
+}   // namespace Affinity
+
+#endif //AFFINITY_H
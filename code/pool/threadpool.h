@@ -2,30 +2,53 @@
 #define THREADPOOL_H
 
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 #include <queue>
 #include <thread>
 #include <functional>
+#include <chrono>
+#include "../metrics/metrics.h"
+#include "affinity.h"
 
+// 两条优先级通道：工作线程总是先取 HIGH。出队时按 CoDel 的思路分通道检测排队时间，
+// 某通道的排队时间持续 interval 都高于 target 即视为该通道过载，供调用方做准入控制。
 class ThreadPool {
 public:
-    explicit ThreadPool(size_t threadCount = 8): pool_(std::make_shared<Pool>()) {
+    enum LANE {
+        HIGH = 0,       // 静态文件、写回响应
+        LOW,            // 需要访问数据库的请求
+        LANE_NUM,
+    };
+
+    // cpus 非空时每个工作线程启动后绑定到这组 CPU
+    explicit ThreadPool(size_t threadCount = 8, const std::vector<int>& cpus = {}): pool_(std::make_shared<Pool>()) {
         assert(threadCount > 0);
         for (size_t i = 0; i < threadCount; i++) {
-            std::thread([pool = pool_] {
+            threads_.emplace_back([pool = pool_, cpus] {
+                Affinity::PinSelf(cpus);
                 std::unique_lock<std::mutex> locker(pool->mtx); //加锁
                 while (true) {
-                    if (!pool->tasks.empty()) {
-                        auto task = std::move(pool->tasks.front());
-                        pool->tasks.pop();
+                    int lane = !pool->tasks[HIGH].empty() ? HIGH : LOW;
+                    if (!pool->tasks[lane].empty()) {
+                        auto task = std::move(pool->tasks[lane].front());
+                        pool->tasks[lane].pop();
+                        pool->size.store(pool->size.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+                        Clock::time_point now = Clock::now();
+                        pool->UpdateCoDel(lane, now, now - task.enqueued);
                         locker.unlock();    //处理任务期间，不需要持有锁
-                        task();
+                        Metrics::Observe(Metrics::QUEUE_WAIT, std::chrono::duration_cast<std::chrono::microseconds>(
+                                now - task.enqueued).count());    // 统计排队时间
+                        task.fn();
                         locker.lock();      //处理完任务，重新尝试加锁
                     }
                     else if (pool->isClosed) break; // 如果线程池关闭，退出循环
-                    else pool->cond.wait(locker);   
+                    else {
+                        for (int i = 0; i < LANE_NUM; i++) { pool->ResetCoDel(i); }    // 队列取空，不再过载
+                        pool->cond.wait(locker);
+                    }
                 }
-            }).detach();        // 线程与 ThreadPool 对象分离
+            });
         }
     }
 
@@ -41,24 +64,71 @@ public:
             }
             pool_->cond.notify_all();
         }
-      
+        for (auto& t : threads_) {      // 等待已排队的任务执行完
+            if (t.joinable()) { t.join(); }
+        }
     }
 
     template<class F>       // 添加任务到线程池
-    void AddTask(F && task) {
+    void AddTask(F && task, LANE lane = HIGH) {
+        Clock::time_point now = Clock::now();
         {//限制locker的作用域，离开立即释放
             std::lock_guard<std::mutex> locker(pool_->mtx);
-            pool_->tasks.emplace(std::forward<F>(task));
+            pool_->tasks[lane].push(Task{ std::function<void()>(std::forward<F>(task)), now });
+            pool_->size.store(pool_->size.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
         }
         pool_->cond.notify_one();
     }
+
+    // target 为 0 时关闭过载检测
+    void SetCoDel(std::chrono::microseconds target, std::chrono::microseconds interval) {
+        std::lock_guard<std::mutex> locker(pool_->mtx);
+        pool_->target = target;
+        pool_->interval = interval;
+    }
+
+    size_t QueueSize() const {      // 当前排队的任务数，不加锁，供准入判断
+        return pool_->size.load(std::memory_order_relaxed);
+    }
+
+    bool Overloaded(LANE lane) const {
+        return pool_->overloaded[lane].load(std::memory_order_relaxed);
+    }
 private:
+    typedef std::chrono::steady_clock Clock;
+    struct Task {
+        std::function<void()> fn;       // 任务函数
+        Clock::time_point enqueued;     // 入队时间
+    };
     struct Pool {
         std::mutex mtx;                 // 互斥锁
         std::condition_variable cond;   // 条件变量
-        bool isClosed;                  // 线程池是否关闭
-        std::queue<std::function<void()>> tasks;    // 任务队列
+        bool isClosed = false;          // 线程池是否关闭
+        std::queue<Task> tasks[LANE_NUM];   // 各通道的任务队列
+        std::atomic<size_t> size{0};    // 所有通道的任务数，持锁修改
+        Clock::duration target{0};      // 可接受的排队时间
+        Clock::duration interval{0};    // 排队时间持续超过 target 多久算过载
+        Clock::time_point firstAbove[LANE_NUM];    // 排队时间首次超过 target 后的判定时刻，空表示未超过
+        std::atomic<bool> overloaded[LANE_NUM] = {};
+
+        void ResetCoDel(int lane) {     // 以下均持锁调用
+            firstAbove[lane] = Clock::time_point();
+            overloaded[lane].store(false, std::memory_order_relaxed);
+        }
+
+        void UpdateCoDel(int lane, Clock::time_point now, Clock::duration sojourn) {
+            if (target.count() == 0 || sojourn < target) {
+                ResetCoDel(lane);
+            }
+            else if (firstAbove[lane] == Clock::time_point()) {
+                firstAbove[lane] = now + interval;
+            }
+            else if (now >= firstAbove[lane]) {
+                overloaded[lane].store(true, std::memory_order_relaxed);
+            }
+        }
     };
     std::shared_ptr<Pool> pool_;        // 指向 Pool 的共享指针
+    std::vector<std::thread> threads_;  // 工作线程，析构时回收
 };
 #endif
\ No newline at end of file
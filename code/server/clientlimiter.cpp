@@ -0,0 +1,100 @@
+#include "clientlimiter.h"
+#include <time.h>
+
+void ClientLimiter::Init(int maxConns, int rate, int burst, int tableSize) {
+    maxConns_ = maxConns;
+    rate_ = rate;
+    capacity_ = static_cast<int64_t>(burst > 0 ? burst : 1) * TOKEN;
+    fullUs_ = rate > 0 ? capacity_ / rate_ : 0;
+    size_t perShard = static_cast<size_t>(tableSize / SHARD_NUM);
+    if (perShard < MAX_PROBE) { perShard = MAX_PROBE; }
+    for (Shard& shard : shards_) {
+        shard.slots.assign(perShard, Entry{ 0, 0, 0, 0 });
+    }
+}
+
+int64_t ClientLimiter::NowUs_() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);     // 精度几毫秒，足够补充令牌且更便宜
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t ClientLimiter::Hash_(uint32_t ip) {
+    ip ^= ip >> 16;             // murmur3 的收尾混合
+    ip *= 0x85ebca6b;
+    ip ^= ip >> 13;
+    ip *= 0xc2b2ae35;
+    ip ^= ip >> 16;
+    return ip;
+}
+
+void ClientLimiter::Refill_(Entry& e, int64_t now) const {
+    if (rate_ == 0 || now <= e.lastUs) { return; }
+    int64_t elapsed = now - e.lastUs;
+    e.tokens = elapsed >= fullUs_ ? capacity_ : e.tokens + elapsed * rate_;
+    if (e.tokens > capacity_) { e.tokens = capacity_; }
+    e.lastUs = now;
+}
+
+bool ClientLimiter::Idle_(const Entry& e, int64_t now) const {
+    return e.ip == 0 || (e.conns == 0 && now - e.lastUs >= fullUs_);
+}
+
+ClientLimiter::Entry* ClientLimiter::Find_(Shard& shard, uint32_t ip, int64_t now) {
+    size_t size = shard.slots.size();
+    size_t pos = (Hash_(ip) / SHARD_NUM) % size;
+    Entry* reuse = nullptr;
+    for (int i = 0; i < MAX_PROBE; i++) {
+        Entry& e = shard.slots[(pos + i) % size];
+        if (e.ip == ip) { return &e; }
+        if (e.ip == 0) {                // 空槽之后不会再有该 IP
+            if (!reuse) { reuse = &e; }
+            break;
+        }
+        if (!reuse && Idle_(e, now)) { reuse = &e; }
+    }
+    if (reuse) {
+        *reuse = Entry{ ip, 0, capacity_, now };
+    }
+    return reuse;
+}
+
+bool ClientLimiter::AcquireConn(uint32_t ip) {
+    if (maxConns_ == 0) { return true; }
+    Shard& shard = shards_[Hash_(ip) % SHARD_NUM];
+    std::lock_guard<std::mutex> locker(shard.mtx);
+    Entry* e = Find_(shard, ip, NowUs_());
+    if (!e) { return true; }            // 表已满，放行
+    if (e->conns >= static_cast<uint32_t>(maxConns_)) { return false; }
+    e->conns++;
+    return true;
+}
+
+void ClientLimiter::ReleaseConn(uint32_t ip) {
+    if (maxConns_ == 0) { return; }
+    Shard& shard = shards_[Hash_(ip) % SHARD_NUM];
+    std::lock_guard<std::mutex> locker(shard.mtx);
+    size_t size = shard.slots.size();
+    size_t pos = (Hash_(ip) / SHARD_NUM) % size;
+    for (int i = 0; i < MAX_PROBE; i++) {       // 只查找不分配：表满时放行的连接没有表项
+        Entry& e = shard.slots[(pos + i) % size];
+        if (e.ip == ip) {
+            if (e.conns > 0) { e.conns--; }
+            return;
+        }
+        if (e.ip == 0) { return; }
+    }
+}
+
+bool ClientLimiter::AllowRequest(uint32_t ip) {
+    if (rate_ == 0) { return true; }
+    Shard& shard = shards_[Hash_(ip) % SHARD_NUM];
+    std::lock_guard<std::mutex> locker(shard.mtx);
+    int64_t now = NowUs_();
+    Entry* e = Find_(shard, ip, now);
+    if (!e) { return true; }
+    Refill_(*e, now);
+    if (e->tokens < TOKEN) { return false; }
+    e->tokens -= TOKEN;
+    return true;
+}
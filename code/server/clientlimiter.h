@@ -0,0 +1,51 @@
+#ifndef CLIENTLIMITER_H
+#define CLIENTLIMITER_H
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+// 按客户端 IP 限制并发连接数和请求速率（令牌桶）。
+// 表按 IP 哈希分片，每片一把锁，片内为线性探测的开放寻址数组，探测步数有上限，每次操作 O(1)。
+// 令牌在访问时按经过的时间补充；没有连接且令牌已补满的表项等同于新表项，可被其他 IP 复用，无需后台清理。
+class ClientLimiter {
+public:
+    // maxConns 为 0 不限连接数，rate 为 0 不限速率，burst 为令牌桶容量
+    void Init(int maxConns, int rate, int burst, int tableSize);
+
+    bool Enabled() const { return maxConns_ > 0 || rate_ > 0; }
+
+    bool AcquireConn(uint32_t ip);      // 连接数已达上限返回 false
+    void ReleaseConn(uint32_t ip);
+    bool AllowRequest(uint32_t ip);     // 令牌不足返回 false
+
+private:
+    struct Entry {
+        uint32_t ip;            // 网络字节序，0 表示空槽
+        uint32_t conns;         // 当前连接数
+        int64_t tokens;         // 剩余令牌，单位为 1/1000000 个
+        int64_t lastUs;         // 上次补充令牌的时间
+    };
+    struct Shard {
+        std::mutex mtx;
+        std::vector<Entry> slots;
+    };
+
+    static const int SHARD_NUM = 64;
+    static const int MAX_PROBE = 16;            // 探测不到空槽时放行，保证最坏开销
+    static const int64_t TOKEN = 1000000;
+
+    Entry* Find_(Shard& shard, uint32_t ip, int64_t now);   // 找到或分配表项，持锁调用
+    void Refill_(Entry& e, int64_t now) const;
+    bool Idle_(const Entry& e, int64_t now) const;          // 可被复用
+    static int64_t NowUs_();
+    static uint32_t Hash_(uint32_t ip);
+
+    int maxConns_ = 0;
+    int64_t rate_ = 0;              // 每秒令牌数
+    int64_t capacity_ = 0;          // 令牌桶容量（1/1000000 个）
+    int64_t fullUs_ = 0;            // 从空到满需要的时间
+    Shard shards_[SHARD_NUM];
+};
+
+#endif //CLIENTLIMITER_H
@@ -8,18 +8,22 @@ Epoller::~Epoller() {
     close(epollFd_);
 }
 
-bool Epoller::AddFd(int fd, uint32_t events) {      // 添加文件描述符到epoll监控
+static uint64_t EventData(int fd, int owner) {      // 低 32 位为描述符，高 32 位为所属连接 + 1
+    return static_cast<uint32_t>(fd) | (static_cast<uint64_t>(owner + 1) << 32);
+}
+
+bool Epoller::AddFd(int fd, uint32_t events, int owner) {      // 添加文件描述符到epoll监控
     if (fd < 0) return false;
     epoll_event ev = {0};
-    ev.data.fd = fd;    // 设置文件描述符
+    ev.data.u64 = EventData(fd, owner);    // 设置文件描述符
     ev.events = events; // 设置事件类型
     return 0 == epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);    // 添加到epoll监控，成功返回true，失败返回false
 }
 
-bool Epoller::ModFd(int fd, uint32_t events) {      // 修改epoll中的文件描述符事件
+bool Epoller::ModFd(int fd, uint32_t events, int owner) {      // 修改epoll中的文件描述符事件
     if (fd < 0) return false;
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = EventData(fd, owner);
     ev.events = events;
     return 0 == epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev);
 }
@@ -36,10 +40,15 @@ int Epoller::Wait(int timeoutMs) {                  // 等待epoll事件，返
 
 int Epoller::GetEventFd(size_t i) const {           // 获取指定索引的事件文件描述符
     assert(i < events_.size() && i >= 0);
-    return events_[i].data.fd;
+    return static_cast<int>(events_[i].data.u64 & 0xffffffff);
 }
 
 uint32_t Epoller::GetEvents(size_t i) const {       // 获取指定索引的事件类型
     assert(i < events_.size() && i >= 0);
     return events_[i].events;
+}
+
+int Epoller::GetEventOwner(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return static_cast<int>(events_[i].data.u64 >> 32) - 1;
 }
\ No newline at end of file
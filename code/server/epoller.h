@@ -13,9 +13,10 @@ public:
     explicit Epoller(int maxEvent = 1024);
     ~Epoller();
 
-    bool AddFd(int fd, uint32_t events);
+    // owner >= 0 时事件属于该客户端连接（反向代理的后端套接字），与描述符一起放在 epoll 数据中
+    bool AddFd(int fd, uint32_t events, int owner = -1);
 
-    bool ModFd(int fd, uint32_t events);
+    bool ModFd(int fd, uint32_t events, int owner = -1);
 
     bool DelFd(int fd);
 
@@ -25,6 +26,8 @@ public:
 
     uint32_t GetEvents(size_t i) const;
 
+    int GetEventOwner(size_t i) const;  // 没有登记所属连接时返回 -1
+
 private:
     int epollFd_;   // epoll文件描述符
 
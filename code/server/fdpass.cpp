@@ -0,0 +1,103 @@
+#include "fdpass.h"
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+
+using namespace std;
+
+namespace FdPass {
+
+static const size_t MAX_FDS = 64;
+static const size_t MAX_MSG = 256;
+
+static bool MakeAddr(const string& path, struct sockaddr_un& addr) {
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) { return false; }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+int Listen(const string& path) {
+    struct sockaddr_un addr;
+    if (!MakeAddr(path, addr)) { return -1; }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) { return -1; }
+    unlink(path.c_str());                   // 旧进程留下的路径，旧的监听描述符不受影响
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool SetTimeout(int sock, int timeoutMs) {
+    struct timeval tv = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+    return setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0 &&
+           setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == 0;
+}
+
+int Connect(const string& path, int timeoutMs) {
+    struct sockaddr_un addr;
+    if (!MakeAddr(path, addr)) { return -1; }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) { return -1; }
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 || !SetTimeout(fd, timeoutMs)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool Send(int sock, const string& msg, const vector<int>& fds) {
+    if (msg.empty() || msg.size() > MAX_MSG || fds.size() > MAX_FDS) { return false; }
+    struct iovec iov = { const_cast<char*>(msg.data()), msg.size() };
+    struct msghdr hdr = {};
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int) * MAX_FDS)];
+    if (!fds.empty()) {
+        memset(control, 0, sizeof(control));
+        hdr.msg_control = control;
+        hdr.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    }
+    return sendmsg(sock, &hdr, MSG_NOSIGNAL) == static_cast<ssize_t>(msg.size());
+}
+
+bool Recv(int sock, string& msg, vector<int>& fds) {
+    char buf[MAX_MSG];
+    struct iovec iov = { buf, sizeof(buf) };
+    struct msghdr hdr = {};
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int) * MAX_FDS)];
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+    ssize_t n = recvmsg(sock, &hdr, MSG_CMSG_CLOEXEC);
+    if (n <= 0) { return false; }
+    msg.assign(buf, n);
+    fds.clear();
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+            fds.insert(fds.end(), data, data + count);
+        }
+    }
+    if (hdr.msg_flags & MSG_CTRUNC) {       // 描述符被截断，关闭已收到的并视为失败
+        for (int fd : fds) { close(fd); }
+        fds.clear();
+        return false;
+    }
+    return true;
+}
+
+}   // namespace FdPass
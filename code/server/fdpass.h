@@ -0,0 +1,22 @@
+#ifndef FDPASS_H
+#define FDPASS_H
+
+#include <string>
+#include <vector>
+
+// 热升级用的 Unix 域套接字：通过 SCM_RIGHTS 在进程间传递监听套接字。
+// 协议为单行文本命令，新进程发送 TAKEOVER，旧进程回复 FDS <n> 并附带描述符，
+// 新进程接管后回复 READY，旧进程随即停止 accept 并进入排空。
+namespace FdPass {
+
+int Listen(const std::string& path);                 // 绑定并监听控制套接字，失败返回 -1
+int Connect(const std::string& path, int timeoutMs); // 连接旧进程的控制套接字，失败返回 -1
+
+bool Send(int sock, const std::string& msg, const std::vector<int>& fds);
+bool Recv(int sock, std::string& msg, std::vector<int>& fds);   // fds 为收到的描述符（可能为空）
+
+bool SetTimeout(int sock, int timeoutMs);             // 收发超时，避免握手卡住反应堆
+
+}   // namespace FdPass
+
+#endif //FDPASS_H
@@ -1,48 +1,195 @@
 #include "webserver.h"
+#include <algorithm>
+#include <thread>
 
 using namespace std;
 
-WebServer::WebServer(
-    int port, int trigMode, int timeoutMS, bool OptLinger,
-    int sqlPort, const char* sqlUser, const char* sqlPwd,
-    const char* dbName, int connPoolNum, int threadNum,
-    bool openLog, int logLevel, int logQuesize):
-    port_(port), openLinger_(OptLinger), timeoutMS_(timeoutMS), isClose_(false),
-    timer_(new HeapTimer()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller())
+const char WebServer::BUSY_RESPONSE[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 13\r\n"
+    "Retry-After: 1\r\n"
+    "Connection: close\r\n\r\n"
+    "Server busy!\n";
+
+const char WebServer::LIMITED_RESPONSE[] =
+    "HTTP/1.1 429 Too Many Requests\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 18\r\n"
+    "Retry-After: 1\r\n"
+    "Connection: close\r\n\r\n"
+    "Too many requests\n";
+
+std::atomic<int> WebServer::stopSignal_(0);
+int WebServer::wakeFds_[WebServer::MAX_REACTORS];
+std::atomic<int> WebServer::wakeFdCount_(0);
+
+WebServer::WebServer(const ServerConfig& config):
+    config_(config), port_(config.port), openLinger_(config.optLinger), timeoutMS_(config.timeoutMs), isClose_(false),
+    draining_(false), controlFd_(-1), threadpool_(nullptr)
     {
-        srcDir_ = getcwd(nullptr, 256); // 获取当前工作目录
-        assert(srcDir_);
-        strncat(srcDir_, "/resources/", 16);    //设置资源目录
+        if (config.resources.empty()) {
+            srcDir_ = getcwd(nullptr, 256); // 获取当前工作目录
+            assert(srcDir_);
+            strncat(srcDir_, "/resources/", 16);    //设置资源目录
+        }
+        else {
+            std::string dir = config.resources;
+            if (dir.back() != '/') { dir += '/'; }
+            srcDir_ = strdup(dir.c_str());
+        }
         HttpConn::userCount = 0;                // 初始化Http连接的静态成员
         HttpConn::srcDir = srcDir_;
-        SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum);  // 初始化SQL连接池
+        HttpConn::readBuffSize = config.readBuffSize;
+        HttpConn::writeBuffSize = config.writeBuffSize;
+        HttpConn::enableH2 = config.http2 && config.proxy.empty();   // HTTP/2 流不经过反向代理，配置了路由时只用 HTTP/1.1
+        HttpConn::enableWs = config.websocket;
+        WebSocketSession::maxMessage = config.wsMaxMessage;
+        WebSocketSession::maxQueue = config.wsQueueBytes;
+        HttpResponse::SetKeepAliveTimeout(config.timeoutMs / 1000);     // Keep-Alive 头与实际空闲超时一致
+        SqlConnPool::Instance()->Init(config.sqlHost.c_str(), config.sqlPort, config.sqlUser.c_str(),
+                                      config.sqlPwd.c_str(), config.dbName.c_str(), config.connPoolNum);  // 初始化SQL连接池
 
-        InitEventMode_(trigMode);               // 初始化事件模式
-        if (!InitSocket_()){isClose_ = true;}   // 初始化套接字，失败则设置关闭标志
+        limiter_.Init(config.perIpConns, config.perIpRate, config.perIpBurst, config.ipTableSize);
+        HttpConn::allowRequest = nullptr;
+        if (config.perIpRate > 0) {             // 按解析出的请求扣令牌，而不是按读事件
+            HttpConn::allowRequest = [this](uint32_t ip) { return limiter_.AllowRequest(ip); };
+        }
+
+        vector<int> reactorCpus, workerCpus;
+        Affinity::ParseList(config.reactorCpus, reactorCpus);   // 已由 ServerConfig::Validate 校验
+        Affinity::ParseList(config.workerCpus, workerCpus);
+        if (!config.numaWorkers) {
+            threadpool_.reset(new ThreadPool(config.threadNum, workerCpus));
+        }
+        for (int i = 0; i < config.reactors; i++) {
+            unique_ptr<Reactor> r(new Reactor());
+            r->id = i;
+            r->listenFd = -1;
+            r->idleFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+            r->acceptPending = false;
+            r->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            r->draining = false;
+            r->cpu = reactorCpus.empty() ? -1 : reactorCpus[i % reactorCpus.size()];
+            r->epoller.reset(new Epoller(config.epollMaxEvents));
+            r->timer.reset(new HeapTimer());
+            if (r->wakeFd >= 0) {
+                r->epoller->AddFd(r->wakeFd, EPOLLIN);
+                wakeFds_[wakeFdCount_++] = r->wakeFd;
+            }
+            if (config.numaWorkers) {           // 线程池绑定到反应堆所在节点的 CPU
+                vector<int> cpus = Affinity::NodeCpus(Affinity::NodeOf(r->cpu));
+                if (!workerCpus.empty()) {
+                    vector<int> both;
+                    for (int c : cpus) {
+                        if (find(workerCpus.begin(), workerCpus.end(), c) != workerCpus.end()) { both.push_back(c); }
+                    }
+                    if (!both.empty()) { cpus = both; }
+                }
+                r->ownPool.reset(new ThreadPool(config.threadNum, cpus));
+            }
+            r->workers = r->ownPool ? r->ownPool.get() : threadpool_.get();
+            r->workers->SetCoDel(chrono::milliseconds(config.codelTargetMs), chrono::milliseconds(config.codelIntervalMs));
+            r->timerCount = 0;
+            reactors_.push_back(move(r));
+        }
+
+        InitMetrics_();                         // 注册指标回调
+        if (config.websocket) {
+            WebSocketHub::Instance()->SetWaker([this](int owner, int fd) { WakeWebSocket_(owner, fd); });
+        }
+        if (Trace::Enabled()) {
+            Trace::InstallSignal(SIGUSR1);      // kill -USR1 导出追踪数据
+        }
+        InitEventMode_(config.trigMode);        // 初始化事件模式
+        InitSignals_();
+
+        if (config.openLog){                    // 先初始化日志，套接字与接管过程的错误才能记下来
+            Log::Instance()->SetRotate(static_cast<size_t>(config.logRotateMb) << 20, config.logCompress, config.logKeep);
+            Log::Instance()->init(config.logLevel, "./log", ".log", config.logQueSize, config.logMode);   // 日志系统初始化
+            AccessLog::Instance()->init("./log", config.accessSample, config.accessSlowMs);  // 访问日志按采样率记录
+            InitAffinity_();
+        }
+        if (!FileCache::Open(srcDir_)) { isClose_ = true; }     // 资源目录打开一次，之后的文件都相对它查找
+        if (!InitRoutes_()) { isClose_ = true; }
+        Upstream::keepAlive = config.proxyKeepalive;
+        if (!config.proxy.empty() && !Proxy::Init(config.proxy)) {
+            isClose_ = true;
+        }
+        if (config.tls && !Tls::Init(config.tlsCert, config.tlsKey, config.tlsKtls, config.tlsTickets,
+                                     config.tlsSessionCache, HttpConn::enableH2)) {
+            isClose_ = true;
+        }
+        if (!config.takeover || !TakeOver_()) { // 接管失败时自己绑定端口（旧进程仍在监听时会失败）
+            for (auto& r : reactors_) {
+                if (!InitSocket_(r.get())) { isClose_ = true; }    // 初始化套接字，失败则设置关闭标志
+            }
+        }
+        if (!isClose_) { InitControl_(); }
 
-        if (openLog){
-            Log::Instance()->init(logLevel, "./log", ".log", logQuesize);   // 日志系统初始化
+        if (config.openLog){
             if (isClose_) {LOG_ERROR("==================== Server init error ==================");}
             else {
                 LOG_INFO("========= Server init ==============");
-                LOG_INFO("Port:%d, OpenLinger: %s", port_, OptLinger ? "true" : "false");
+                config.Dump();                  // 生效的全部配置
                 LOG_INFO("Listen Mode: %s, OpenConn MOde: %s", 
                                 (listenEvent_ & EPOLLET ? "ET" : "LT"),
                                 (connEvent_ & EPOLLET ? "ET" : "LT"));
-                LOG_INFO("LogSys level: %d", logLevel);
                 LOG_INFO("srcDir: %s", HttpConn::srcDir);
-                LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum,  threadNum);
             }
         }
 }
 
 WebServer::~WebServer() {
-    close(listenFd_);    // 关闭监听文件描述符
+    threadpool_.reset();        // 先等工作线程结束，它们的任务还会访问反应堆
+    for (auto& r : reactors_) { r->ownPool.reset(); }
+    HttpConn::allowRequest = nullptr;       // 引用了 limiter_
+    WebSocketHub::Instance()->SetWaker(nullptr);
+    for (auto& r : reactors_) {
+        if (r->listenFd >= 0) { close(r->listenFd); }  // 关闭监听文件描述符
+        if (r->idleFd >= 0) { close(r->idleFd); }
+        if (r->wakeFd >= 0) { close(r->wakeFd); }
+    }
+    wakeFdCount_ = 0;
+    if (controlFd_ >= 0) {      // 未交出时控制套接字路径仍归本进程所有
+        close(controlFd_);
+        unlink(config_.controlSocket.c_str());
+    }
     isClose_ = true;
+    Tls::Close();
     free(srcDir_);       // 释放资源目录路径
     SqlConnPool::Instance()->ClosePool();   // 关闭SQL连接池
 }
 
+void WebServer::InitMetrics_() {
+    Metrics* metrics = Metrics::Instance();
+    metrics->AddGauge("webserver_active_connections", "Open client connections.",
+                      [] { return static_cast<double>(HttpConn::userCount.load()); });
+    metrics->AddGauge("webserver_threadpool_queue_depth", "Tasks waiting in the thread pool queue.",
+                      [this] {
+                          size_t n = threadpool_ ? threadpool_->QueueSize() : 0;
+                          for (auto& r : reactors_) {
+                              if (r->ownPool) { n += r->ownPool->QueueSize(); }
+                          }
+                          return static_cast<double>(n);
+                      });
+    metrics->AddGauge("webserver_sql_free_connections", "Idle connections in the SQL pool.",
+                      [] { return static_cast<double>(SqlConnPool::Instance()->GetFreeConnCount()); });
+    metrics->AddGauge("webserver_timers", "Active connection timers.",
+                      [this] {
+                          size_t n = 0;
+                          for (auto& r : reactors_) { n += r->timerCount.load(std::memory_order_relaxed); }
+                          return static_cast<double>(n);
+                      });
+    metrics->AddGauge("webserver_log_dropped_total", "Log records dropped because a queue was full.",
+                      [] { return static_cast<double>(Log::Instance()->DropCount() + AccessLog::Instance()->DropCount()); },
+                      "counter");
+    metrics->AddGauge("webserver_websocket_connections", "Open WebSocket connections.",
+                      [] { return static_cast<double>(WebSocketHub::Instance()->Size()); });
+    metrics->AddGauge("webserver_proxy_idle_connections", "Idle keep-alive connections pooled for proxy upstreams.",
+                      [] { return static_cast<double>(Proxy::IdleCount()); });
+}
+
 void WebServer::InitEventMode_(int trigMode) {
     listenEvent_  = EPOLLRDHUP;             // 设置监听事件
     connEvent_ = EPOLLONESHOT | EPOLLRDHUP; // 设置连接事件
@@ -68,142 +215,589 @@ void WebServer::InitEventMode_(int trigMode) {
 
     HttpConn::isET = (connEvent_ & EPOLLET);    // 设置Http连接是否为边缘触发模式
 }
-void WebServer::Start() {       // 启动Web服务器
-    int timeMS = -1;            // epoll wait超时时间，-1表示无限等待
+void WebServer::InitAffinity_() {     // 绑定日志线程；反应堆与工作线程在各自启动时绑定
+    vector<int> logCpus;
+    Affinity::ParseList(config_.logCpus, logCpus);
+    if (logCpus.empty()) { return; }
+    cpu_set_t set = Affinity::ToSet(logCpus);
+    Log::Instance()->SetAffinity(set);
+    AccessLog::Instance()->SetAffinity(set);
+}
+
+// 静态文件兜底，页面别名、登录注册和内存中的端点各自注册；新的动态处理函数也加在这里
+bool WebServer::InitRoutes_() {
+    Router* router = Router::Instance();
+    if (router->Frozen()) { return true; }      // 同一进程内再次构造（基准测试）时沿用
+    typedef const Router::Match& M;
+    bool ok = true;
+    ok &= router->Add(Router::ANY, "/*path", [](HttpRequest&, M, Router::Reply&) {});  // 按请求路径返回文件
+    ok &= router->Add(Router::ANY, "/", [](HttpRequest& req, M, Router::Reply&) { req.path() = "/index.html"; });
+    for (const char* page : { "/index", "/welcome", "/video", "/picture" }) {
+        ok &= router->Add(Router::ANY, page, [](HttpRequest& req, M, Router::Reply&) { req.path() += ".html"; });
+    }
+    for (const char* page : { "/register", "/login" }) {    // 表单提交到不带后缀的路径
+        bool isLogin = strcmp(page, "/login") == 0;
+        string html = string(page) + ".html";
+        Router::Handler auth = [isLogin, html](HttpRequest& req, M, Router::Reply&) {
+            if (req.method() == "POST" && req.IsForm()) {
+                bool verified = HttpRequest::UserVerify(req.GetPost("username"), req.GetPost("password"), isLogin,
+                                                        req.ConnFd());
+                req.path() = verified ? "/welcome.html" : "/error.html";
+            }
+            else {
+                req.path() = html;
+            }
+        };
+        ok &= router->Add(Router::ANY, page, auth);
+        ok &= router->Add(Router::ANY, html, auth);
+    }
+    ok &= router->Add(Router::ANY, Metrics::PATH, [](HttpRequest&, M, Router::Reply& reply) {
+        reply.content = Metrics::Instance()->Render();
+        reply.contentType = Metrics::CONTENT_TYPE;
+    });
+    ok &= router->Add(Router::ANY, Trace::PATH, [](HttpRequest&, M, Router::Reply& reply) {
+        if (!Trace::Enabled()) { return; }      // 未开启时同普通路径
+        reply.content = Trace::DumpJson();
+        reply.contentType = "application/json";
+    });
+    router->Freeze();
+    return ok;
+}
+
+void WebServer::InitSignals_() {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnSignal_;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, nullptr);
+    sigaction(SIGINT, &sa, nullptr);
+    sa.sa_handler = SIG_IGN;            // 对端已关闭时 writev 返回 EPIPE，而不是终止进程
+    sigaction(SIGPIPE, &sa, nullptr);
+}
+
+void WebServer::OnSignal_(int sig) {    // 信号处理函数中只置位并唤醒各反应堆，排空在事件循环中进行
+    stopSignal_.store(sig, std::memory_order_relaxed);
+    WakeAll_();
+}
+
+void WebServer::WakeAll_() {
+    uint64_t one = 1;
+    int n = wakeFdCount_.load(std::memory_order_relaxed);
+    for (int i = 0; i < n; i++) {
+        ssize_t ret = write(wakeFds_[i], &one, sizeof(one));    // write 是异步信号安全的
+        (void)ret;
+    }
+}
+
+bool WebServer::TakeOver_() {       // 新进程：向旧进程要监听套接字，数量须与反应堆一致
+    const string& path = config_.controlSocket;
+    int sock = FdPass::Connect(path, 5000);
+    if (sock < 0) {
+        LOG_ERROR("Takeover: connect %s error: %d", path.c_str(), errno);
+        return false;
+    }
+    string msg;
+    vector<int> fds;
+    if (!FdPass::Send(sock, "TAKEOVER\n", {}) || !FdPass::Recv(sock, msg, fds) || msg.compare(0, 4, "FDS ") != 0) {
+        LOG_ERROR("Takeover: handshake with %s failed", path.c_str());
+        for (int fd : fds) { close(fd); }
+        close(sock);
+        return false;
+    }
+    if (fds.size() != reactors_.size()) {  // 旧进程没收到 READY，会继续服务
+        LOG_ERROR("Takeover: got %zu listen sockets, need %zu (reactors)", fds.size(), reactors_.size());
+        for (int fd : fds) { close(fd); }
+        close(sock);
+        return false;
+    }
+    for (size_t i = 0; i < fds.size(); i++) {
+        Reactor* r = reactors_[i].get();
+        SetFdNonblock(fds[i]);
+        r->epoller->AddFd(fds[i], listenEvent_ | EPOLLIN);
+        r->listenFd = fds[i];
+    }
+    if (!FdPass::Send(sock, "READY\n", {})) {     // 旧进程收不到 READY 会继续 accept，两边同时服务也不会丢连接
+        LOG_WARN("Takeover: send READY failed");
+    }
+    close(sock);
+    LOG_INFO("Takeover: %zu listen sockets from %s", fds.size(), path.c_str());
+    return true;
+}
+
+void WebServer::InitControl_() {
+    if (config_.controlSocket.empty()) { return; }
+    controlFd_ = FdPass::Listen(config_.controlSocket);
+    if (controlFd_ < 0) {
+        LOG_ERROR("Control socket %s error: %d", config_.controlSocket.c_str(), errno);
+        return;
+    }
+    reactors_[0]->epoller->AddFd(controlFd_, EPOLLIN);
+    LOG_INFO("Control socket: %s", config_.controlSocket.c_str());
+}
+
+void WebServer::DealControl_() {    // 旧进程：交出全部监听套接字，收到 READY 后停止 accept 并排空
+    int sock = accept4(controlFd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (sock < 0) { return; }
+    FdPass::SetTimeout(sock, 5000);
+    string msg;
+    vector<int> fds;
+    bool ok = FdPass::Recv(sock, msg, fds) && msg.compare(0, 8, "TAKEOVER") == 0;
+    for (int fd : fds) { close(fd); }
+    if (!ok || draining_) {
+        LOG_WARN("Control: %s", ok ? "already draining, takeover refused" : "bad request");
+        close(sock);
+        return;
+    }
+    vector<int> listenFds;
+    for (auto& r : reactors_) { listenFds.push_back(r->listenFd); }
+    ok = FdPass::Send(sock, "FDS " + to_string(listenFds.size()) + "\n", listenFds) &&
+         FdPass::Recv(sock, msg, fds) && msg.compare(0, 5, "READY") == 0;
+    for (int fd : fds) { close(fd); }
+    close(sock);
+    if (!ok) {
+        LOG_WARN("Control: takeover aborted, keep serving");
+        return;
+    }
+    LOG_INFO("Control: listen sockets handed over, draining");
+    reactors_[0]->epoller->DelFd(controlFd_);
+    close(controlFd_);                  // 路径已由新进程重新绑定，不再 unlink
+    controlFd_ = -1;
+    draining_ = true;
+    WakeAll_();
+}
+
+void WebServer::StartDrain_(Reactor* r) {   // 停止 accept，关闭空闲连接，在途请求响应后关闭
+    r->draining = true;
+    r->drainDeadline = chrono::steady_clock::now() + chrono::milliseconds(config_.drainTimeoutMs);
+    r->acceptPending = false;
+    HttpConn::isDraining = true;
+    WebSocketHub::Instance()->GoAway();     // WebSocket 连接先收到 1001 关闭帧，写完后关闭
+    if (r->listenFd >= 0) {
+        r->epoller->DelFd(r->listenFd);
+        close(r->listenFd);             // 热升级时新进程持有同一个套接字，已排队的连接不受影响
+        r->listenFd = -1;
+    }
+    int idle = 0;
+    for (auto& item : r->users) {
+        HttpConn& conn = item.second;
+        if (conn.IsClosed() || conn.IsBusy() || conn.IsWebSocket() || conn.Proxying() || conn.ToWriteBytes() > 0) { continue; }
+        char byte;              // 下一个请求已到达但还没派发的连接照常处理，响应后关闭
+        if (recv(conn.GetFd(), &byte, 1, MSG_PEEK | MSG_DONTWAIT) <= 0) {
+            CloseConn_(r, &conn);
+            idle++;
+        }
+    }
+    LOG_INFO("Reactor[%d] draining, closed %d idle connections", r->id, idle);
+}
+
+bool WebServer::DrainDone_(Reactor* r) {
+    int open = 0;
+    for (auto& item : r->users) {
+        if (!item.second.IsClosed()) { open++; }
+    }
+    if (open == 0) { return true; }
+    if (chrono::steady_clock::now() < r->drainDeadline) { return false; }
+    LOG_WARN("Reactor[%d] drain timeout, closing %d connections", r->id, open);
+    for (auto& item : r->users) {
+        if (!item.second.IsClosed()) { CloseConn_(r, &item.second); }
+    }
+    return true;
+}
+
+void WebServer::Start() {       // 启动Web服务器：反应堆0在当前线程运行，其余各占一个线程
     if (!isClose_) {LOG_INFO("============ Server start =============="); }
+    vector<thread> threads;
+    for (size_t i = 1; i < reactors_.size(); i++) {
+        threads.emplace_back(&WebServer::Loop_, this, reactors_[i].get());
+    }
+    Loop_(reactors_[0].get());
+    for (auto& t : threads) { t.join(); }
+}
+
+void WebServer::Loop_(Reactor* r) {
+    if (r->cpu >= 0) {
+        if (!Affinity::PinSelf({ r->cpu })) { LOG_WARN("Reactor[%d] pin to cpu %d failed", r->id, r->cpu); }
+        else { LOG_INFO("Reactor[%d] pinned to cpu %d, node %d", r->id, r->cpu, Affinity::NodeOf(r->cpu)); }
+    }
+    int timeMS = -1;            // epoll wait超时时间，-1表示无限等待
     while (!isClose_) {
         if (timeoutMS_ > 0) {
-            timeMS = timer_->GetNextTick();     // 获取下一个定时事件的时间
+            timeMS = r->timer->GetNextTick();   // 获取下一个定时事件的时间
+            r->timerCount.store(r->timer->size(), std::memory_order_relaxed);
+        }
+        if (r->acceptPending) { timeMS = 0; }  // 还有未取完的连接，不阻塞
+        if (r->draining && (timeMS < 0 || timeMS > DRAIN_TICK_MS)) { timeMS = DRAIN_TICK_MS; }
+        int eventCnt;
+        {
+            TRACE_SCOPE(Trace::EPOLL_WAIT, r->id);
+            eventCnt = r->epoller->Wait(timeMS);    // 等待事件
+        }
+        if (r->id == 0 && Trace::TakeDumpRequest()) {   // 收到 SIGUSR1，导出追踪数据
+            LOG_INFO("Trace dump %s", Trace::DumpToFile("./log") ? "done" : "failed");
         }
-        int eventCnt = epoller_->Wait(timeMS);  // 等待事件
+        bool listenReady = r->acceptPending;
         for (int i = 0; i < eventCnt; i++) {    // 处理每一个事件
-            int fd = epoller_->GetEventFd(i);   // 获取文件描述符
-            uint32_t events = epoller_->GetEvents(i);   // 获取事件类型
-            if (fd == listenFd_) {
-                DealListen_();                  // 处理监听事件
+            int fd = r->epoller->GetEventFd(i); // 获取文件描述符
+            uint32_t events = r->epoller->GetEvents(i); // 获取事件类型
+            if (fd == r->listenFd) {
+                listenReady = true;             // 先处理已有连接的读写，最后再批量 accept
+            }
+            else if (fd == r->wakeFd) {
+                uint64_t value;
+                ssize_t ret = read(r->wakeFd, &value, sizeof(value));
+                (void)ret;
+            }
+            else if (r->id == 0 && fd == controlFd_) {
+                DealControl_();
+            }
+            else if (r->epoller->GetEventOwner(i) >= 0) {   // 后端套接字的错误和关闭也交给会话处理
+                DealUpstream_(r, r->epoller->GetEventOwner(i));
             }
             else if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {  // 处理异常事件
-                assert(users_.count(fd) > 0);
-                CloseConn_(&users_[fd]);
+                assert(r->users.count(fd) > 0);
+                CloseConn_(r, &r->users[fd]);
             }
             else if (events & EPOLLIN) {
-                assert(users_.count(fd) > 0);
-                DealRead_(&users_[fd]);
+                assert(r->users.count(fd) > 0);
+                DealRead_(r, &r->users[fd]);
             }
             else if (events & EPOLLOUT) {
-                assert(users_.count(fd) > 0);
-                DealWrite_(&users_[fd]);
+                assert(r->users.count(fd) > 0);
+                DealWrite_(r, &r->users[fd]);
             }
             else {
                 LOG_ERROR("Unexpected event");
             }
         }
+        if (listenReady && r->listenFd >= 0) {
+            r->acceptPending = DealListen_(r);  // 处理监听事件
+        }
+        if (stopSignal_ && !draining_) {
+            LOG_INFO("Signal %d received, draining", stopSignal_.load());
+            draining_ = true;
+            WakeAll_();
+        }
+        if (draining_ && !r->draining) { StartDrain_(r); }
+        if (config_.websocket) { DealWebSocket_(r); }  // 放在本批事件之后：已取出事件的连接都已置忙
+        if (r->draining && DrainDone_(r)) { break; }
     }
+    LOG_INFO("Reactor[%d] stopped", r->id);
 }
 
 void WebServer::SendError_(int fd, const char* info) {
+    SendNow_(fd, info);
+    close(fd);
+}
+
+void WebServer::SendNow_(int fd, const char* info) {
     assert(fd > 0);
-    int ret = send(fd, info, strlen(info), 0);
-    if (ret < 0) {
-        LOG_WARN("send error to client[%d] error!", fd);
+    if (!Tls::Enabled()) {      // TLS 连接握手前无法回复明文，只能直接关闭
+        int ret = send(fd, info, strlen(info), MSG_DONTWAIT | MSG_NOSIGNAL);   // 尽力发送，不等待
+        if (ret < 0) {
+            LOG_WARN("send error to client[%d] error!", fd);
+        }
     }
-    close(fd);
+    char discard[4096];     // 读掉已到达的请求，否则带着未读数据 close 会发 RST，客户端收不到响应
+    while (recv(fd, discard, sizeof(discard), MSG_DONTWAIT) > 0) {}
+}
+
+ThreadPool::LANE WebServer::Classify_(Reactor* r, HttpConn* client) {
+    if (r->workers->QueueSize() == 0) { return ThreadPool::HIGH; }   // 无需排队时不必区分，省一次系统调用
+    char method[5];         // 本服务器只有登录、注册走 POST 并访问数据库
+    ssize_t n = recv(client->GetFd(), method, sizeof(method), MSG_PEEK | MSG_DONTWAIT);
+    if (n == sizeof(method) && memcmp(method, "POST ", 5) == 0) { return ThreadPool::LOW; }
+    return ThreadPool::HIGH;
+}
+
+bool WebServer::Admit_(Reactor* r, ThreadPool::LANE lane) {    // 排队已满或所在通道持续过载时拒绝
+    if (config_.queueLimit > 0 && r->workers->QueueSize() >= static_cast<size_t>(config_.queueLimit)) {
+        return false;
+    }
+    return !r->workers->Overloaded(lane);
+}
+
+void WebServer::Shed_(Reactor* r, HttpConn* client) {     // 在反应堆线程直接回 503，不占用工作线程
+    Metrics::Add(Metrics::SHEDS);
+    Metrics::CountStatus(503);
+    SendNow_(client->GetFd(), BUSY_RESPONSE);
+    LOG_DEBUG("Client[%d] shed, queue %zu", client->GetFd(), r->workers->QueueSize());
+    CloseConn_(r, client);
 }
 
-void WebServer::CloseConn_(HttpConn* client) {      // 关闭连接
+void WebServer::CloseConn_(Reactor* r, HttpConn* client) {      // 关闭连接
     assert(client);
+    if (client->IsClosed()) { return; }    // 定时器可能晚于关闭触发，描述符已被新连接复用，不能再 DelFd
     LOG_INFO("Client[%d] quit!", client->GetFd());
-    epoller_->DelFd(client->GetFd());
-    client->Close();             // 关闭客户端连接
+    r->epoller->DelFd(client->GetFd());
+    if (client->Close() && limiter_.Enabled()) {     // 关闭客户端连接
+        limiter_.ReleaseConn(client->GetAddr().sin_addr.s_addr);
+    }
 }
 
-void WebServer::AddClient_(int fd, sockaddr_in addr) {      // 添加新的客户端
+void WebServer::AddClient_(Reactor* r, int fd, sockaddr_in addr) {      // 添加新的客户端
     assert(fd > 0);
-    users_[fd].init(fd, addr);
+    HttpConn& conn = r->users[fd];  // 在反应堆线程中首次分配，内存落在其 NUMA 节点
+    conn.init(fd, addr, r->id);
     if (timeoutMS_ > 0) {           // 如果设置了超时时间，则添加到定时器中
-        timer_->add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, &users_[fd]));
+        r->timer->add(fd, std::min(timeoutMS_, config_.headerTimeoutMs), std::bind(&WebServer::OnTimeout_, this, r, &conn));
     }
-    epoller_->AddFd(fd, EPOLLIN | connEvent_);  // 将文件描述符添加到epoll中，并设置为非阻塞模式
-    SetFdNonblock(fd);                          // 设置文件描述符为非阻塞
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
+    r->epoller->AddFd(fd, EPOLLIN | connEvent_);   // 将文件描述符添加到epoll中（accept4 已设为非阻塞）
+    LOG_INFO("Client[%d] in!", conn.GetFd());
 }
 
-void WebServer::DealListen_() {     // 处理监听事件
+bool WebServer::DealListen_(Reactor* r) {     // 处理监听事件：每次最多取 accept_batch 个连接
     struct sockaddr_in addr;
-    socklen_t len = sizeof(addr);
-    do {
-        int fd = accept(listenFd_, (struct sockaddr *)&addr, &len);
-        if (fd <= 0) { return ;}
-        else if (HttpConn::userCount >= MAX_FD) {   // 客户端数量超过最大值
-            SendError_(fd, "Server busy!");
+    for (int n = 0; n < config_.acceptBatch; n++) {
+        socklen_t len = sizeof(addr);
+        int fd = accept4(r->listenFd, (struct sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) { continue; }
+            if ((errno == EMFILE || errno == ENFILE) && r->idleFd >= 0) {   // 描述符耗尽：腾出预留的描述符接受并拒绝连接
+                close(r->idleFd);
+                fd = accept4(r->listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd >= 0) {
+                    Metrics::Add(Metrics::REJECTS);
+                    SendError_(fd, BUSY_RESPONSE);
+                }
+                r->idleFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                LOG_WARN("Accept: out of file descriptors!");
+                continue;
+            }
+            if (errno != EAGAIN) { LOG_WARN("Accept error: %d", errno); }
+            return false;
+        }
+        if (HttpConn::userCount >= MAX_FD) {   // 客户端数量超过最大值
+            Metrics::Add(Metrics::REJECTS);
+            SendError_(fd, BUSY_RESPONSE);
             LOG_WARN("Client is full!");
-            return;
+            continue;
+        }
+        if (!limiter_.AcquireConn(addr.sin_addr.s_addr)) {    // 单个 IP 的连接数已达上限
+            Metrics::Add(Metrics::LIMITED);
+            SendError_(fd, LIMITED_RESPONSE);
+            LOG_DEBUG("Client[%d] rejected: too many connections from one IP", fd);
+            continue;
         }
-        AddClient_(fd, addr);           // 添加新客户端
-    } while (listenEvent_ & EPOLLET);   // 如果是边缘触发模式，需要循环处理
+        Metrics::Add(Metrics::ACCEPTS);
+        AddClient_(r, fd, addr);        // 添加新客户端
+    }
+    return (listenEvent_ & EPOLLET) != 0;   // 取满一批：边缘触发不会再通知，下一轮继续取；水平触发会再次通知
 }
 
-void WebServer::DealRead_(HttpConn* client) {       // 处理读事件
+void WebServer::DealRead_(Reactor* r, HttpConn* client) {       // 处理读事件
     assert(client);
-    ExtenTime_(client);                             // 延长客户端超时时间
-    threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client));  // 将读取任务添加到线程池
+    ThreadPool::LANE lane = ThreadPool::HIGH;      // 已升级、代理中或请求进行到一半的连接不参与准入，让已开始的处理做完
+    if (client->AtRequestBoundary()) {
+        lane = Classify_(r, client);
+        if (!Admit_(r, lane)) {                     // 排队过长时快速拒绝，而不是让所有请求一起变慢
+            Shed_(r, client);
+            return;
+        }
+    }
+    client->MarkReady();                            // 记录就绪时间，用于统计排队耗时
+    client->SetBusy(true);
+    r->workers->AddTask(std::bind(&WebServer::OnRead_, this, r, client), lane);  // 将读取任务添加到线程池
 }
 
-void WebServer::DealWrite_(HttpConn* client) {      // 处理写事件
+void WebServer::DealWrite_(Reactor* r, HttpConn* client) {      // 处理写事件
     assert(client);
-    ExtenTime_(client);                             // 延长客户端超时时间
-    threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client));    // 将写入任务添加到线程池
+    client->SetBusy(true);
+    r->workers->AddTask(std::bind(&WebServer::OnWrite_, this, r, client));    // 将写入任务添加到线程池
 }
 
-void WebServer::ExtenTime_(HttpConn* client) {      // 延长客户端超时时间
+// 广播线程只把连接放进所属反应堆的列表并唤醒它，连接的 epoll 状态只在这里（以及持有它的工作线程交回时）改变
+void WebServer::WakeWebSocket_(int owner, int fd) {
+    Reactor* r = reactors_[owner].get();
+    bool first;
+    {
+        lock_guard<mutex> locker(r->wsMtx);
+        first = r->wsReady.empty();
+        r->wsReady.push_back(fd);
+    }
+    if (first && r->wakeFd >= 0) {          // 列表非空时反应堆已被唤醒过，不重复写 eventfd
+        uint64_t one = 1;
+        ssize_t ret = write(r->wakeFd, &one, sizeof(one));
+        (void)ret;
+    }
+}
+
+void WebServer::DealWebSocket_(Reactor* r) {
+    {
+        lock_guard<mutex> locker(r->wsMtx);
+        if (r->wsReady.empty()) { return; }
+        r->wsTaken.swap(r->wsReady);
+    }
+    for (int fd : r->wsTaken) {
+        auto it = r->users.find(fd);
+        if (it == r->users.end()) { continue; }
+        HttpConn* client = &it->second;
+        int rearm = client->TakeRearm();
+        if (rearm < 0 && client->IsBusy()) { continue; }    // 工作线程还在处理，交回时会再看发送队列
+        if (client->IsClosed() || !client->IsWebSocket()) { continue; }     // 描述符已被复用
+        if (client->WsOverflow()) {
+            Metrics::Add(Metrics::WS_DROPS);
+            LOG_DEBUG("Client[%d] websocket send queue full, dropped", fd);
+            CloseConn_(r, client);
+            continue;
+        }
+        bool wantWrite = client->WsArm(rearm > 0);
+        client->SetBusy(false);
+        r->epoller->ModFd(fd, connEvent_ | (wantWrite ? EPOLLOUT : EPOLLIN));
+    }
+    r->wsTaken.clear();
+}
+
+void WebServer::Rearm_(Reactor* r, HttpConn* client, bool write) {
+    if (client->IsWebSocket()) {            // 保持置忙，由反应堆挂回，避免与广播唤醒同时修改 epoll
+        client->SetRearm(write);
+        WakeWebSocket_(r->id, client->GetFd());
+        return;
+    }
+    client->SetBusy(false);                 // 重新挂到 epoll 之前清除，之后反应堆可能再次投递
+    r->epoller->ModFd(client->GetFd(), connEvent_ | (write ? EPOLLOUT : EPOLLIN));
+}
+
+void WebServer::DealUpstream_(Reactor* r, int owner) {
+    auto it = r->users.find(owner);
+    if (it == r->users.end() || it->second.IsClosed()) { return; }   // 客户端关闭时后端连接已随之关闭
+    HttpConn* client = &it->second;
+    client->SetBusy(true);
+    r->workers->AddTask(std::bind(&WebServer::OnProxy_, this, r, client));
+}
+
+void WebServer::OnTimeout_(Reactor* r, HttpConn* client) {     // 定时器到期：按连接当前阶段判断是否真的超时
     assert(client);
-    if (timeoutMS_ > 0) {
-        timer_->adjust(client->GetFd(), timeoutMS_);      // 如果设置了超时时间，则调整定时器
+    if (client->IsClosed()) { return; }
+    int64_t next = client->IsBusy() ? BUSY_RECHECK_MS : CheckPhase_(client, HttpConn::NowMs());
+    if (next > 0) {     // 阶段已变化或仍在进展，按新的截止时间重新挂上
+        r->timer->add(client->GetFd(), static_cast<int>(next), std::bind(&WebServer::OnTimeout_, this, r, client));
+        return;
     }
+    static const char* const PHASE_NAME[] = { "keep-alive", "header", "body", "write", "websocket", "upstream" };
+    LOG_INFO("Client[%d] %s timeout", client->GetFd(), PHASE_NAME[client->Phase()]);
+    Metrics::Add(Metrics::TIMEOUTS);
+    CloseConn_(r, client);
 }
 
-void WebServer::OnRead_(HttpConn* client) {         // 处理读事件
+// 空闲和请求头阶段是从阶段开始计的固定期限，慢速逐字节发送也无法续期；
+// 请求体和写阶段按窗口检查，每个窗口内至少要有 min_rate 的吞吐
+int64_t WebServer::CheckPhase_(HttpConn* client, int64_t now) {
+    HttpConn::PHASE phase = client->Phase();
+    int64_t since = client->PhaseSinceMs();
+    uint64_t bytes = client->PhaseBytes();
+    HttpConn::TimeoutCheck& check = client->timeoutCheck;
+    if (check.phase != phase || check.since != since) {     // 进入了新阶段，窗口从阶段开始算
+        check = HttpConn::TimeoutCheck{ phase, since, 0, since };
+    }
+    switch (phase) {
+        case HttpConn::IDLE:    // 空闲期间可能开始收请求头，最迟 header_timeout_ms 后再看一次
+            return std::min<int64_t>(since + timeoutMS_ - now, config_.headerTimeoutMs);
+        case HttpConn::HEADER:
+            return since + config_.headerTimeoutMs - now;
+        case HttpConn::WEBSOCKET:   // 窗口内任一方向有数据即可，客户端 ping 或收到广播都算
+            if (now < check.checkedMs + config_.wsIdleMs) { return check.checkedMs + config_.wsIdleMs - now; }
+            if (bytes == check.bytes) { return 0; }
+            check.bytes = bytes;
+            check.checkedMs = now;
+            return config_.wsIdleMs;
+        case HttpConn::UPSTREAM:    // 后端迟迟不响应，或两个方向都停止转发
+            if (now < check.checkedMs + config_.proxyTimeoutMs) { return check.checkedMs + config_.proxyTimeoutMs - now; }
+            if (bytes == check.bytes) { return 0; }
+            check.bytes = bytes;
+            check.checkedMs = now;
+            return config_.proxyTimeoutMs;
+        default: {
+            int64_t window = phase == HttpConn::BODY ? config_.bodyTimeoutMs : config_.writeTimeoutMs;
+            if (now < check.checkedMs + window) { return check.checkedMs + window - now; }
+            uint64_t need = static_cast<uint64_t>(config_.minRateBps) * (now - check.checkedMs) / 1000;
+            if (bytes - check.bytes < std::max<uint64_t>(need, 1)) { return 0; }
+            check.bytes = bytes;
+            check.checkedMs = now;
+            return window;
+        }
+    }
+}
+
+void WebServer::OnRead_(Reactor* r, HttpConn* client) {         // 处理读事件
     assert(client);
     int ret = -1;
     int readErrno = 0;
+    if (client->Proxying()) {           // 请求体的剩余部分由代理会话直接转发
+        OnProxy_(r, client);
+        return;
+    }
     ret = client->read(&readErrno);
     if (ret <= 0 && readErrno != EAGAIN) {
-        CloseConn_(client);
+        CloseConn_(r, client);
         return;
     }
-    OnProcess(client);      // 处理读取到的数据
+    OnProcess(r, client);   // 处理读取到的数据
 }
 
-void WebServer::OnProcess(HttpConn* client) {       // 处理客户端请求
-    if(client->process()) {                         // 如果处理成功，准备写回数据
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+void WebServer::OnProcess(Reactor* r, HttpConn* client) {       // 处理客户端请求
+    bool ready = client->process();
+    if (client->Proxying()) {           // 请求交给了后端
+        OnProxy_(r, client);
+        return;
     }
-    else {      // 继续读取更多数据
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+    Rearm_(r, client, ready);           // 处理成功则准备写回数据，否则继续读取更多数据
+}
+
+// 一次只挂客户端或后端中的一个套接字：后端套接字带着客户端描述符登记，事件回到同一个会话
+void WebServer::OnProxy_(Reactor* r, HttpConn* client) {
+    ProxySession::WAIT wait = client->StepProxy();
+    switch (wait) {
+        case ProxySession::UPSTREAM_READ:
+        case ProxySession::UPSTREAM_WRITE: {
+            int fd = client->UpstreamFd();
+            uint32_t events = connEvent_ | (wait == ProxySession::UPSTREAM_READ ? EPOLLIN : EPOLLOUT);
+            client->SetBusy(false);
+            if (!r->epoller->ModFd(fd, events, client->GetFd())) {    // 新建的连接，或池中的连接上次登记在别的反应堆
+                r->epoller->AddFd(fd, events, client->GetFd());
+            }
+            return;
+        }
+        case ProxySession::CLIENT_READ:
+        case ProxySession::CLIENT_WRITE:
+            Rearm_(r, client, wait == ProxySession::CLIENT_WRITE);
+            return;
+        case ProxySession::DONE:
+            if (client->IsKeepAlive()) {    // 流水线中的下一个请求可能已在读缓冲区
+                OnProcess(r, client);
+                return;
+            }
+            break;
+        default:
+            break;
     }
+    CloseConn_(r, client);
 }
 
-void WebServer::OnWrite_(HttpConn* client) {        // 处理写事件
+void WebServer::OnWrite_(Reactor* r, HttpConn* client) {        // 处理写事件
     assert(client);
     int ret = -1;
     int writeErrono = 0;
+    if (client->Proxying()) {
+        OnProxy_(r, client);
+        return;
+    }
     ret = client->write(&writeErrono);              // 执行写操作
     if (client->ToWriteBytes() == 0) {              // 如果数据已经全部写入
         if (client->IsKeepAlive()) {                // 如果是长连接，继续处理请求
-            OnProcess(client);
+            OnProcess(r, client);
             return;
         }
     }
     else if (ret < 0) {
         if (writeErrono == EAGAIN) {    //EAGAIN 是一个错误码，表示非阻塞操作无法立即完成,在这种情况下，意味着输出缓冲区已满，现在不能发送更多数据，稍后可以重试。
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+            Rearm_(r, client, true);
             return;
         }
     }
-    CloseConn_(client);
+    CloseConn_(r, client);
 }
 
-bool WebServer::InitSocket_() {
+bool WebServer::InitSocket_(Reactor* r) {
     int ret;
     struct sockaddr_in addr;
     if (port_ > 65535 || port_ < 1024) {
@@ -218,54 +812,75 @@ bool WebServer::InitSocket_() {
         optLinger.l_onoff = 1;
         optLinger.l_linger = 1;
     }
-    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);    // 创建套接字
-    if (listenFd_ < 0) {
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);    // 创建套接字
+    if (listenFd < 0) {
         LOG_ERROR("Creat socket error!", port_);
         return false;
     }
 
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));  // 设置linger选项
+    ret = setsockopt(listenFd, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));  // 设置linger选项
     if (ret < 0) {
-        close(listenFd_);
+        close(listenFd);
         LOG_ERROR("Init linger error!", port_);
         return false;
     }
 
     int optval = 1;
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));    // 设置socket选项SO_REUSEADDR，允许重用本地地址和端口
+    ret = setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));    // 设置socket选项SO_REUSEADDR，允许重用本地地址和端口
     if (ret == -1) {
         LOG_ERROR("set socket setsocketopt error !");
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
 
-    ret = bind(listenFd_, (struct sockaddr *)&addr, sizeof(addr));
+    if (config_.deferAcceptSec > 0) {           // 收到首个数据包后才唤醒 accept，空连接不占用反应堆
+        int secs = config_.deferAcceptSec;
+        if (setsockopt(listenFd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &secs, sizeof(secs)) == -1) {
+            LOG_WARN("set TCP_DEFER_ACCEPT error!");
+        }
+    }
+    if (config_.reactors > 1) {                 // 每个反应堆一个监听套接字，由内核分配连接
+        ret = setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval));
+        if (ret == -1) {
+            LOG_ERROR("set SO_REUSEPORT error!");
+            close(listenFd);
+            return false;
+        }
+    }
+    if (config_.incomingCpu && r->cpu >= 0) {   // 内核优先把该 CPU 上收到的连接交给此监听套接字（Linux 6.2+ 对 REUSEPORT 组生效）
+        if (setsockopt(listenFd, SOL_SOCKET, SO_INCOMING_CPU, &r->cpu, sizeof(r->cpu)) == -1) {
+            LOG_WARN("set SO_INCOMING_CPU %d error!", r->cpu);
+        }
+    }
+
+    ret = bind(listenFd, (struct sockaddr *)&addr, sizeof(addr));
     if (ret < 0) {
         LOG_ERROR("Bind Port:%d error!", port_);
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
 
-    ret = listen(listenFd_, 6);
+    ret = listen(listenFd, config_.listenBacklog);
     if (ret < 0) {
         LOG_ERROR("Listen Port:%d error!", port_);
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
 
-    ret = epoller_->AddFd(listenFd_, listenEvent_ | EPOLLIN);   // 将监听的文件描述符添加到epoll事件监听中
+    ret = r->epoller->AddFd(listenFd, listenEvent_ | EPOLLIN);   // 将监听的文件描述符添加到epoll事件监听中
     if (ret == 0) {
         LOG_ERROR("Add listen error!");
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
 
-    SetFdNonblock(listenFd_);
-    LOG_INFO("Server port:%d", port_);
+    SetFdNonblock(listenFd);
+    r->listenFd = listenFd;
+    LOG_INFO("Server port:%d, reactor:%d", port_, r->id);
     return true;
 }
 
 int WebServer::SetFdNonblock(int fd) {  // 设置文件描述符为非阻塞模式
     assert(fd > 0);
-    return fcntl(fd, F_SETFL,fcntl(fd, F_GETFD, 0) | O_NONBLOCK);
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
 }
\ No newline at end of file
@@ -2,12 +2,16 @@
 #define WEBSERVER_H
 
 #include <unordered_map>
+#include <mutex>
 #include <fcntl.h>
 #include <unistd.h>
 #include <assert.h>
 #include <errno.h>
+#include <signal.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include "epoller.h"
 #include "../log/log.h"
@@ -16,51 +20,105 @@
 #include "../pool/threadpool.h"
 #include "../pool/sqlconnRAII.h"
 #include "../http/httpconn.h"
+#include "../metrics/metrics.h"
+#include "../trace/trace.h"
+#include "../config/config.h"
+#include "fdpass.h"
+#include "clientlimiter.h"
 class WebServer {
 public:
-    WebServer(
-        int port, int trigMode, int timeoutMS, bool OptLinger,
-        int sqpPort, const char* sqlUser, const char* sqlPwd,
-        const char* dbName, int connPoolNum, int threadNum,
-        bool openLog, int logLevel, int logQueSize);
+    explicit WebServer(const ServerConfig& config);
     ~WebServer();
     void Start();
 
 private:
+    // 反应堆：独立的监听套接字、epoll、定时器和连接表，连接只在所属反应堆内处理
+    struct Reactor {
+        int id;
+        int listenFd;
+        int idleFd;                             // 预留的空闲描述符，EMFILE 时用来接受并关闭连接
+        bool acceptPending;                     // 上次批量 accept 未取完，下一轮继续
+        int cpu;                                // 绑定的 CPU，-1 表示不绑定
+        int wakeFd;                             // eventfd，信号或排空时唤醒 epoll_wait
+        bool draining;                          // 已停止 accept，等待在途连接结束
+        std::chrono::steady_clock::time_point drainDeadline;
+        std::unique_ptr<Epoller> epoller;
+        std::unique_ptr<HeapTimer> timer;
+        std::unique_ptr<ThreadPool> ownPool;    // numa_workers 时的私有线程池
+        ThreadPool* workers;                    // 实际投递任务的线程池
+        std::unordered_map<int, HttpConn> users;
+        std::atomic<size_t> timerCount;         // 定时器数量，由反应堆线程更新供指标读取
+        std::mutex wsMtx;                       // 保护 wsReady
+        std::vector<int> wsReady;               // 待反应堆重新挂上 epoll 的 WebSocket 连接
+        std::vector<int> wsTaken;               // 本轮取出处理的，与 wsReady 交换复用
+    };
 
-    bool InitSocket_();
+    bool InitSocket_(Reactor* r);
     void InitEventMode_(int trigMode);
-    void AddClient_(int fd, sockaddr_in addr);
+    void InitAffinity_();
+    void InitSignals_();
+    bool InitRoutes_();                     // 注册内置路由并冻结路由表
+    bool TakeOver_();                       // 从旧进程接管监听套接字
+    void InitControl_();
+    void DealControl_();                    // 新进程请求接管：交出监听套接字后开始排空
+    void StartDrain_(Reactor* r);
+    bool DrainDone_(Reactor* r);            // 返回 true 表示可以退出事件循环
+    static void WakeAll_();
+    static void OnSignal_(int sig);
+    void Loop_(Reactor* r);
+    void AddClient_(Reactor* r, int fd, sockaddr_in addr);
 
-    void DealListen_();
-    void DealWrite_(HttpConn* client);
-    void DealRead_(HttpConn* client);
+    bool DealListen_(Reactor* r);           // 返回 true 表示本批取满，队列中可能还有连接
+    void DealWrite_(Reactor* r, HttpConn* client);
+    void DealRead_(Reactor* r, HttpConn* client);
+    void DealWebSocket_(Reactor* r);
+    void WakeWebSocket_(int owner, int fd);     // 任意线程：请求反应堆处理该 WebSocket 连接
+    void Rearm_(Reactor* r, HttpConn* client, bool write);  // 工作线程处理完，重新挂上 epoll
+    void DealUpstream_(Reactor* r, int owner);  // 后端套接字就绪，交给所属客户端连接
 
     void SendError_(int fd, const char* info);
-    void ExtenTime_(HttpConn* client);
-    void CloseConn_(HttpConn* client);
+    void SendNow_(int fd, const char* info);
+    ThreadPool::LANE Classify_(Reactor* r, HttpConn* client);
+    bool Admit_(Reactor* r, ThreadPool::LANE lane);
+    void Shed_(Reactor* r, HttpConn* client);
+    void OnTimeout_(Reactor* r, HttpConn* client);
+    int64_t CheckPhase_(HttpConn* client, int64_t now);    // 距下次检查的毫秒数，<= 0 表示已超时
+    void CloseConn_(Reactor* r, HttpConn* client);
 
-    void OnRead_(HttpConn* client);
-    void OnWrite_(HttpConn* client);
-    void OnProcess(HttpConn* client);
+    void OnRead_(Reactor* r, HttpConn* client);
+    void OnWrite_(Reactor* r, HttpConn* client);
+    void OnProcess(Reactor* r, HttpConn* client);
+    void OnProxy_(Reactor* r, HttpConn* client);
 
     static const int MAX_FD = 65536;
+    static const char BUSY_RESPONSE[];      // 过载时直接发送的 503 响应
+    static const char LIMITED_RESPONSE[];   // 超过单个客户端限额时发送的 429 响应
+    static const int MAX_REACTORS = 64;
+    static const int DRAIN_TICK_MS = 100;   // 排空期间检查连接的间隔
+    static const int BUSY_RECHECK_MS = 1000;    // 超时时连接正在工作线程中处理，稍后再查
+
+    static std::atomic<int> stopSignal_;    // 收到的 SIGTERM/SIGINT，信号处理函数中只置位并唤醒
+    static int wakeFds_[MAX_REACTORS];
+    static std::atomic<int> wakeFdCount_;
 
     static  int SetFdNonblock(int fd);
 
+    void InitMetrics_();
+
+    ServerConfig config_;   // 启动参数
     int port_;               // 服务器端口
     bool openLinger_;       // 是否开启linger选项
-    int timeoutMS_;         // 超时时间（毫秒）
-    bool isClose_;          // 服务器是否关闭的标志
-    int listenFd_;          // 监听文件描述符
+    int timeoutMS_;         // 长连接空闲超时（毫秒），0 关闭所有连接定时器
+    std::atomic<bool> isClose_; // 服务器是否关闭的标志
+    std::atomic<bool> draining_;   // 收到停止信号或监听套接字已交给新进程
+    int controlFd_;         // 热升级控制套接字，由反应堆0处理
     char* srcDir_;          // 资源目录
     uint32_t listenEvent_;  // 监听事件类型
     uint32_t connEvent_;    // 连接事件类型
 
-    std::unique_ptr<HeapTimer> timer_;          // 定时器
-    std::unique_ptr<ThreadPool> threadpool_;    // 线程池
-    std::unique_ptr<Epoller>  epoller_;         // Epoller对象
-    std::unordered_map<int, HttpConn> users_;   // 存储客户端连接的map
+    ClientLimiter limiter_;     // 按客户端 IP 的连接数与请求速率限制，各反应堆共享
+    std::unique_ptr<ThreadPool> threadpool_;    // 共享线程池
+    std::vector<std::unique_ptr<Reactor>> reactors_;
 };
 
 #endif
\ No newline at end of file
@@ -2,12 +2,11 @@
 
 void HeapTimer::siftup_(size_t i) {
     assert(i >= 0 && i < heap_.size());  // 断言i在合法范围内
-    size_t j = (i - 1) / 2;  // 计算父节点索引
-    while(j >= 0) {  // 当i不是根节点时
+    while(i > 0) {  // 当i不是根节点时（size_t 无符号，不能用 j >= 0 判断）
+        size_t j = (i - 1) / 2;  // 计算父节点索引
         if(heap_[j] < heap_[i]) { break; }  // 如果父节点小于当前节点，停止上浮
         SwapNode_(i, j);  // 交换当前节点和父节点
         i = j;  // 更新当前节点为父节点，继续上浮检查
-        j = (i - 1) / 2;  // 重新计算父节点索引
     }
 }
 
@@ -98,12 +97,12 @@ void HeapTimer::tick() {
         return;
     }
     while (!heap_.empty()) {
-        TimerNode node = heap_.front();
-        if (std::chrono::duration_cast<MS>(node.expires - Clock::now()).count() > 0) {
+        if (std::chrono::duration_cast<MS>(heap_.front().expires - Clock::now()).count() > 0) {
             break;
         }
+        TimerNode node = heap_.front();
+        pop();          // 先出堆再回调，回调中可以用同一 id 重新 add
         node.cb();
-        pop();
     }
 }
 
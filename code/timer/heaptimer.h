@@ -47,6 +47,8 @@ public:
 
     int GetNextTick();              // 获取距离下一次定时任务的时间
 
+    size_t size() const { return heap_.size(); }    // 当前定时器数量
+
 private:
     void del_(size_t i);            // 删除指定位置的定时器
 
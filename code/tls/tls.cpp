@@ -0,0 +1,227 @@
+#include "tls.h"
+#include <errno.h>
+#include <limits.h>
+#include <algorithm>
+
+#include "../log/log.h"
+#include "../metrics/metrics.h"
+
+#ifdef ENABLE_TLS
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#endif
+
+using namespace std;
+
+#ifdef ENABLE_TLS
+
+static SSL_CTX* ctx = nullptr;
+static bool alpnH2 = false;
+
+const size_t TlsSession::READ_CHUNK;
+const size_t TlsSession::WRITE_CHUNK;
+
+static const char* LastError() {
+    unsigned long e = ERR_peek_last_error();
+    return e ? ERR_reason_error_string(e) : "unknown";
+}
+
+static int SelectAlpn(SSL*, const unsigned char** out, unsigned char* outlen,
+                      const unsigned char* in, unsigned int inlen, void*) {
+    static const unsigned char H2[] = "\x02h2\x08http/1.1";
+    static const unsigned char H1[] = "\x08http/1.1";
+    const unsigned char* prefs = alpnH2 ? H2 : H1;
+    unsigned int len = alpnH2 ? sizeof(H2) - 1 : sizeof(H1) - 1;
+    if (SSL_select_next_proto(const_cast<unsigned char**>(out), outlen, prefs, len, in, inlen) == OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_OK;
+    }
+    return SSL_TLSEXT_ERR_NOACK;    // 客户端没有提供我们支持的协议，不协商，按 HTTP/1.1 处理
+}
+
+bool Tls::Init(const string& cert, const string& key, bool ktls, bool tickets, int cacheSize, bool h2) {
+    SSL_CTX* c = SSL_CTX_new(TLS_server_method());
+    if (!c) {
+        LOG_ERROR("TLS: SSL_CTX_new failed: %s", LastError());
+        return false;
+    }
+    SSL_CTX_set_min_proto_version(c, TLS1_2_VERSION);
+    if (SSL_CTX_use_certificate_chain_file(c, cert.c_str()) != 1 ||
+        SSL_CTX_use_PrivateKey_file(c, key.c_str(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(c) != 1) {
+        LOG_ERROR("TLS: load certificate %s / key %s failed: %s", cert.c_str(), key.c_str(), LastError());
+        SSL_CTX_free(c);
+        return false;
+    }
+    // 非阻塞写：每写完一个记录就返回，重试时缓冲区地址可以变化（iovec 会前移）；空闲连接释放读写缓冲区
+    SSL_CTX_set_mode(c, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+    SSL_CTX_set_options(c, SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE);
+
+    static const unsigned char SESSION_CTX[] = "webserver";
+    SSL_CTX_set_session_id_context(c, SESSION_CTX, sizeof(SESSION_CTX) - 1);
+    if (cacheSize > 0) {        // 会话缓存由 OpenSSL 内部加锁，各工作线程共享
+        SSL_CTX_set_session_cache_mode(c, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(c, cacheSize);
+    }
+    else {
+        SSL_CTX_set_session_cache_mode(c, SSL_SESS_CACHE_OFF);
+    }
+    if (!tickets) {             // 票据密钥在进程内随机生成，热升级后旧票据失效，客户端回退到完整握手
+        SSL_CTX_set_options(c, SSL_OP_NO_TICKET);
+        SSL_CTX_set_num_tickets(c, 0);
+    }
+#ifdef SSL_OP_ENABLE_KTLS
+    if (ktls) { SSL_CTX_set_options(c, SSL_OP_ENABLE_KTLS); }
+#else
+    if (ktls) { LOG_WARN("TLS: OpenSSL built without kTLS, using SSL_write"); }
+#endif
+    alpnH2 = h2;
+    SSL_CTX_set_alpn_select_cb(c, SelectAlpn, nullptr);
+    ctx = c;
+    LOG_INFO("TLS: %s, session cache %d, tickets %s, kTLS %s", OpenSSL_version(OPENSSL_VERSION),
+             cacheSize, tickets ? "on" : "off", ktls ? "on" : "off");
+    return true;
+}
+
+void Tls::Close() {
+    if (ctx) {
+        SSL_CTX_free(ctx);
+        ctx = nullptr;
+    }
+}
+
+bool Tls::Enabled() {
+    return ctx != nullptr;
+}
+
+TlsSession::TlsSession() : ssl_(nullptr), established_(false), wantWrite_(false), ktlsTx_(false) {}
+
+TlsSession::~TlsSession() {
+    Detach();
+}
+
+bool TlsSession::Attach(int fd) {
+    Detach();
+    ssl_ = SSL_new(ctx);
+    if (!ssl_ || SSL_set_fd(ssl_, fd) != 1) {
+        LOG_ERROR("TLS: SSL_new failed: %s", LastError());
+        Detach();
+        return false;
+    }
+    SSL_set_accept_state(ssl_);
+    return true;
+}
+
+void TlsSession::Detach() {
+    if (ssl_) {
+        if (established_) { SSL_shutdown(ssl_); }   // 只发一次 close_notify，不等对端回应
+        SSL_free(ssl_);
+        ssl_ = nullptr;
+    }
+    established_ = wantWrite_ = ktlsTx_ = false;
+    ERR_clear_error();
+}
+
+int TlsSession::Handshake() {
+    ERR_clear_error();
+    int ret = SSL_do_handshake(ssl_);
+    if (ret == 1) {
+        established_ = true;
+        wantWrite_ = false;
+#ifndef OPENSSL_NO_KTLS
+        ktlsTx_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+#endif
+        Metrics::Add(Metrics::TLS_HANDSHAKES);
+        if (SSL_session_reused(ssl_)) { Metrics::Add(Metrics::TLS_RESUMED); }
+        if (ktlsTx_) { Metrics::Add(Metrics::TLS_KTLS); }
+        LOG_DEBUG("TLS: %s %s%s%s", SSL_get_version(ssl_), SSL_get_cipher_name(ssl_),
+                  SSL_session_reused(ssl_) ? ", resumed" : "", ktlsTx_ ? ", kTLS" : "");
+        return 1;
+    }
+    int err = SSL_get_error(ssl_, ret);
+    wantWrite_ = err == SSL_ERROR_WANT_WRITE;
+    if (err == SSL_ERROR_WANT_READ || wantWrite_) { return 0; }
+    Metrics::Add(Metrics::TLS_FAILURES);
+    LOG_DEBUG("TLS: handshake failed: %s", err == SSL_ERROR_SYSCALL ? strerror(errno) : LastError());
+    return -1;
+}
+
+ssize_t TlsSession::Read(Buffer& buff, int* saveErrno) {
+    ssize_t total = 0;
+    while (true) {      // SSL 可能已把整个记录读进内部缓冲区，必须读到 WANT_READ，否则不会再有读事件
+        buff.EnsureWriteable(READ_CHUNK);
+        ERR_clear_error();
+        int n = SSL_read(ssl_, buff.BeginWrite(), static_cast<int>(min<size_t>(buff.WritableBytes(), INT_MAX)));
+        if (n > 0) {
+            buff.HasWritten(n);
+            total += n;
+            continue;
+        }
+        int err = SSL_get_error(ssl_, n);
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+            if (total > 0) { return total; }
+            *saveErrno = EAGAIN;
+            return -1;
+        }
+        if (err == SSL_ERROR_ZERO_RETURN) { return total; }     // 对端发送了 close_notify
+        if (total > 0) { return total; }
+        *saveErrno = (err == SSL_ERROR_SYSCALL && errno) ? errno : EPROTO;
+        return -1;
+    }
+}
+
+ssize_t TlsSession::Writev(int fd, const struct iovec* iov, int cnt) {
+    if (ktlsTx_) { return writev(fd, iov, cnt); }
+    ssize_t total = 0;
+    for (int i = 0; i < cnt; i++) {
+        const char* base = static_cast<const char*>(iov[i].iov_base);
+        size_t off = 0;
+        while (off < iov[i].iov_len) {
+            ERR_clear_error();
+            int n = SSL_write(ssl_, base + off, static_cast<int>(min(iov[i].iov_len - off, WRITE_CHUNK)));
+            if (n <= 0) {       // 未写出的记录留在 SSL 内部，下次必须从同一位置重试，调用方按已写字节前移即可
+                int err = SSL_get_error(ssl_, n);
+                if (total > 0) { return total; }
+                if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) { errno = EAGAIN; }
+                else if (err != SSL_ERROR_SYSCALL || errno == 0) { errno = EPIPE; }
+                return -1;
+            }
+            off += n;
+            total += n;
+        }
+    }
+    return total;
+}
+
+#else
+
+bool Tls::Init(const string&, const string&, bool, bool, int, bool) {
+    LOG_ERROR("TLS: built without OpenSSL, rebuild with make TLS=1");
+    return false;
+}
+
+void Tls::Close() {}
+
+bool Tls::Enabled() {
+    return false;
+}
+
+TlsSession::TlsSession() : ssl_(nullptr), established_(false), wantWrite_(false), ktlsTx_(false) {}
+
+TlsSession::~TlsSession() {}
+
+bool TlsSession::Attach(int) { return false; }
+
+void TlsSession::Detach() {}
+
+int TlsSession::Handshake() { return -1; }
+
+ssize_t TlsSession::Read(Buffer&, int* saveErrno) {
+    *saveErrno = EPROTO;
+    return -1;
+}
+
+ssize_t TlsSession::Writev(int fd, const struct iovec* iov, int cnt) {
+    return writev(fd, iov, cnt);
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef TLS_H
+#define TLS_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <string>
+
+#include "../buffer/buffer.h"
+
+struct ssl_st;          // OpenSSL 的 SSL，头文件只在 tls.cpp 中引入
+
+/*
+ * 可选的 TLS 终结：make TLS=1 时链接 OpenSSL，否则 Init 直接失败，其余接口不会被调用。
+ * 在反应堆的非阻塞套接字上直接握手，服务端会话缓存和会话票据让重连的客户端省掉完整握手。
+ * 握手完成后由 OpenSSL 开启内核 TLS（kTLS）：发送方向之后直接 writev 文件映射，由内核加密，
+ * 用户态不再复制；内核没有 tls 模块或加密套件不支持时退回 SSL_write。
+ */
+class Tls {
+public:
+    // 加载证书和私钥，cacheSize 为 0 时关闭服务端会话缓存；h2 为真时 ALPN 优先协商 h2
+    static bool Init(const std::string& cert, const std::string& key, bool ktls, bool tickets,
+                     int cacheSize, bool h2);
+    static void Close();
+    static bool Enabled();      // 已初始化，新连接都走 TLS
+};
+
+class TlsSession {              // 每个连接一个，只由处理该连接的线程访问
+public:
+    TlsSession();
+    ~TlsSession();
+
+    bool Attach(int fd);        // 新连接：创建 SSL 对象，等待 ClientHello
+    void Detach();              // 尽力发送 close_notify 并释放，需在 close(fd) 之前调用
+
+    bool Active() const { return ssl_ != nullptr; }
+    bool Established() const { return established_; }
+    bool WantWrite() const { return wantWrite_; }    // 握手输出被套接字发送缓冲区阻塞
+    bool KtlsSend() const { return ktlsTx_; }       // 发送方向由内核加密，可以直接 writev/splice 到套接字
+
+    int Handshake();            // 1 完成，0 等待读写事件，-1 失败
+
+    ssize_t Read(Buffer& buff, int* saveErrno);     // 读到 SSL_ERROR_WANT_READ 为止，返回值同 Buffer::ReadFd
+    ssize_t Writev(int fd, const struct iovec* iov, int cnt);  // 返回值和 errno 同 writev
+
+private:
+    static const size_t READ_CHUNK = 16 * 1024;     // 一个 TLS 记录的最大明文长度
+    static const size_t WRITE_CHUNK = 64 * 1024;
+
+    ssl_st* ssl_;
+    bool established_;
+    bool wantWrite_;
+    bool ktlsTx_;               // 发送方向已交给内核
+};
+
+#endif //TLS_H
@@ -0,0 +1,124 @@
+#include "trace.h"
+#include <stdio.h>
+#include <time.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+const char* const Trace::PATH = "/debug/trace";
+mutex Trace::mtx_;
+vector<unique_ptr<Trace::Ring>> Trace::rings_;
+atomic<bool> Trace::dumpRequested_(false);
+
+static const char* const STAGE_NAME[] = {
+    "epoll_wait", "queue", "read", "parse", "file", "mysql", "writev",
+};
+
+namespace {
+
+struct Calibration {    // 进程启动时的 TSC 与单调时钟对照点，导出时据此换算微秒
+    uint64_t tsc;
+    chrono::steady_clock::time_point clock;
+    Calibration(): tsc(Trace::Now()), clock(chrono::steady_clock::now()) {}
+};
+
+Calibration& Origin() {
+    static Calibration origin;
+    return origin;
+}
+
+}   // namespace
+
+Trace::Ring& Trace::Local_() {
+    static thread_local Ring* ring = nullptr;
+    if (!ring) {
+        Origin();
+        lock_guard<mutex> locker(mtx_);
+        rings_.emplace_back(new Ring());
+        ring = rings_.back().get();
+        ring->tid = static_cast<int>(rings_.size());
+        ring->head = 0;
+    }
+    return *ring;
+}
+
+void Trace::Record(STAGE stage, uint64_t begin, uint64_t end, int id) {
+    Ring& ring = Local_();
+    uint64_t head = ring.head.load(memory_order_relaxed);
+    Event& e = ring.events[head & (RING_SIZE - 1)];
+    e.begin = begin;
+    e.end = end;
+    e.id = id;
+    e.stage = static_cast<uint16_t>(stage);
+    ring.head.store(head + 1, memory_order_release);
+}
+
+string Trace::DumpJson() {
+    Calibration& origin = Origin();
+    Calibration now;
+    double elapsedUs = chrono::duration<double, micro>(now.clock - origin.clock).count();
+    double ticksPerUs = elapsedUs > 0 ? (now.tsc - origin.tsc) / elapsedUs : 1.0;
+    if (ticksPerUs <= 0) { ticksPerUs = 1.0; }
+
+    string out = "{\"traceEvents\":[";
+    char buf[256];
+    bool first = true;
+    vector<Event> events;
+    lock_guard<mutex> locker(mtx_);
+    for (auto& ring : rings_) {
+        uint64_t head = ring->head.load(memory_order_acquire);
+        uint64_t begin = head > RING_SIZE ? head - RING_SIZE : 0;
+        events.clear();
+        for (uint64_t i = begin; i < head; i++) {
+            events.push_back(ring->events[i & (RING_SIZE - 1)]);
+        }
+        uint64_t after = ring->head.load(memory_order_acquire);
+        size_t skip = after - head;     // 拷贝期间被覆盖的最旧记录可能不完整，丢弃
+        for (size_t i = skip; i < events.size(); i++) {
+            const Event& e = events[i];
+            if (e.stage >= STAGE_NUM || e.end < e.begin || e.begin < origin.tsc) { continue; }
+            int n = snprintf(buf, sizeof(buf),
+                "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"id\":%d}}",
+                first ? "" : ",\n", STAGE_NAME[e.stage], ring->tid,
+                (e.begin - origin.tsc) / ticksPerUs, (e.end - e.begin) / ticksPerUs, e.id);
+            out.append(buf, n);
+            first = false;
+        }
+    }
+    out += "],\"displayTimeUnit\":\"ms\"}\n";
+    return out;
+}
+
+bool Trace::DumpToFile(const char* dir) {
+    char fileName[256];
+    time_t timer = time(nullptr);
+    struct tm t;
+    localtime_r(&timer, &t);
+    snprintf(fileName, sizeof(fileName), "%s/trace-%04d%02d%02d-%02d%02d%02d.json", dir,
+             t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+    mkdir(dir, 0777);
+    FILE* fp = fopen(fileName, "w");
+    if (!fp) { return false; }
+    string json = DumpJson();
+    bool ok = fwrite(json.data(), 1, json.size(), fp) == json.size();
+    fclose(fp);
+    return ok;
+}
+
+void Trace::OnSignal_(int) {
+    dumpRequested_.store(true, memory_order_relaxed);  // 信号处理函数中只置位
+}
+
+void Trace::InstallSignal(int sig) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnSignal_;
+    sigemptyset(&sa.sa_mask);
+    sigaction(sig, &sa, nullptr);
+}
+
+bool Trace::TakeDumpRequest() {
+    return dumpRequested_.exchange(false, memory_order_relaxed);
+}
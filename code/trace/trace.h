@@ -0,0 +1,106 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * 请求分阶段追踪：各阶段用 TSC 打时间戳，写入线程私有的环形缓冲区（覆盖最旧的记录）。
+ * 编译时加 -DENABLE_TRACE（make TRACE=1）才会生成追踪点，否则宏全部为空。
+ * 通过 SIGUSR1 或 /debug/trace 导出为 Chrome trace-event JSON，可在 chrome://tracing 中查看。
+ */
+class Trace {
+public:
+    enum STAGE {
+        EPOLL_WAIT = 0,     // 反应堆等待事件
+        QUEUE,              // 读事件就绪到工作线程开始处理
+        READ,               // 读取套接字
+        PARSE,              // HttpRequest::parse
+        FILE_IO,            // stat/open/mmap 资源文件
+        MYSQL,              // UserVerify 中的数据库访问
+        WRITEV,             // 写回响应
+        STAGE_NUM,
+    };
+
+    static const char* const PATH;              // 导出追踪数据的请求路径
+
+    static uint64_t Now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    static bool Enabled() {
+#ifdef ENABLE_TRACE
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static void Record(STAGE stage, uint64_t begin, uint64_t end, int id);
+
+    static std::string DumpJson();              // 所有线程的事件，Chrome trace-event 格式
+    static bool DumpToFile(const char* dir);    // 写入 dir/trace-<时间>.json
+
+    static void InstallSignal(int sig);         // 收到信号时置位导出请求
+    static bool TakeDumpRequest();              // 反应堆循环中检查并清除导出请求
+
+private:
+    static const size_t RING_SIZE = 8192;       // 每线程保留的事件数，2的幂
+
+    struct Event {
+        uint64_t begin;
+        uint64_t end;
+        int32_t id;                             // 通常为连接 fd
+        uint16_t stage;
+    };
+
+    struct Ring {
+        int tid;
+        std::atomic<uint64_t> head;             // 已写入的事件总数
+        Event events[RING_SIZE];
+    };
+
+    static Ring& Local_();
+    static void OnSignal_(int sig);
+
+    static std::mutex mtx_;
+    static std::vector<std::unique_ptr<Ring>> rings_;
+    static std::atomic<bool> dumpRequested_;
+};
+
+class TraceScope {      // 作用域内的耗时记为一个阶段
+public:
+    TraceScope(Trace::STAGE stage, int id): stage_(stage), id_(id), begin_(Trace::Now()) {}
+    ~TraceScope() { Trace::Record(stage_, begin_, Trace::Now(), id_); }
+private:
+    Trace::STAGE stage_;
+    int id_;
+    uint64_t begin_;
+};
+
+#ifdef ENABLE_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(stage, id) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(stage, id)
+#define TRACE_STAMP(var) do { (var) = Trace::Now(); } while (0)
+#define TRACE_SINCE(stage, begin, id) Trace::Record(stage, begin, Trace::Now(), id)
+#else
+#define TRACE_SCOPE(stage, id) do {} while (0)
+#define TRACE_STAMP(var) do {} while (0)
+#define TRACE_SINCE(stage, begin, id) do {} while (0)
+#endif
+
+#endif //TRACE_H
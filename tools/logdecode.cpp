@@ -0,0 +1,93 @@
+/*
+ * 二进制日志离线解码工具（Log::MODE_BINARY 产生的文件）。
+ * 用法: logdecode [-j] file...
+ *   默认输出与文本模式一致的日志行，-j 输出 JSON lines
+ */
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "../code/log/binlog.h"
+#include "../code/log/timecache.h"
+
+static bool ReadExact(FILE* fp, void* buf, size_t n) {
+    return n == 0 || fread(buf, 1, n, fp) == n;
+}
+
+static int Decode(const char* path, bool json) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "open %s failed\n", path);
+        return 1;
+    }
+    std::unordered_map<uint32_t, std::string> formats;
+    std::vector<char> args;
+    std::string line;
+    char magic[BinLog::FILE_MAGIC_LEN];
+    int tag;
+    if (!ReadExact(fp, magic, sizeof(magic)) || memcmp(magic, BinLog::FILE_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "%s: not a binary log\n", path);
+        fclose(fp);
+        return 1;
+    }
+    while ((tag = fgetc(fp)) != EOF) {
+        uint32_t id = 0;
+        uint16_t len = 0;
+        if (tag == 'F') {           // 格式串定义
+            if (!ReadExact(fp, &id, sizeof(id)) || !ReadExact(fp, &len, sizeof(len))) { break; }
+            std::string fmt(len, '\0');
+            if (!ReadExact(fp, &fmt[0], len)) { break; }
+            formats[id] = fmt;
+        }
+        else if (tag == 'R') {      // 日志记录
+            uint8_t level = 0, argc = 0;
+            int64_t timeNs = 0;
+            if (!ReadExact(fp, &id, sizeof(id)) || !ReadExact(fp, &level, 1) || !ReadExact(fp, &argc, 1) ||
+                !ReadExact(fp, &timeNs, sizeof(timeNs)) || !ReadExact(fp, &len, sizeof(len))) { break; }
+            args.resize(len);
+            if (!ReadExact(fp, args.data(), len)) { break; }
+            auto it = formats.find(id);
+            const char* fmt = it == formats.end() ? "<unknown format>" : it->second.c_str();
+
+            struct timeval tv;
+            tv.tv_sec = timeNs / 1000000000;
+            tv.tv_usec = (timeNs % 1000000000) / 1000;
+            char prefix[TimeCache::LOG_PREFIX_LEN];
+            size_t prefixLen = TimeCache::FormatLogPrefix(prefix, tv);
+            line.clear();
+            if (json) {
+                BinLog::AppendJsonLine(prefix, prefixLen, level, fmt, args.data(), len, argc, line);
+            }
+            else {
+                BinLog::AppendTextLine(prefix, prefixLen, level, fmt, args.data(), len, argc, line);
+            }
+            fwrite(line.data(), 1, line.size(), stdout);
+        }
+        else {
+            fprintf(stderr, "%s: corrupt record tag 0x%02x\n", path, tag);
+            fclose(fp);
+            return 1;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    bool json = false;
+    int first = 1;
+    if (argc > 1 && strcmp(argv[1], "-j") == 0) {
+        json = true;
+        first = 2;
+    }
+    if (first >= argc) {
+        fprintf(stderr, "usage: %s [-j] file...\n", argv[0]);
+        return 1;
+    }
+    int ret = 0;
+    for (int i = first; i < argc; i++) {
+        ret |= Decode(argv[i], json);
+    }
+    return ret;
+}